@@ -0,0 +1,373 @@
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "arena.h"
+#include "stats.h"
+
+// Alignment of every allocation, enough for any scalar type and for the unaligned SIMD loads the kernels use
+#define ARENA_ALIGN 16
+// Bytes in front of every allocation that record its size, kept at ARENA_ALIGN so the allocation stays aligned
+#define ARENA_HEADER ARENA_ALIGN
+// Smallest block requested from malloc
+#define ARENA_BLOCK (1024 * 1024)
+
+#define ALIGN_UP(size) (((size) + ARENA_ALIGN - 1) & ~(size_t)(ARENA_ALIGN - 1))
+
+struct ArenaBlock {
+    ArenaBlock *next;
+    size_t size;
+    size_t used;
+};
+
+// The arena the calling thread's working memory comes from, or NULL to use malloc
+static _Thread_local Arena *attachedArena = NULL;
+
+static unsigned char *blockData(ArenaBlock *block);
+static ArenaBlock *addBlock(Arena *arena, size_t needed);
+static void freeBlocks(Arena *arena);
+
+static unsigned char *blockData(ArenaBlock *block) {
+    /*
+    Summary:
+        Returns the first usable byte of a block, just past its aligned bookkeeping.
+
+    Args:
+        block (ArenaBlock*): The block.
+
+    Return:
+        Returns a pointer into the block; no memory is allocated.
+    */
+
+    return (unsigned char *)block + ALIGN_UP(sizeof(ArenaBlock));
+}
+
+static ArenaBlock *addBlock(Arena *arena, size_t needed) {
+    /*
+    Summary:
+        Allocates a new block that becomes the one allocations are carved from. Blocks are only as large as needed;
+        resetArena() merges them afterwards, so over-reserving here would stay reserved for the rest of the run.
+
+    Args:
+        arena (Arena*): The arena to grow.
+        needed (size_t): The number of bytes the block must be able to hold.
+
+    Return:
+        Returns the new block, or NULL if malloc fails.
+    */
+
+    size_t size = needed > ARENA_BLOCK ? needed : ARENA_BLOCK;
+
+    if (size > SIZE_MAX - ALIGN_UP(sizeof(ArenaBlock))) return NULL;
+
+    countAllocation(ALIGN_UP(sizeof(ArenaBlock)) + size);
+
+    ArenaBlock *block = (ArenaBlock *)malloc(ALIGN_UP(sizeof(ArenaBlock)) + size);
+
+    if (!block) return NULL;
+
+    block->next = arena->blocks;
+    block->size = size;
+    block->used = 0;
+    arena->blocks = block;
+    arena->reserved += size;
+
+    return block;
+}
+
+static void freeBlocks(Arena *arena) {
+    /*
+    Summary:
+        Returns every block of an arena to malloc and leaves the arena empty.
+
+    Args:
+        arena (Arena*): The arena to empty.
+
+    Return:
+        This function does not return any value.
+    */
+
+    while (arena->blocks) {
+        ArenaBlock *next = arena->blocks->next;
+
+        free(arena->blocks);
+        arena->blocks = next;
+    }
+
+    arena->reserved = 0;
+    arena->last = NULL;
+}
+
+void initArena(Arena *arena) {
+    /*
+    Summary:
+        Initialises an empty arena. No memory is reserved until the first allocation.
+
+    Args:
+        arena (Arena*): The arena to initialise.
+
+    Return:
+        This function does not return any value.
+    */
+
+    arena->blocks = NULL;
+    arena->reserved = 0;
+    arena->last = NULL;
+}
+
+void *arenaAlloc(Arena *arena, size_t size) {
+    /*
+    Summary:
+        Carves an allocation out of the current block by bumping a pointer, adding a block if it does not fit.
+        Allocations are only released all at once by resetArena(), apart from the most recent one, which can still
+        grow or be given back in place.
+
+    Args:
+        arena (Arena*): The arena to allocate from.
+        size (size_t): The number of bytes to allocate.
+
+    Return:
+        Returns memory aligned to ARENA_ALIGN bytes, or NULL if the arena cannot grow.
+    */
+
+    if (size > SIZE_MAX - ARENA_HEADER - ARENA_ALIGN) return NULL;
+
+    size_t needed = ARENA_HEADER + ALIGN_UP(size);
+    ArenaBlock *block = arena->blocks;
+
+    if (!block || block->size - block->used < needed) block = addBlock(arena, needed);
+
+    if (!block) return NULL;
+
+    unsigned char *pointer = blockData(block) + block->used + ARENA_HEADER;
+
+    *(size_t *)(pointer - ARENA_HEADER) = size;
+    block->used += needed;
+    arena->last = pointer;
+
+    return pointer;
+}
+
+void *arenaRealloc(Arena *arena, void *pointer, size_t size) {
+    /*
+    Summary:
+        Resizes an allocation from the arena. The most recent allocation grows in place while the block has room,
+        which is how decoders that keep doubling one buffer use it; any other allocation that has to grow is copied
+        to a new one, and the old bytes stay reserved until the arena is reset.
+
+    Args:
+        arena (Arena*): The arena the allocation came from.
+        pointer (void*): The allocation to resize, or NULL to allocate.
+        size (size_t): The new size in bytes.
+
+    Return:
+        Returns the resized memory, or NULL if the arena cannot grow, in which case pointer is left untouched.
+    */
+
+    if (!pointer) return arenaAlloc(arena, size);
+
+    unsigned char *bytes = (unsigned char *)pointer;
+    size_t *header = (size_t *)(bytes - ARENA_HEADER);
+
+    if (bytes == arena->last && size <= SIZE_MAX - ARENA_ALIGN) {
+        ArenaBlock *block = arena->blocks;
+        size_t end = (size_t)(bytes - blockData(block)) + ALIGN_UP(size);
+
+        if (end <= block->size) {
+            block->used = end;
+            *header = size;
+            return pointer;
+        }
+    } else if (size <= *header) {
+        *header = size;
+        return pointer;
+    }
+
+    size_t kept = *header < size ? *header : size;
+    void *moved = arenaAlloc(arena, size);
+
+    if (moved) memcpy(moved, pointer, kept);
+
+    return moved;
+}
+
+void arenaFree(Arena *arena, void *pointer) {
+    /*
+    Summary:
+        Releases an allocation from the arena. Only the most recent allocation actually gives its bytes back; all
+        others are reclaimed by resetArena().
+
+    Args:
+        arena (Arena*): The arena the allocation came from.
+        pointer (void*): The allocation to release.
+
+    Return:
+        This function does not return any value.
+    */
+
+    unsigned char *bytes = (unsigned char *)pointer;
+
+    if (!bytes || bytes != arena->last) return;
+
+    arena->blocks->used = (size_t)(bytes - ARENA_HEADER - blockData(arena->blocks));
+    arena->last = NULL;
+}
+
+bool arenaOwns(const Arena *arena, const void *pointer) {
+    /*
+    Summary:
+        Checks whether memory was carved out of the arena. Once the arena has settled after a reset it has a single
+        block, so this is one range check.
+
+    Args:
+        arena (const Arena*): The arena.
+        pointer (const void*): The memory to look up.
+
+    Return:
+        Returns true if pointer lies inside one of the arena's blocks.
+    */
+
+    uintptr_t address = (uintptr_t)pointer;
+
+    for (ArenaBlock *block = arena->blocks; block; block = block->next) {
+        uintptr_t start = (uintptr_t)blockData(block);
+
+        if (address >= start && address < start + block->size) return true;
+    }
+
+    return false;
+}
+
+void resetArena(Arena *arena) {
+    /*
+    Summary:
+        Releases every allocation at once, keeping the reserved memory for the next image. If the last image needed
+        more than one block, they are replaced by a single block as large as all of them together, so any image no
+        larger than the ones before fits in one block and a reset is just setting its fill level back to zero.
+
+    Args:
+        arena (Arena*): The arena to reset. Nothing allocated from it may be used afterwards.
+
+    Return:
+        This function does not return any value.
+
+    Note:
+        The arena never shrinks, so a long batch settles at the working memory of its largest image instead of
+        growing and shrinking the heap with every image.
+    */
+
+    arena->last = NULL;
+
+    if (!arena->blocks) return;
+
+    if (arena->blocks->next) {
+        size_t reserved = arena->reserved;
+
+        freeBlocks(arena);
+        addBlock(arena, reserved);
+        return;
+    }
+
+    arena->blocks->used = 0;
+}
+
+void destroyArena(Arena *arena) {
+    /*
+    Summary:
+        Returns all memory reserved by an arena to the system.
+
+    Args:
+        arena (Arena*): The arena to destroy; it is left empty and can be used again.
+
+    Return:
+        This function does not return any value.
+    */
+
+    freeBlocks(arena);
+}
+
+void attachArena(Arena *arena) {
+    /*
+    Summary:
+        Makes an arena the source of the calling thread's working memory: from now on workAlloc(), workRealloc() and
+        workFree() on this thread go to it. The image decoder, libpng, zlib and the per-image buffers of the
+        command-line tool all allocate through those functions, so an image processed between attachArena() and
+        resetArena() makes no calls to malloc once the arena has grown to fit it.
+
+    Args:
+        arena (Arena*): The arena to use, or NULL to go back to malloc.
+
+    Return:
+        This function does not return any value.
+
+    Note:
+        Working memory must be released on the thread that allocated it, and before its arena is reset.
+    */
+
+    attachedArena = arena;
+}
+
+void *workAlloc(size_t size) {
+    /*
+    Summary:
+        Allocates working memory for the image being processed: from the calling thread's arena if one is attached,
+        otherwise from malloc. Heap allocations are counted in the thread's statistics.
+
+    Args:
+        size (size_t): The number of bytes to allocate.
+
+    Return:
+        Returns the allocated memory, or NULL if allocation fails. Release it with workFree().
+    */
+
+    Arena *arena = attachedArena;
+
+    if (arena) return arenaAlloc(arena, size);
+
+    countAllocation(size);
+
+    return malloc(size);
+}
+
+void *workRealloc(void *pointer, size_t size) {
+    /*
+    Summary:
+        Resizes working memory allocated by workAlloc(), like realloc().
+
+    Args:
+        pointer (void*): The memory to resize, or NULL to allocate.
+        size (size_t): The new size in bytes.
+
+    Return:
+        Returns the resized memory, or NULL if allocation fails, in which case pointer is left untouched.
+    */
+
+    Arena *arena = attachedArena;
+
+    if (arena && (!pointer || arenaOwns(arena, pointer))) return arenaRealloc(arena, pointer, size);
+
+    countAllocation(size);
+
+    return realloc(pointer, size);
+}
+
+void workFree(void *pointer) {
+    /*
+    Summary:
+        Releases working memory allocated by workAlloc() or workRealloc(). Memory from an arena is reclaimed when the
+        arena is reset; anything else goes back to free().
+
+    Args:
+        pointer (void*): The memory to release, or NULL.
+
+    Return:
+        This function does not return any value.
+    */
+
+    Arena *arena = attachedArena;
+
+    if (!pointer) return;
+
+    if (arena && arenaOwns(arena, pointer)) arenaFree(arena, pointer);
+    else free(pointer);
+}
@@ -0,0 +1,27 @@
+#ifndef ARENA_H
+#define ARENA_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+typedef struct ArenaBlock ArenaBlock;
+
+typedef struct {
+    ArenaBlock *blocks;
+    size_t reserved;
+    unsigned char *last;
+} Arena;
+
+void initArena(Arena *arena);
+void *arenaAlloc(Arena *arena, size_t size);
+void *arenaRealloc(Arena *arena, void *pointer, size_t size);
+void arenaFree(Arena *arena, void *pointer);
+bool arenaOwns(const Arena *arena, const void *pointer);
+void resetArena(Arena *arena);
+void destroyArena(Arena *arena);
+void attachArena(Arena *arena);
+void *workAlloc(size_t size);
+void *workRealloc(void *pointer, size_t size);
+void workFree(void *pointer);
+
+#endif
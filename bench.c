@@ -0,0 +1,1261 @@
+#include <math.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include <zlib.h>
+#endif
+
+#include "carrier.h"
+#include "codec.h"
+#include "crc32c.h"
+#include "image.h"
+#include "lsb.h"
+#include "pool.h"
+#include "stego.h"
+#include "stego_internal.h"
+#include "stb/stb_image_write.h"
+
+#define MAX_SIZES 16
+#define MAX_SCATTER_MODES 8
+// Scatter mode that embeds the payload sequentially
+#define SCATTER_OFF -1
+#define KILOBYTE 1024
+#define MEGABYTE (1024 * 1024)
+
+typedef struct {
+    double sizes[MAX_SIZES];
+    int sizeCount;
+    int scatterModes[MAX_SCATTER_MODES];
+    int scatterCount;
+    bool rgb;
+    bool rgba;
+    int runs;
+    bool json;
+    bool decodeOnly;
+    bool codecOnly;
+    bool checksumOnly;
+    int threads;
+    int missCounter;
+    PngOptions pngOptions;
+    StegoOptions stegoOptions;
+} BenchConfig;
+
+typedef struct {
+    double load;
+    double pack;
+    double embed;
+    double write;
+    double extract;
+    size_t pngBytes;
+    size_t allocations;
+    size_t allocatedBytes;
+    long long embedMisses;
+    long long extractMisses;
+} BenchRun;
+
+typedef struct {
+    unsigned char *bytes;
+    size_t length;
+    size_t capacity;
+} DecodedPayload;
+
+static atomic_size_t allocationCount;
+static atomic_size_t allocationBytes;
+
+#ifdef __GLIBC__
+// Every allocation in the process, including those made inside libpng and zlib, is counted on its way to glibc
+extern void *__libc_malloc(size_t size);
+extern void *__libc_calloc(size_t count, size_t size);
+extern void *__libc_realloc(void *pointer, size_t size);
+
+void *malloc(size_t size) {
+    atomic_fetch_add_explicit(&allocationCount, 1, memory_order_relaxed);
+    atomic_fetch_add_explicit(&allocationBytes, size, memory_order_relaxed);
+    return __libc_malloc(size);
+}
+
+void *calloc(size_t count, size_t size) {
+    atomic_fetch_add_explicit(&allocationCount, 1, memory_order_relaxed);
+    atomic_fetch_add_explicit(&allocationBytes, count * size, memory_order_relaxed);
+    return __libc_calloc(count, size);
+}
+
+void *realloc(void *pointer, size_t size) {
+    atomic_fetch_add_explicit(&allocationCount, 1, memory_order_relaxed);
+    atomic_fetch_add_explicit(&allocationBytes, size, memory_order_relaxed);
+    return __libc_realloc(pointer, size);
+}
+#endif
+
+static bool parseSizes(const char *list, BenchConfig *config);
+static bool parseLayouts(const char *list, BenchConfig *config);
+static bool parseScatterModes(const char *list, BenchConfig *config);
+static double elapsedSeconds(struct timespec *start);
+static int openMissCounter(void);
+static void startMissCounter(int counter);
+static long long readMissCounter(int counter);
+static void synthesizeCarrier(StegoImage *image, double megapixels, int channels);
+static void fillPayload(unsigned char *payload, size_t length);
+static bool runPipeline(const PngMemory *carrier, const unsigned char *payload, size_t length, unsigned char *output,
+                        const BenchConfig *config, const StegoOptions *stegoOptions, WorkerPool *pool, BenchRun *run);
+static void printRow(const BenchConfig *config, double megapixels, int channels, const StegoImage *image, size_t length,
+                     int scatter, const BenchRun *best, bool *first);
+static void printMisses(long long misses, bool json);
+static bool benchCarrier(const BenchConfig *config, double megapixels, int channels, WorkerPool *pool, bool *first);
+static void appendBytes(void *context, void *data, int size);
+static bool encodeCarrier(StegoImage *image, const char *format, PngMemory *memory);
+static bool decodeCarrier(const PngMemory *memory, bool headerOnly, double *seconds);
+static bool benchDecode(const BenchConfig *config, double megapixels, int channels, bool *first);
+static void fillLogPayload(unsigned char *payload, size_t length);
+static bool collectDecoded(void *context, const unsigned char *bytes, size_t length);
+static bool benchCodec(const BenchConfig *config, const char *kind, size_t length, bool *first);
+static bool benchChecksum(const BenchConfig *config, size_t length, bool *first);
+
+int main(int argc, char *argv[]) {
+    /*
+    USE CASE
+        Built and run by "make bench"; arguments can be passed with BENCH_ARGS="...".
+            ./stegano-bench [--sizes 1,12,48,100] [--layouts rgb,rgba] [--runs N] [--json] [-j N] [-k N] [--preset NAME]
+                            [--scatter off,0,9]
+            ./stegano-bench --decode [--sizes ...] [--layouts ...] [--runs N] [--json]
+            ./stegano-bench --codecs [--runs N] [--json] [-k N]
+            ./stegano-bench --checksums [--runs N] [--json]
+
+        Every carrier is generated in memory, compressed to a PNG once, and then run through the whole pipeline for
+        payloads of 1 KB, 1 MB and the full capacity: load (PNG decode), pack (payload scan and checksum for the
+        header), embed, PNG write (compressed in memory, nothing goes to disk) and extract. One row is printed per
+        carrier and payload with the time and MB/s of every stage, the best of --runs runs, and the number of
+        allocations and bytes allocated by one run. PNGs are written with the fast preset unless --preset says
+        otherwise, since libpng's defaults make the write stage dominate the run time of the whole suite.
+
+        --scatter repeats every payload for each listed embedding order: "off" is sequential, and a number spreads the
+        payload with a key in blocks of 2^N carrier bytes, so 0 scatters single bytes. Where the kernel allows it, the
+        last-level cache misses of the embed and extract stages are counted as well, to show what scattering costs
+        and how much of it blocking wins back; the columns are empty (null in JSON) when the counter is unavailable.
+
+        --decode runs a decode-only suite instead: every carrier is encoded as PNG, BMP, TGA and JPEG in memory, and
+        each is decoded by every backend that reads it, in full and again only as far as the rows that hold the
+        stego header. One row is printed per carrier, format and backend.
+
+        --codecs runs a payload compression suite instead: JSON log lines and random bytes of 64 KB, 1 MB and 16 MB
+        are compressed with every codec and level the encoder offers, and decompressed again through the same
+        streaming decoder decode() uses. One row is printed per payload and codec with the compression ratio, both
+        throughputs in payload MB/s and the carrier bytes the packed payload takes at -k bits per channel.
+
+        --checksums times the payload checksum alone on 4 KB, 1 MB and 16 MB of random bytes: the CRC-32C of the
+        header with the kernel picked for this CPU (STEGO_CRC_KERNEL=table, sse4.2 or pclmul forces one) against the
+        zlib CRC-32 of version 1 headers. One row is printed per size and checksum.
+    */
+
+    BenchConfig config;
+    double defaultSizes[] = {1, 12, 48, 100};
+
+    memcpy(config.sizes, defaultSizes, sizeof(defaultSizes));
+    config.sizeCount = 4;
+    config.scatterModes[0] = SCATTER_OFF;
+    config.scatterCount = 1;
+    config.rgb = true;
+    config.rgba = true;
+    config.runs = 1;
+    config.json = false;
+    config.decodeOnly = false;
+    config.codecOnly = false;
+    config.checksumOnly = false;
+    config.threads = defaultThreadCount();
+    parsePngPreset("fast", &config.pngOptions);
+    initStegoOptions(&config.stegoOptions);
+
+    for (int arg = 1; arg < argc; arg++) {
+        bool hasValue = arg + 1 < argc;
+
+        if (strcmp(argv[arg], "--sizes") == 0 && hasValue) {
+            if (!parseSizes(argv[++arg], &config)) {
+                fprintf(stderr, "Invalid sizes\n");
+                return 1;
+            }
+        } else if (strcmp(argv[arg], "--layouts") == 0 && hasValue) {
+            if (!parseLayouts(argv[++arg], &config)) {
+                fprintf(stderr, "Invalid layouts\n");
+                return 1;
+            }
+        } else if (strcmp(argv[arg], "--runs") == 0 && hasValue) {
+            config.runs = atoi(argv[++arg]);
+
+            if (config.runs < 1) {
+                fprintf(stderr, "Invalid run count\n");
+                return 1;
+            }
+        } else if (strcmp(argv[arg], "-j") == 0 && hasValue) {
+            config.threads = atoi(argv[++arg]);
+
+            if (config.threads < 1) {
+                fprintf(stderr, "Invalid thread count\n");
+                return 1;
+            }
+        } else if (strcmp(argv[arg], "-k") == 0 && hasValue) {
+            config.stegoOptions.bitsPerChannel = atoi(argv[++arg]);
+
+            if (config.stegoOptions.bitsPerChannel < 1 || config.stegoOptions.bitsPerChannel > 4) {
+                fprintf(stderr, "Invalid bits per channel\n");
+                return 1;
+            }
+        } else if (strcmp(argv[arg], "--preset") == 0 && hasValue) {
+            if (!parsePngPreset(argv[++arg], &config.pngOptions)) {
+                fprintf(stderr, "Invalid preset\n");
+                return 1;
+            }
+        } else if (strcmp(argv[arg], "--scatter") == 0 && hasValue) {
+            if (!parseScatterModes(argv[++arg], &config)) {
+                fprintf(stderr, "Invalid scatter modes\n");
+                return 1;
+            }
+        } else if (strcmp(argv[arg], "--json") == 0) {
+            config.json = true;
+        } else if (strcmp(argv[arg], "--decode") == 0) {
+            config.decodeOnly = true;
+        } else if (strcmp(argv[arg], "--codecs") == 0) {
+            config.codecOnly = true;
+        } else if (strcmp(argv[arg], "--checksums") == 0) {
+            config.checksumOnly = true;
+        } else {
+            fprintf(stderr, "Unknown argument: %s\n", argv[arg]);
+            return 1;
+        }
+    }
+
+    initImageBackend();
+    stegoInit();
+
+    if (config.checksumOnly) {
+        size_t lengths[] = {4 * KILOBYTE, MEGABYTE, 16 * MEGABYTE};
+        bool first = true;
+        bool ok = true;
+
+        if (config.json) printf("[");
+        else printf("payload_bytes,checksum,kernel,ms,MBps\n");
+
+        for (size_t length = 0; length < sizeof(lengths) / sizeof(lengths[0]) && ok; length++) {
+            ok = benchChecksum(&config, lengths[length], &first);
+        }
+
+        if (config.json) printf("\n]\n");
+
+        return ok ? 0 : 1;
+    }
+
+    if (config.decodeOnly) {
+        bool first = true;
+        bool ok = true;
+
+        if (config.json) printf("[");
+        else printf("megapixels,layout,format,backend,encoded_bytes,full_ms,full_MBps,header_ms\n");
+
+        for (int size = 0; size < config.sizeCount && ok; size++) {
+            if (config.rgb) ok = benchDecode(&config, config.sizes[size], 3, &first) && ok;
+
+            if (config.rgba) ok = benchDecode(&config, config.sizes[size], 4, &first) && ok;
+        }
+
+        if (config.json) printf("\n]\n");
+
+        return ok ? 0 : 1;
+    }
+
+    if (config.codecOnly) {
+        static const char *kinds[] = {"json", "random"};
+        size_t lengths[] = {64 * KILOBYTE, MEGABYTE, 16 * MEGABYTE};
+        bool first = true;
+        bool ok = true;
+
+        if (config.json) printf("[");
+        else {
+            printf("payload,payload_bytes,codec,level,packed_bytes,ratio,compress_ms,compress_MBps,decompress_ms,"
+                   "decompress_MBps,carrier_bytes\n");
+        }
+
+        for (size_t kind = 0; kind < sizeof(kinds) / sizeof(kinds[0]) && ok; kind++) {
+            for (size_t length = 0; length < sizeof(lengths) / sizeof(lengths[0]) && ok; length++) {
+                ok = benchCodec(&config, kinds[kind], lengths[length], &first);
+            }
+        }
+
+        if (config.json) printf("\n]\n");
+
+        return ok ? 0 : 1;
+    }
+
+    // Opened before the pool starts its threads, so their misses are inherited by the counter
+    config.missCounter = openMissCounter();
+
+    WorkerPool *pool = createWorkerPool(config.threads);
+    bool first = true;
+    bool ok = pool != NULL;
+
+    if (config.json) printf("[");
+    else {
+        printf("megapixels,layout,width,height,payload_bytes,bits,scatter,threads,kernel,load_ms,load_MBps,pack_ms,"
+               "pack_MBps,embed_ms,embed_MBps,embed_misses,write_ms,write_MBps,png_bytes,extract_ms,extract_MBps,"
+               "extract_misses,allocs,alloc_bytes\n");
+    }
+
+    for (int size = 0; size < config.sizeCount && ok; size++) {
+        if (config.rgb) ok = benchCarrier(&config, config.sizes[size], 3, pool, &first) && ok;
+
+        if (config.rgba) ok = benchCarrier(&config, config.sizes[size], 4, pool, &first) && ok;
+    }
+
+    if (config.json) printf("\n]\n");
+
+    destroyWorkerPool(pool);
+
+#ifdef __linux__
+    if (config.missCounter >= 0) close(config.missCounter);
+#endif
+
+    return ok ? 0 : 1;
+}
+
+static bool parseSizes(const char *list, BenchConfig *config) {
+    /*
+    Summary:
+        Parses a comma-separated list of carrier sizes in megapixels, such as "1,12,48,100".
+
+    Args:
+        list (const char*): The list to parse.
+        config (BenchConfig*): Receives the sizes.
+
+    Return:
+        Returns true if every entry is a positive number and there are at most MAX_SIZES of them, false otherwise.
+    */
+
+    config->sizeCount = 0;
+
+    while (*list) {
+        char *end;
+        double megapixels = strtod(list, &end);
+
+        if (end == list || megapixels <= 0 || config->sizeCount == MAX_SIZES) return false;
+
+        config->sizes[config->sizeCount++] = megapixels;
+        list = *end == ',' ? end + 1 : end;
+
+        if (*end != ',' && *end != '\0') return false;
+    }
+
+    return config->sizeCount > 0;
+}
+
+static bool parseLayouts(const char *list, BenchConfig *config) {
+    /*
+    Summary:
+        Parses the pixel layouts to generate carriers in: "rgb", "rgba" or "rgb,rgba".
+
+    Args:
+        list (const char*): The list to parse.
+        config (BenchConfig*): Receives the layouts.
+
+    Return:
+        Returns true if the list names at least one known layout and nothing else, false otherwise.
+    */
+
+    config->rgb = strcmp(list, "rgb") == 0 || strcmp(list, "rgb,rgba") == 0 || strcmp(list, "rgba,rgb") == 0;
+    config->rgba = strcmp(list, "rgba") == 0 || strcmp(list, "rgb,rgba") == 0 || strcmp(list, "rgba,rgb") == 0;
+
+    return config->rgb || config->rgba;
+}
+
+static bool parseScatterModes(const char *list, BenchConfig *config) {
+    /*
+    Summary:
+        Parses a comma-separated list of embedding orders, such as "off,0,9": "off" for sequential embedding, or the
+        base-2 logarithm of the scatter block size.
+
+    Args:
+        list (const char*): The list to parse.
+        config (BenchConfig*): Receives the modes.
+
+    Return:
+        Returns true if every entry is "off" or a block size the library supports and there are at most
+        MAX_SCATTER_MODES of them, false otherwise.
+    */
+
+    config->scatterCount = 0;
+
+    while (*list) {
+        char *end;
+        int mode;
+
+        if (strncmp(list, "off", 3) == 0) {
+            mode = SCATTER_OFF;
+            end = (char *)list + 3;
+        } else {
+            long blockBits = strtol(list, &end, 10);
+
+            if (end == list || blockBits < 0 || blockBits > STEGO_MAX_SCATTER_BLOCK_BITS) return false;
+
+            mode = (int)blockBits;
+        }
+
+        if ((*end != ',' && *end != '\0') || config->scatterCount == MAX_SCATTER_MODES) return false;
+
+        config->scatterModes[config->scatterCount++] = mode;
+        list = *end == ',' ? end + 1 : end;
+    }
+
+    return config->scatterCount > 0;
+}
+
+static double elapsedSeconds(struct timespec *start) {
+    /*
+    Summary:
+        Returns the wall-clock time that has passed since start and resets start to now, so consecutive stages can
+        be timed with a single timestamp.
+
+    Args:
+        start (struct timespec*): The timestamp to measure from; it is updated to the current time.
+
+    Return:
+        Returns the elapsed time in seconds.
+    */
+
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+
+    double seconds = (double)(now.tv_sec - start->tv_sec) + (now.tv_nsec - start->tv_nsec) / 1e9;
+
+    *start = now;
+
+    return seconds;
+}
+
+static int openMissCounter(void) {
+    /*
+    Summary:
+        Opens a counter of the last-level cache misses caused by the calling thread and by the threads it starts from
+        now on.
+
+    Args:
+        This function does not take any arguments.
+
+    Return:
+        Returns the counter, or -1 if the system does not provide one (not Linux, no PMU, or perf events disabled).
+    */
+
+#ifdef __linux__
+    struct perf_event_attr attributes;
+
+    memset(&attributes, 0, sizeof(attributes));
+    attributes.size = sizeof(attributes);
+    attributes.type = PERF_TYPE_HARDWARE;
+    attributes.config = PERF_COUNT_HW_CACHE_MISSES;
+    attributes.disabled = 1;
+    attributes.inherit = 1;
+    attributes.exclude_kernel = 1;
+    attributes.exclude_hv = 1;
+
+    return (int)syscall(SYS_perf_event_open, &attributes, 0, -1, -1, 0);
+#else
+    return -1;
+#endif
+}
+
+static void startMissCounter(int counter) {
+    /*
+    Summary:
+        Clears a cache-miss counter and starts it.
+
+    Args:
+        counter (int): The counter from openMissCounter(), or -1.
+
+    Return:
+        This function does not return any value; it does nothing without a counter.
+    */
+
+#ifdef __linux__
+    if (counter < 0) return;
+
+    ioctl(counter, PERF_EVENT_IOC_RESET, 0);
+    ioctl(counter, PERF_EVENT_IOC_ENABLE, 0);
+#else
+    (void)counter;
+#endif
+}
+
+static long long readMissCounter(int counter) {
+    /*
+    Summary:
+        Stops a cache-miss counter and reads it.
+
+    Args:
+        counter (int): The counter from openMissCounter(), or -1.
+
+    Return:
+        Returns the number of misses since startMissCounter(), or -1 if there is no counter or it cannot be read.
+    */
+
+#ifdef __linux__
+    long long misses;
+
+    if (counter < 0) return -1;
+
+    ioctl(counter, PERF_EVENT_IOC_DISABLE, 0);
+
+    return read(counter, &misses, sizeof(misses)) == sizeof(misses) ? misses : -1;
+#else
+    (void)counter;
+    return -1;
+#endif
+}
+
+static void synthesizeCarrier(StegoImage *image, double megapixels, int channels) {
+    /*
+    Summary:
+        Generates a 4:3 8-bit carrier of roughly the given size: smooth gradients with a little noise, so it
+        compresses like a photograph rather than like flat colour or pure noise. The alpha channel of RGBA carriers is
+        a gentle gradient as well.
+
+    Args:
+        image (StegoImage*): Receives the carrier; pixels is NULL if memory allocation fails. The caller frees pixels.
+        megapixels (double): The number of pixels, in millions.
+        channels (int): 3 for RGB or 4 for RGBA.
+
+    Return:
+        This function does not return any value; it fills in the image.
+    */
+
+    double pixels = megapixels * 1e6;
+
+    image->width = (int)(sqrt(pixels * 4 / 3) + 0.5);
+    image->height = (int)(pixels / image->width + 0.5);
+    image->channels = channels;
+    image->bitDepth = 8;
+    image->stride = (size_t)image->width * channels;
+    image->pixels = (unsigned char *)malloc((size_t)image->height * image->stride);
+
+    if (!image->pixels) return;
+
+    uint32_t noise = 2463534242u;
+
+    for (int y = 0; y < image->height; y++) {
+        unsigned char *row = image->pixels + (size_t)y * image->stride;
+
+        for (int x = 0; x < image->width; x++) {
+            noise ^= noise << 13;
+            noise ^= noise >> 17;
+            noise ^= noise << 5;
+
+            row[x * channels] = (unsigned char)(x * 255 / image->width + (noise & 7));
+            row[x * channels + 1] = (unsigned char)(y * 255 / image->height + ((noise >> 3) & 7));
+            row[x * channels + 2] = (unsigned char)((x + y) * 127 / (image->width + image->height) + ((noise >> 6) & 7));
+
+            if (channels == 4) row[x * channels + 3] = (unsigned char)(192 + y * 63 / image->height);
+        }
+    }
+}
+
+static void fillPayload(unsigned char *payload, size_t length) {
+    /*
+    Summary:
+        Fills a payload with pseudo-random bytes. The high bit is set in the first byte, so the payload is always
+        embedded as binary data (8 bits per byte) and the numbers do not depend on the random contents.
+
+    Args:
+        payload (unsigned char*): The buffer to fill.
+        length (size_t): The number of bytes.
+
+    Return:
+        This function does not return any value.
+    */
+
+    uint64_t state = 0x9E3779B97F4A7C15u;
+
+    for (size_t index = 0; index < length; index++) {
+        state ^= state << 7;
+        state ^= state >> 9;
+        payload[index] = (unsigned char)state;
+    }
+
+    if (length > 0) payload[0] |= 0x80;
+}
+
+static bool runPipeline(const PngMemory *carrier, const unsigned char *payload, size_t length, unsigned char *output,
+                        const BenchConfig *config, const StegoOptions *stegoOptions, WorkerPool *pool, BenchRun *run) {
+    /*
+    Summary:
+        Runs one carrier and payload through every stage of an encode followed by a decode, timing each stage and
+        counting the allocations made along the way.
+
+    Args:
+        carrier (const PngMemory*): The carrier, as a PNG in memory.
+        payload (const unsigned char*): The payload to embed.
+        length (size_t): The number of bytes in the payload.
+        output (unsigned char*): A buffer of at least length bytes that the payload is extracted into.
+        config (const BenchConfig*): The PNG options and the cache-miss counter to use.
+        stegoOptions (const StegoOptions*): How the payload is embedded.
+        pool (WorkerPool*): The pool embedding and extraction run on.
+        run (BenchRun*): Receives the stage timings, the cache misses, the PNG size and the allocation counts.
+
+    Return:
+        Returns true if the payload came back intact, false if a stage failed (an error goes to stderr).
+    */
+
+    StegoImage image;
+    StegoHeader header;
+    struct timespec start;
+    size_t allocations = atomic_load(&allocationCount);
+    size_t allocatedBytes = atomic_load(&allocationBytes);
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+
+    if (!loadImageFromMemory(carrier->bytes, carrier->length, &image)) {
+        fprintf(stderr, "Error loading the synthetic carrier\n");
+        return false;
+    }
+
+    run->load = elapsedSeconds(&start);
+
+    initStegoHeader(&header, payload, length, stegoOptions);
+    run->pack = elapsedSeconds(&start);
+
+    startMissCounter(config->missCounter);
+    embedMessage(&image, &header, payload, pool);
+    run->embedMisses = readMissCounter(config->missCounter);
+    run->embed = elapsedSeconds(&start);
+
+    bool written = measurePngWrite(&image, &config->pngOptions, &run->pngBytes);
+
+    run->write = elapsedSeconds(&start);
+
+    startMissCounter(config->missCounter);
+    uint32_t checksum = extractMessage(&image, &header, output, pool);
+    run->extractMisses = readMissCounter(config->missCounter);
+    run->extract = elapsedSeconds(&start);
+
+    freeImage(&image);
+    run->allocations = atomic_load(&allocationCount) - allocations;
+    run->allocatedBytes = atomic_load(&allocationBytes) - allocatedBytes;
+
+    if (!written) {
+        fprintf(stderr, "Error writing the PNG\n");
+        return false;
+    }
+
+    if (memcmp(payload, output, length) != 0 || checksum != header.checksum) {
+        fprintf(stderr, "Round trip failed for a %zu byte payload\n", length);
+        return false;
+    }
+
+    return true;
+}
+
+static void printRow(const BenchConfig *config, double megapixels, int channels, const StegoImage *image, size_t length,
+                     int scatter, const BenchRun *best, bool *first) {
+    /*
+    Summary:
+        Prints the results for one carrier and payload as a CSV row, or as a JSON object when --json is given.
+        Decode and write throughput is given in pixel MB/s, the other stages in payload MB/s.
+
+    Args:
+        config (const BenchConfig*): The benchmark settings.
+        megapixels (double): The requested carrier size.
+        channels (int): The number of channels of the carrier.
+        image (const StegoImage*): The carrier layout.
+        length (size_t): The payload length.
+        scatter (int): The scatter block bits, or SCATTER_OFF for sequential embedding.
+        best (const BenchRun*): The fastest time and fewest cache misses of every stage across the runs.
+        first (bool*): Whether this is the first JSON object; it is cleared.
+
+    Return:
+        This function does not return any value; it prints to stdout.
+    */
+
+    double imageMegabytes = (double)image->height * image->stride / 1e6;
+    double payloadMegabytes = (double)length / 1e6;
+    const char *layout = channels == 4 ? "rgba" : "rgb";
+    int bits = config->stegoOptions.bitsPerChannel;
+    char mode[16];
+
+    if (scatter == SCATTER_OFF) strcpy(mode, "off");
+    else snprintf(mode, sizeof(mode), "%d", scatter);
+
+    if (config->json) {
+        printf("%s\n  {\"megapixels\": %g, \"layout\": \"%s\", \"width\": %d, \"height\": %d, \"payload_bytes\": %zu, "
+               "\"bits\": %d, \"scatter\": \"%s\", \"threads\": %d, \"kernel\": \"%s\", \"load_ms\": %.3f, "
+               "\"load_MBps\": %.1f, \"pack_ms\": %.3f, \"pack_MBps\": %.1f, \"embed_ms\": %.3f, \"embed_MBps\": %.1f, "
+               "\"embed_misses\": ",
+               *first ? "" : ",", megapixels, layout, image->width, image->height, length, bits, mode, config->threads,
+               lsbKernelName(), best->load * 1e3, imageMegabytes / best->load, best->pack * 1e3,
+               payloadMegabytes / best->pack, best->embed * 1e3, payloadMegabytes / best->embed);
+        printMisses(best->embedMisses, true);
+        printf(", \"write_ms\": %.3f, \"write_MBps\": %.1f, \"png_bytes\": %zu, \"extract_ms\": %.3f, "
+               "\"extract_MBps\": %.1f, \"extract_misses\": ",
+               best->write * 1e3, imageMegabytes / best->write, best->pngBytes, best->extract * 1e3,
+               payloadMegabytes / best->extract);
+        printMisses(best->extractMisses, true);
+        printf(", \"allocs\": %zu, \"alloc_bytes\": %zu}", best->allocations, best->allocatedBytes);
+    } else {
+        printf("%g,%s,%d,%d,%zu,%d,%s,%d,%s,%.3f,%.1f,%.3f,%.1f,%.3f,%.1f,", megapixels, layout, image->width,
+               image->height, length, bits, mode, config->threads, lsbKernelName(), best->load * 1e3,
+               imageMegabytes / best->load, best->pack * 1e3, payloadMegabytes / best->pack, best->embed * 1e3,
+               payloadMegabytes / best->embed);
+        printMisses(best->embedMisses, false);
+        printf(",%.3f,%.1f,%zu,%.3f,%.1f,", best->write * 1e3, imageMegabytes / best->write, best->pngBytes,
+               best->extract * 1e3, payloadMegabytes / best->extract);
+        printMisses(best->extractMisses, false);
+        printf(",%zu,%zu\n", best->allocations, best->allocatedBytes);
+    }
+
+    fflush(stdout);
+    *first = false;
+}
+
+static void printMisses(long long misses, bool json) {
+    /*
+    Summary:
+        Prints a cache-miss count, or the marker for a count that is not available: nothing in CSV, null in JSON.
+
+    Args:
+        misses (long long): The count, or -1 if it is not available.
+        json (bool): Whether the row is JSON.
+
+    Return:
+        This function does not return any value; it prints to stdout.
+    */
+
+    if (misses >= 0) printf("%lld", misses);
+    else if (json) printf("null");
+}
+
+static bool benchCarrier(const BenchConfig *config, double megapixels, int channels, WorkerPool *pool, bool *first) {
+    /*
+    Summary:
+        Generates one synthetic carrier, compresses it to a PNG in memory with the fast preset (this setup is not
+        timed), and benchmarks it in every scatter mode with payloads of 1 KB, 1 MB and the full capacity of that
+        mode, skipping sizes that do not fit.
+
+    Args:
+        config (const BenchConfig*): The benchmark settings.
+        megapixels (double): The carrier size in millions of pixels.
+        channels (int): 3 for RGB or 4 for RGBA.
+        pool (WorkerPool*): The pool embedding and extraction run on.
+        first (bool*): Whether the next JSON object is the first.
+
+    Return:
+        Returns true if every run succeeded, false otherwise (errors go to stderr).
+    */
+
+    StegoImage image;
+    PngOptions setup;
+    PngMemory carrier = {NULL, 0, 0};
+    StegoOptions modeOptions[MAX_SCATTER_MODES];
+    size_t capacities[MAX_SCATTER_MODES];
+    size_t capacity = 0;
+
+    synthesizeCarrier(&image, megapixels, channels);
+
+    if (!image.pixels) {
+        fprintf(stderr, "Memory allocation failed\n");
+        return false;
+    }
+
+    parsePngPreset("fast", &setup);
+
+    bool encoded = writePngToMemory(&image, &setup, &carrier);
+
+    for (int mode = 0; mode < config->scatterCount; mode++) {
+        modeOptions[mode] = config->stegoOptions;
+        modeOptions[mode].scatter = config->scatterModes[mode] != SCATTER_OFF;
+        modeOptions[mode].key = 0x5EED5EED5EED5EEDu;
+        modeOptions[mode].scatterBlockBits = modeOptions[mode].scatter ? config->scatterModes[mode] : 0;
+        capacities[mode] = 0;
+        stegoCapacity(&image, &modeOptions[mode], 8, &capacities[mode]);
+        capacity = capacities[mode] > capacity ? capacities[mode] : capacity;
+    }
+
+    free(image.pixels);
+    image.pixels = NULL;
+
+    unsigned char *payload = (unsigned char *)malloc(capacity + 1);
+    unsigned char *output = (unsigned char *)malloc(capacity + 1);
+    bool ok = encoded && payload && output;
+
+    if (!ok) fprintf(stderr, "Error preparing a %g MP carrier\n", megapixels);
+    else fillPayload(payload, capacity);
+
+    for (int index = 0; index < 3 && ok; index++) {
+        for (int mode = 0; mode < config->scatterCount && ok; mode++) {
+            size_t lengths[] = {KILOBYTE, MEGABYTE, capacities[mode]};
+            size_t length = lengths[index];
+            BenchRun best = {0};
+
+            if (length > capacities[mode] || (index > 0 && length == lengths[index - 1])) continue;
+
+            for (int run = 0; run < config->runs && ok; run++) {
+                BenchRun current;
+
+                ok = runPipeline(&carrier, payload, length, output, config, &modeOptions[mode], pool, &current);
+
+                if (run == 0) best = current;
+                else {
+                    best.load = current.load < best.load ? current.load : best.load;
+                    best.pack = current.pack < best.pack ? current.pack : best.pack;
+                    best.embed = current.embed < best.embed ? current.embed : best.embed;
+                    best.write = current.write < best.write ? current.write : best.write;
+                    best.extract = current.extract < best.extract ? current.extract : best.extract;
+                    best.embedMisses = current.embedMisses < best.embedMisses ? current.embedMisses : best.embedMisses;
+                    best.extractMisses =
+                        current.extractMisses < best.extractMisses ? current.extractMisses : best.extractMisses;
+                }
+            }
+
+            if (ok) printRow(config, megapixels, channels, &image, length, config->scatterModes[mode], &best, first);
+        }
+    }
+
+    free(payload);
+    free(output);
+    free(carrier.bytes);
+
+    return ok;
+}
+
+static void appendBytes(void *context, void *data, int size) {
+    /*
+    Summary:
+        The stb_image_write output callback: appends the encoded bytes to a growable buffer.
+
+    Args:
+        context (void*): The PngMemory to append to; its capacity is set to SIZE_MAX once memory runs out.
+        data (void*): The bytes to append.
+        size (int): The number of bytes.
+
+    Return:
+        This function does not return any value.
+    */
+
+    PngMemory *memory = (PngMemory *)context;
+
+    if (memory->capacity == SIZE_MAX) return;
+
+    if (memory->length + size > memory->capacity) {
+        size_t capacity = memory->capacity * 2 > memory->length + size ? memory->capacity * 2 : memory->length + size;
+        unsigned char *bytes = (unsigned char *)realloc(memory->bytes, capacity);
+
+        if (!bytes) {
+            memory->capacity = SIZE_MAX;
+            return;
+        }
+
+        memory->bytes = bytes;
+        memory->capacity = capacity;
+    }
+
+    memcpy(memory->bytes + memory->length, data, size);
+    memory->length += size;
+}
+
+static bool encodeCarrier(StegoImage *image, const char *format, PngMemory *memory) {
+    /*
+    Summary:
+        Encodes a carrier in memory in one of the formats of the decode suite: PNG with the fast preset, BMP, TGA or
+        JPEG at quality 90 through stb_image_write.
+
+    Args:
+        image (StegoImage*): The 8-bit carrier to encode.
+        format (const char*): "png", "bmp", "tga" or "jpg".
+        memory (PngMemory*): Receives the encoded image; the caller frees its bytes.
+
+    Return:
+        Returns true if the image was encoded, false otherwise.
+    */
+
+    PngOptions fast;
+
+    memory->bytes = NULL;
+    memory->length = 0;
+    memory->capacity = 0;
+
+    if (strcmp(format, "png") == 0) {
+        parsePngPreset("fast", &fast);
+        return writePngToMemory(image, &fast, memory);
+    }
+
+    int written = 0;
+
+    if (strcmp(format, "bmp") == 0) {
+        written = stbi_write_bmp_to_func(appendBytes, memory, image->width, image->height, image->channels, image->pixels);
+    } else if (strcmp(format, "tga") == 0) {
+        written = stbi_write_tga_to_func(appendBytes, memory, image->width, image->height, image->channels, image->pixels);
+    } else if (strcmp(format, "jpg") == 0) {
+        written = stbi_write_jpg_to_func(appendBytes, memory, image->width, image->height, image->channels, image->pixels,
+                                         90);
+    }
+
+    return written && memory->bytes && memory->capacity != SIZE_MAX;
+}
+
+static bool decodeCarrier(const PngMemory *memory, bool headerOnly, double *seconds) {
+    /*
+    Summary:
+        Decodes an encoded carrier with the selected backend, either whole or only the rows that hold the stego
+        header, and times it from opening to releasing the pixels.
+
+    Args:
+        memory (const PngMemory*): The encoded carrier.
+        headerOnly (bool): Whether to stop after the rows holding the first HEADER_BITS carrier bytes.
+        seconds (double*): Receives the time taken.
+
+    Return:
+        Returns true if the image was decoded, false otherwise.
+    */
+
+    StegoImage image;
+    ImageReader reader;
+    struct timespec start;
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+
+    if (!openImageFromMemory(memory->bytes, memory->length, &reader, &image)) return false;
+
+    size_t rowCarriers = carrierCount(&image) / image.height;
+    int rows = headerOnly ? (int)((HEADER_BITS + rowCarriers - 1) / rowCarriers) : image.height;
+    bool decoded = readImageRows(&reader, &image, rows);
+
+    closeImage(&reader);
+    freeImage(&image);
+    *seconds = elapsedSeconds(&start);
+
+    return decoded;
+}
+
+static bool benchDecode(const BenchConfig *config, double megapixels, int channels, bool *first) {
+    /*
+    Summary:
+        Generates one synthetic carrier, encodes it in every format of the decode suite (not timed), and times
+        decoding each one, in full and header only, with every backend that can read it: libpng and stb_image for
+        PNG, stb_image for the rest. Formats this build cannot encode are skipped with a note on stderr.
+
+    Args:
+        config (const BenchConfig*): The benchmark settings.
+        megapixels (double): The carrier size in millions of pixels.
+        channels (int): 3 for RGB or 4 for RGBA.
+        first (bool*): Whether the next JSON object is the first.
+
+    Return:
+        Returns true if every decode succeeded, false otherwise (errors go to stderr).
+    */
+
+    static const char *formats[] = {"png", "bmp", "tga", "jpg"};
+    static const char *backends[] = {"libpng", "stb"};
+    StegoImage image;
+    bool ok = true;
+
+    synthesizeCarrier(&image, megapixels, channels);
+
+    if (!image.pixels) {
+        fprintf(stderr, "Memory allocation failed\n");
+        return false;
+    }
+
+    double imageMegabytes = (double)image.height * image.stride / 1e6;
+    const char *layout = channels == 4 ? "rgba" : "rgb";
+
+    for (size_t format = 0; format < sizeof(formats) / sizeof(formats[0]) && ok; format++) {
+        PngMemory memory;
+
+        if (!encodeCarrier(&image, formats[format], &memory)) {
+            fprintf(stderr, "Skipping %s: this build cannot encode it\n", formats[format]);
+            free(memory.bytes);
+            continue;
+        }
+
+        for (size_t backend = 0; backend < sizeof(backends) / sizeof(backends[0]) && ok; backend++) {
+            double full = 0;
+            double header = 0;
+
+            // libpng only reads PNGs; any other format would just fall back to stb_image again
+            if (backend == 0 && format > 0) continue;
+
+            selectImageBackend(backends[backend]);
+
+            for (int run = 0; run < config->runs && ok; run++) {
+                double fullRun;
+                double headerRun;
+
+                ok = decodeCarrier(&memory, false, &fullRun) && decodeCarrier(&memory, true, &headerRun);
+                full = run == 0 || fullRun < full ? fullRun : full;
+                header = run == 0 || headerRun < header ? headerRun : header;
+            }
+
+            if (!ok) {
+                fprintf(stderr, "Error decoding the %s carrier with %s\n", formats[format], backends[backend]);
+                break;
+            }
+
+            if (config->json) {
+                printf("%s\n  {\"megapixels\": %g, \"layout\": \"%s\", \"format\": \"%s\", \"backend\": \"%s\", "
+                       "\"encoded_bytes\": %zu, \"full_ms\": %.3f, \"full_MBps\": %.1f, \"header_ms\": %.3f}",
+                       *first ? "" : ",", megapixels, layout, formats[format], backends[backend], memory.length,
+                       full * 1e3, imageMegabytes / full, header * 1e3);
+            } else {
+                printf("%g,%s,%s,%s,%zu,%.3f,%.1f,%.3f\n", megapixels, layout, formats[format], backends[backend],
+                       memory.length, full * 1e3, imageMegabytes / full, header * 1e3);
+            }
+
+            fflush(stdout);
+            *first = false;
+        }
+
+        free(memory.bytes);
+    }
+
+    selectImageBackend("auto");
+    free(image.pixels);
+
+    return ok;
+}
+
+static void fillLogPayload(unsigned char *payload, size_t length) {
+    /*
+    Summary:
+        Fills a payload with JSON log lines of the kind the codecs are meant for: a fixed set of keys, a few repeated
+        values and some varying numbers. The contents are deterministic, so ratios are comparable across runs.
+
+    Args:
+        payload (unsigned char*): The buffer to fill.
+        length (size_t): The number of bytes; the last line is cut off where the buffer ends.
+
+    Return:
+        This function does not return any value.
+    */
+
+    static const char *levels[] = {"info", "warn", "debug", "error"};
+    static const char *paths[] = {"/api/v1/items", "/api/v1/users", "/healthz", "/api/v2/search"};
+    uint64_t state = 0x2545F4914F6CDD1Du;
+    size_t offset = 0;
+    char line[256];
+
+    for (unsigned long sequence = 0; offset < length; sequence++) {
+        state ^= state << 13;
+        state ^= state >> 7;
+        state ^= state << 17;
+
+        int written = snprintf(line, sizeof(line),
+                               "{\"ts\":%lu,\"level\":\"%s\",\"path\":\"%s/%u\",\"status\":%d,\"latency_ms\":%u}\n",
+                               1700000000ul + sequence, levels[state % 4], paths[(state >> 8) % 4],
+                               (unsigned)(state >> 16) % 1000, (state >> 32) % 16 ? 200 : 500,
+                               (unsigned)(state >> 40) % 500);
+        size_t count = length - offset < (size_t)written ? length - offset : (size_t)written;
+
+        memcpy(payload + offset, line, count);
+        offset += count;
+    }
+}
+
+static bool collectDecoded(void *context, const unsigned char *bytes, size_t length) {
+    /*
+    Summary:
+        The sink the codec suite decompresses into: appends to a buffer of the original payload's size, so the round
+        trip can be checked afterwards.
+
+    Args:
+        context (void*): The DecodedPayload to append to.
+        bytes (const unsigned char*): The decompressed bytes.
+        length (size_t): The number of bytes.
+
+    Return:
+        Returns true if the bytes fit, false if the payload decompressed to more than it was.
+    */
+
+    DecodedPayload *decoded = (DecodedPayload *)context;
+
+    if (length > decoded->capacity - decoded->length) return false;
+
+    memcpy(decoded->bytes + decoded->length, bytes, length);
+    decoded->length += length;
+
+    return true;
+}
+
+static bool benchCodec(const BenchConfig *config, const char *kind, size_t length, bool *first) {
+    /*
+    Summary:
+        Compresses one generated payload with every codec and level and decompresses it again, timing both (best of
+        --runs runs) and checking the round trip. Decompression is fed 3 MB pieces, as much as decode() extracts at
+        a time.
+
+    Args:
+        config (const BenchConfig*): The benchmark settings.
+        kind (const char*): "json" for log lines, "random" for incompressible bytes.
+        length (size_t): The payload size in bytes.
+        first (bool*): Whether the next JSON object is the first.
+
+    Return:
+        Returns true if every payload came back intact, false otherwise (errors go to stderr).
+    */
+
+    static const int codecs[][2] = {{STEGO_CODEC_NONE, 0}, {STEGO_CODEC_DEFLATE, 1}, {STEGO_CODEC_DEFLATE, 6},
+                                    {STEGO_CODEC_DEFLATE, 9}};
+    size_t piece = 3 * MEGABYTE;
+    unsigned char *payload = (unsigned char *)malloc(length);
+    size_t bound = compressedBound(STEGO_CODEC_DEFLATE, length);
+    unsigned char *packed = (unsigned char *)malloc(bound);
+    DecodedPayload decoded = {(unsigned char *)malloc(length), 0, length};
+    bool ok = payload && packed && decoded.bytes;
+
+    if (!ok) fprintf(stderr, "Memory allocation failed\n");
+
+    if (ok && strcmp(kind, "json") == 0) fillLogPayload(payload, length);
+    else if (ok) fillPayload(payload, length);
+
+    for (size_t index = 0; index < sizeof(codecs) / sizeof(codecs[0]) && ok; index++) {
+        int codec = codecs[index][0];
+        int level = codecs[index][1];
+        double compress = 0;
+        double decompress = 0;
+        size_t packedLength = 0;
+
+        for (int run = 0; run < config->runs && ok; run++) {
+            PayloadDecoder decoder;
+            struct timespec start;
+
+            clock_gettime(CLOCK_MONOTONIC, &start);
+            ok = compressPayload(codec, level, payload, length, packed, bound, &packedLength);
+
+            double compressRun = elapsedSeconds(&start);
+
+            decoded.length = 0;
+            ok = ok && initPayloadDecoder(&decoder, codec);
+
+            for (size_t offset = 0; offset < packedLength && ok; offset += piece) {
+                size_t count = packedLength - offset < piece ? packedLength - offset : piece;
+
+                ok = decodePayload(&decoder, packed + offset, count, collectDecoded, &decoded);
+            }
+
+            ok = finishPayloadDecoder(&decoder) && ok;
+
+            double decompressRun = elapsedSeconds(&start);
+
+            ok = ok && decoded.length == length && memcmp(decoded.bytes, payload, length) == 0;
+            compress = run == 0 || compressRun < compress ? compressRun : compress;
+            decompress = run == 0 || decompressRun < decompress ? decompressRun : decompress;
+        }
+
+        if (!ok) {
+            fprintf(stderr, "The %s payload did not survive %s level %d\n", kind, codecName(codec), level);
+            break;
+        }
+
+        StegoOptions options = config->stegoOptions;
+        StegoHeader header;
+
+        options.codec = codec;
+        initStegoHeader(&header, packed, packedLength, &options);
+
+        size_t carriers = messageCarriers(&header, SIZE_MAX);
+        double megabytes = (double)length / 1e6;
+
+        if (config->json) {
+            printf("%s\n  {\"payload\": \"%s\", \"payload_bytes\": %zu, \"codec\": \"%s\", \"level\": %d, "
+                   "\"packed_bytes\": %zu, \"ratio\": %.3f, \"compress_ms\": %.3f, \"compress_MBps\": %.1f, "
+                   "\"decompress_ms\": %.3f, \"decompress_MBps\": %.1f, \"carrier_bytes\": %zu}",
+                   *first ? "" : ",", kind, length, codecName(codec), level, packedLength,
+                   (double)length / packedLength, compress * 1e3, megabytes / compress, decompress * 1e3,
+                   megabytes / decompress, carriers);
+        } else {
+            printf("%s,%zu,%s,%d,%zu,%.3f,%.3f,%.1f,%.3f,%.1f,%zu\n", kind, length, codecName(codec), level,
+                   packedLength, (double)length / packedLength, compress * 1e3, megabytes / compress,
+                   decompress * 1e3, megabytes / decompress, carriers);
+        }
+
+        fflush(stdout);
+        *first = false;
+    }
+
+    free(payload);
+    free(packed);
+    free(decoded.bytes);
+
+    return ok;
+}
+
+static bool benchChecksum(const BenchConfig *config, size_t length, bool *first) {
+    /*
+    Summary:
+        Times the CRC-32C of one generated payload and its zlib CRC-32, best of --runs runs. Each run repeats the
+        checksum over at least 64 MB, so the small payloads, which stay in L1, are timed over more than a few
+        microseconds.
+
+    Args:
+        config (const BenchConfig*): The benchmark settings.
+        length (size_t): The payload size in bytes.
+        first (bool*): Whether the next JSON object is the first.
+
+    Return:
+        Returns true, or false if the payload could not be allocated (errors go to stderr).
+    */
+
+    static const char *names[] = {"crc32c", "crc32"};
+    unsigned char *payload = (unsigned char *)malloc(length);
+    size_t repeats = 64 * MEGABYTE / length > 0 ? 64 * MEGABYTE / length : 1;
+    volatile uint32_t sink = 0;
+
+    if (!payload) {
+        fprintf(stderr, "Memory allocation failed\n");
+        return false;
+    }
+
+    fillPayload(payload, length);
+
+    for (int checksum = 0; checksum < 2; checksum++) {
+        const char *kernel = checksum == 0 ? crc32cKernelName() : "zlib";
+        double best = 0;
+
+        for (int run = 0; run < config->runs; run++) {
+            struct timespec start;
+            uint32_t crc = 0;
+
+            clock_gettime(CLOCK_MONOTONIC, &start);
+
+            for (size_t repeat = 0; repeat < repeats; repeat++) {
+                if (checksum == 0) crc = crc32c(crc, payload, length);
+                else crc = (uint32_t)crc32(crc, payload, (uInt)length);
+            }
+
+            double seconds = elapsedSeconds(&start) / repeats;
+
+            sink ^= crc;
+            best = run == 0 || seconds < best ? seconds : best;
+        }
+
+        double megabytes = (double)length / 1e6;
+
+        if (config->json) {
+            printf("%s\n  {\"payload_bytes\": %zu, \"checksum\": \"%s\", \"kernel\": \"%s\", \"ms\": %.4f, "
+                   "\"MBps\": %.1f}",
+                   *first ? "" : ",", length, names[checksum], kernel, best * 1e3, megabytes / best);
+        } else {
+            printf("%zu,%s,%s,%.4f,%.1f\n", length, names[checksum], kernel, best * 1e3, megabytes / best);
+        }
+
+        fflush(stdout);
+        *first = false;
+    }
+
+    (void)sink;
+    free(payload);
+
+    return true;
+}
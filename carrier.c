@@ -0,0 +1,469 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "carrier.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define CARRIER_X86 1
+#endif
+
+// 16-bit samples are kept in host byte order, so the byte holding the least significant bits depends on the CPU
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+#define LOW_BYTE_16 1
+#else
+#define LOW_BYTE_16 0
+#endif
+
+#define LAYOUT_INLINE static inline __attribute__((always_inline))
+
+typedef void (*GatherLayout)(const StegoImage *image, size_t first, size_t count, unsigned char *bytes);
+typedef void (*ScatterLayout)(StegoImage *image, size_t first, size_t count, const unsigned char *bytes);
+
+// pshufb masks for one 16-byte block of a layout: the carrier bytes of the block's pixels in order, those bytes spread
+// back to their pixel positions, and the pixel bytes that are not carriers
+typedef struct {
+    unsigned char gather[16];
+    unsigned char spread[16];
+    unsigned char keep[16];
+} LayoutMasks;
+
+// Set once by initCarrierKernels(), from stegoInit(), before any gather or scatter reads them
+static int vectorState = 0;
+static LayoutMasks layoutMasks[2][4];
+
+static int colorChannels(int channels);
+static int sampleBytes(const StegoImage *image);
+static size_t vectorBlocks(size_t available, int colors, int pixelBytes);
+
+#ifdef CARRIER_X86
+__attribute__((target("ssse3")))
+static void gatherBlocksSsse3(const unsigned char *pixel, unsigned char *bytes, size_t blocks, const LayoutMasks *masks,
+                              int blockBytes, int blockCarriers) {
+    /*
+    Summary:
+        Gathers the carrier bytes of blocks of whole pixels with one shuffle per 16 bytes of pixels. Every store writes
+        16 bytes, of which only the first blockCarriers are kept; the next store overwrites the rest.
+
+    Args:
+        pixel (const unsigned char*): The first byte of the first pixel of the block.
+        bytes (unsigned char*): Receives blocks * blockCarriers carrier bytes; 16 bytes past the last block start
+            must be writable.
+        blocks (size_t): The number of blocks, as counted by vectorBlocks().
+        masks (const LayoutMasks*): The masks of the layout.
+        blockBytes (int): The pixel bytes per block.
+        blockCarriers (int): The carrier bytes per block.
+
+    Return:
+        This function does not return any value; it fills the buffer.
+    */
+
+    const __m128i mask = _mm_loadu_si128((const __m128i *)masks->gather);
+
+    for (size_t block = 0; block < blocks; block++) {
+        __m128i pixels = _mm_loadu_si128((const __m128i *)(pixel + block * blockBytes));
+
+        _mm_storeu_si128((__m128i *)(bytes + block * blockCarriers), _mm_shuffle_epi8(pixels, mask));
+    }
+}
+
+__attribute__((target("ssse3")))
+static void scatterBlocksSsse3(unsigned char *pixel, const unsigned char *bytes, size_t blocks, const LayoutMasks *masks,
+                               int blockBytes, int blockCarriers) {
+    /*
+    Summary:
+        Writes carrier bytes back into blocks of whole pixels, merging them with the bytes that are not carriers. The
+        16-byte stores rewrite bytes past the block with the values just loaded, so vectorBlocks() only counts blocks
+        whose 16 bytes belong to pixels in the caller's own range.
+
+    Args:
+        pixel (unsigned char*): The first byte of the first pixel of the block.
+        bytes (const unsigned char*): The carrier bytes; 16 bytes past the last block start must be readable.
+        blocks (size_t): The number of blocks, as counted by vectorBlocks().
+        masks (const LayoutMasks*): The masks of the layout.
+        blockBytes (int): The pixel bytes per block.
+        blockCarriers (int): The carrier bytes per block.
+
+    Return:
+        This function does not return any value; it modifies the pixels in place.
+    */
+
+    const __m128i spread = _mm_loadu_si128((const __m128i *)masks->spread);
+    const __m128i keep = _mm_loadu_si128((const __m128i *)masks->keep);
+
+    for (size_t block = 0; block < blocks; block++) {
+        __m128i carriers = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)(bytes + block * blockCarriers)), spread);
+        __m128i pixels = _mm_loadu_si128((const __m128i *)(pixel + block * blockBytes));
+
+        _mm_storeu_si128((__m128i *)(pixel + block * blockBytes), _mm_or_si128(_mm_and_si128(pixels, keep), carriers));
+    }
+}
+#endif
+
+LAYOUT_INLINE void gatherRows(const StegoImage *image, size_t first, size_t count, unsigned char *bytes, const int channels,
+                              const int colors, const int size) {
+    /*
+    Summary:
+        Copies count carrier bytes, starting at carrier byte first, out of the image into a contiguous buffer. The
+        carrier bytes are the bytes holding the least significant bits of every colour sample, row by row and pixel by
+        pixel; alpha samples are skipped. The layout arguments are compile-time constants in every caller, so each
+        layout gets its own loop with the channel walk unrolled.
+
+    Args:
+        image (const StegoImage*): The image to read from.
+        first (size_t): The first carrier byte to copy.
+        count (size_t): The number of carrier bytes to copy.
+        bytes (unsigned char*): The buffer that receives them.
+        channels (const int): The number of samples per pixel, including alpha.
+        colors (const int): The number of those samples that carry bits.
+        size (const int): The number of bytes per sample, 1 or 2.
+
+    Return:
+        This function does not return any value; it fills the buffer.
+    */
+
+    size_t rowCarriers = (size_t)image->width * colors;
+    size_t row = first / rowCarriers;
+    size_t column = first % rowCarriers;
+    int step = channels * size;
+    int low = size == 2 ? LOW_BYTE_16 : 0;
+
+    while (count > 0) {
+        size_t run = rowCarriers - column < count ? rowCarriers - column : count;
+        const unsigned char *pixel = image->pixels + row * image->stride + column / colors * step + low;
+        size_t index = 0;
+
+        if (channels == colors && size == 1) {
+            memcpy(bytes, pixel, run);
+        } else {
+            int channel = (int)(column % colors);
+
+            if (channel != 0) {
+                for (; channel < colors && index < run; channel++, index++) bytes[index] = pixel[channel * size];
+                pixel += step;
+            }
+
+#ifdef CARRIER_X86
+            size_t blocks = vectorState == 1 && index < run ? vectorBlocks(run - index, colors, step) : 0;
+
+            if (blocks > 0) {
+                gatherBlocksSsse3(pixel - low, bytes + index, blocks, &layoutMasks[size - 1][channels - 1], 16 / step * step,
+                                  16 / step * colors);
+                pixel += blocks * (16 / step * step);
+                index += blocks * (16 / step * colors);
+            }
+#endif
+
+            for (; index + colors <= run; index += colors, pixel += step) {
+                for (int sample = 0; sample < colors; sample++) bytes[index + sample] = pixel[sample * size];
+            }
+
+            for (int sample = 0; index < run; sample++, index++) bytes[index] = pixel[sample * size];
+        }
+
+        bytes += run;
+        count -= run;
+        row++;
+        column = 0;
+    }
+}
+
+LAYOUT_INLINE void scatterRows(StegoImage *image, size_t first, size_t count, const unsigned char *bytes, const int channels,
+                               const int colors, const int size) {
+    /*
+    Summary:
+        Copies count carrier bytes from a contiguous buffer back into the image; the inverse of gatherRows(). Only the
+        carrier bytes are written, so alpha samples and the high bytes of 16-bit samples are never touched and
+        different threads may scatter disjoint carrier ranges of the same image at once.
+
+    Args:
+        image (StegoImage*): The image to write to.
+        first (size_t): The first carrier byte to write.
+        count (size_t): The number of carrier bytes to write.
+        bytes (const unsigned char*): The carrier bytes.
+        channels (const int): The number of samples per pixel, including alpha.
+        colors (const int): The number of those samples that carry bits.
+        size (const int): The number of bytes per sample, 1 or 2.
+
+    Return:
+        This function does not return any value; it modifies the image in place.
+    */
+
+    size_t rowCarriers = (size_t)image->width * colors;
+    size_t row = first / rowCarriers;
+    size_t column = first % rowCarriers;
+    int step = channels * size;
+    int low = size == 2 ? LOW_BYTE_16 : 0;
+
+    while (count > 0) {
+        size_t run = rowCarriers - column < count ? rowCarriers - column : count;
+        unsigned char *pixel = image->pixels + row * image->stride + column / colors * step + low;
+        size_t index = 0;
+
+        if (channels == colors && size == 1) {
+            memcpy(pixel, bytes, run);
+        } else {
+            int channel = (int)(column % colors);
+
+            if (channel != 0) {
+                for (; channel < colors && index < run; channel++, index++) pixel[channel * size] = bytes[index];
+                pixel += step;
+            }
+
+#ifdef CARRIER_X86
+            size_t blocks = vectorState == 1 && index < run ? vectorBlocks(run - index, colors, step) : 0;
+
+            if (blocks > 0) {
+                scatterBlocksSsse3(pixel - low, bytes + index, blocks, &layoutMasks[size - 1][channels - 1], 16 / step * step,
+                                   16 / step * colors);
+                pixel += blocks * (16 / step * step);
+                index += blocks * (16 / step * colors);
+            }
+#endif
+
+            for (; index + colors <= run; index += colors, pixel += step) {
+                for (int sample = 0; sample < colors; sample++) pixel[sample * size] = bytes[index + sample];
+            }
+
+            for (int sample = 0; index < run; sample++, index++) pixel[sample * size] = bytes[index];
+        }
+
+        bytes += run;
+        count -= run;
+        row++;
+        column = 0;
+    }
+}
+
+// One gather/scatter pair per pixel layout, each with its channel count, colour count and sample size fixed
+#define CARRIER_LAYOUT(name, channels, colors, size)                                                                  \
+    static void gather##name(const StegoImage *image, size_t first, size_t count, unsigned char *bytes) {             \
+        gatherRows(image, first, count, bytes, channels, colors, size);                                               \
+    }                                                                                                                 \
+    static void scatter##name(StegoImage *image, size_t first, size_t count, const unsigned char *bytes) {            \
+        scatterRows(image, first, count, bytes, channels, colors, size);                                              \
+    }
+
+CARRIER_LAYOUT(Gray8, 1, 1, 1)
+CARRIER_LAYOUT(GrayAlpha8, 2, 1, 1)
+CARRIER_LAYOUT(Rgb8, 3, 3, 1)
+CARRIER_LAYOUT(Rgba8, 4, 3, 1)
+CARRIER_LAYOUT(Gray16, 1, 1, 2)
+CARRIER_LAYOUT(GrayAlpha16, 2, 1, 2)
+CARRIER_LAYOUT(Rgb16, 3, 3, 2)
+CARRIER_LAYOUT(Rgba16, 4, 3, 2)
+
+static const GatherLayout gatherLayouts[2][4] = {
+    {gatherGray8, gatherGrayAlpha8, gatherRgb8, gatherRgba8},
+    {gatherGray16, gatherGrayAlpha16, gatherRgb16, gatherRgba16},
+};
+
+static const ScatterLayout scatterLayouts[2][4] = {
+    {scatterGray8, scatterGrayAlpha8, scatterRgb8, scatterRgba8},
+    {scatterGray16, scatterGrayAlpha16, scatterRgb16, scatterRgba16},
+};
+
+static int colorChannels(int channels) {
+    /*
+    Summary:
+        Returns how many samples of a pixel carry hidden bits: all of them, except the alpha sample of gray+alpha
+        (2 channels) and RGBA (4 channels) images. Alpha is left alone because changing it can make an opaque pixel
+        slightly transparent, which is easy to spot.
+
+    Args:
+        channels (int): The number of samples per pixel, 1 to 4.
+
+    Return:
+        Returns the number of colour samples per pixel.
+    */
+
+    return channels == 2 || channels == 4 ? channels - 1 : channels;
+}
+
+static int sampleBytes(const StegoImage *image) {
+    /*
+    Summary:
+        Returns the size of one sample of an image in bytes.
+
+    Args:
+        image (const StegoImage*): The image to query; a bitDepth of 0 is taken as 8.
+
+    Return:
+        Returns 2 for 16-bit images and 1 otherwise.
+    */
+
+    return image->bitDepth == 16 ? 2 : 1;
+}
+
+void initCarrierKernels(void) {
+    /*
+    Summary:
+        Decides whether the SSSE3 block loops can be used and builds the shuffle masks of every layout. Like the LSB
+        kernels, the vector loops are skipped when STEGO_LSB_KERNEL is set to "scalar". Until it has run, the
+        portable loops are used.
+
+    Args:
+        None.
+
+    Return:
+        This function does not return any value.
+
+    Note:
+        Not thread-safe: it runs once, from stegoInit(), before carrier bytes are gathered or scattered.
+    */
+
+    const char *requested = getenv("STEGO_LSB_KERNEL");
+    bool vectors = false;
+
+#ifdef CARRIER_X86
+    __builtin_cpu_init();
+    vectors = __builtin_cpu_supports("ssse3") && !(requested && strcmp(requested, "scalar") == 0);
+#else
+    (void)requested;
+#endif
+
+    for (int size = 1; size <= 2; size++) {
+        for (int channels = 1; channels <= 4; channels++) {
+            LayoutMasks *masks = &layoutMasks[size - 1][channels - 1];
+            int colors = colorChannels(channels);
+            int step = channels * size;
+            int pixels = 16 / step;
+
+            memset(masks->gather, 0x80, 16);
+            memset(masks->spread, 0x80, 16);
+            memset(masks->keep, 0xFF, 16);
+
+            for (int carrier = 0; carrier < pixels * colors; carrier++) {
+                int offset = carrier / colors * step + carrier % colors * size + (size == 2 ? LOW_BYTE_16 : 0);
+
+                masks->gather[carrier] = (unsigned char)offset;
+                masks->spread[offset] = (unsigned char)carrier;
+                masks->keep[offset] = 0;
+            }
+        }
+    }
+
+    vectorState = vectors ? 1 : 0;
+}
+
+static size_t vectorBlocks(size_t available, int colors, int pixelBytes) {
+    /*
+    Summary:
+        Counts the 16-byte blocks the vector loops may process at the start of a run of whole pixels: every 16-byte
+        pixel load and store must stay within the run's pixels, and every 16-byte carrier load or store within its
+        carrier bytes.
+
+    Args:
+        available (size_t): The number of carrier bytes left in the run, starting at a pixel boundary.
+        colors (int): The carrier bytes per pixel.
+        pixelBytes (int): The bytes per pixel.
+
+    Return:
+        Returns the number of blocks, possibly 0.
+    */
+
+    size_t pixels = available / colors;
+    size_t blockPixels = (size_t)(16 / pixelBytes);
+    size_t spanPixels = (size_t)((16 + pixelBytes - 1) / pixelBytes);
+    size_t blockCarriers = blockPixels * colors;
+
+    if (pixels < spanPixels || available < 16) return 0;
+
+    size_t byPixels = (pixels - spanPixels) / blockPixels + 1;
+    size_t byCarriers = (available - 16) / blockCarriers + 1;
+
+    return byPixels < byCarriers ? byPixels : byCarriers;
+}
+
+bool carrierLayoutValid(const StegoImage *image) {
+    /*
+    Summary:
+        Checks that an image describes a pixel layout the carrier functions support: 1 (gray), 2 (gray+alpha), 3 (RGB)
+        or 4 (RGBA) channels at 8 or 16 bits per sample, with rows at least as long as their pixels.
+
+    Args:
+        image (const StegoImage*): The image to check.
+
+    Return:
+        Returns true if the layout is supported, false otherwise.
+    */
+
+    if (image->channels < 1 || image->channels > 4 || image->width < 0 || image->height < 0) return false;
+
+    if (image->bitDepth != 0 && image->bitDepth != 8 && image->bitDepth != 16) return false;
+
+    return image->stride >= (size_t)image->width * image->channels * sampleBytes(image);
+}
+
+bool carrierIsContiguous(const StegoImage *image) {
+    /*
+    Summary:
+        Tells whether the carrier bytes of an image are simply its pixel buffer: 8-bit gray or RGB without row padding.
+        Those images are embedded into in place; every other layout goes through gatherCarrier() and scatterCarrier().
+
+    Args:
+        image (const StegoImage*): The image to check.
+
+    Return:
+        Returns true if carrier byte i is image->pixels[i], false otherwise.
+    */
+
+    return sampleBytes(image) == 1 && colorChannels(image->channels) == image->channels &&
+           image->stride == (size_t)image->width * image->channels;
+}
+
+size_t carrierCount(const StegoImage *image) {
+    /*
+    Summary:
+        Counts the carrier bytes of an image, one per colour sample.
+
+    Args:
+        image (const StegoImage*): The image to count.
+
+    Return:
+        Returns the number of carrier bytes.
+    */
+
+    return (size_t)image->height * image->width * colorChannels(image->channels);
+}
+
+void gatherCarrier(const StegoImage *image, size_t first, size_t count, unsigned char *bytes) {
+    /*
+    Summary:
+        Copies a range of carrier bytes out of an image of any supported layout into a contiguous buffer, using the
+        loop specialised for that layout.
+
+    Args:
+        image (const StegoImage*): The image to read from; its layout must pass carrierLayoutValid().
+        first (size_t): The first carrier byte to copy.
+        count (size_t): The number of carrier bytes; first + count must not exceed carrierCount(image).
+        bytes (unsigned char*): The buffer that receives them.
+
+    Return:
+        This function does not return any value; it fills the buffer.
+    */
+
+    if (count == 0) return;
+
+    gatherLayouts[sampleBytes(image) - 1][image->channels - 1](image, first, count, bytes);
+}
+
+void scatterCarrier(StegoImage *image, size_t first, size_t count, const unsigned char *bytes) {
+    /*
+    Summary:
+        Writes a range of carrier bytes from a contiguous buffer back into an image; the inverse of gatherCarrier().
+
+    Args:
+        image (StegoImage*): The image to write to; its layout must pass carrierLayoutValid().
+        first (size_t): The first carrier byte to write.
+        count (size_t): The number of carrier bytes; first + count must not exceed carrierCount(image).
+        bytes (const unsigned char*): The carrier bytes.
+
+    Return:
+        This function does not return any value; it modifies the image in place.
+    */
+
+    if (count == 0) return;
+
+    scatterLayouts[sampleBytes(image) - 1][image->channels - 1](image, first, count, bytes);
+}
@@ -0,0 +1,16 @@
+#ifndef CARRIER_H
+#define CARRIER_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "stego.h"
+
+void initCarrierKernels(void);
+bool carrierLayoutValid(const StegoImage *image);
+bool carrierIsContiguous(const StegoImage *image);
+size_t carrierCount(const StegoImage *image);
+void gatherCarrier(const StegoImage *image, size_t first, size_t count, unsigned char *bytes);
+void scatterCarrier(StegoImage *image, size_t first, size_t count, const unsigned char *bytes);
+
+#endif
@@ -0,0 +1,290 @@
+#include <string.h>
+#include <zlib.h>
+
+#include "arena.h"
+#include "codec.h"
+#include "stego.h"
+
+// Bytes of decompressed payload handed to the sink at a time
+#define CODEC_CHUNK (256 * 1024)
+// Largest piece of a buffer passed to zlib at once, whose counters are only 32 bits wide
+#define CODEC_SLICE (1024 * 1024 * 1024)
+// Raw deflate: the payload checksum in the header already covers the data, so zlib's own wrapper is left out
+#define CODEC_WINDOW_BITS -15
+
+static voidpf codecAlloc(voidpf opaque, uInt items, uInt size);
+static void codecFree(voidpf opaque, voidpf pointer);
+
+static voidpf codecAlloc(voidpf opaque, uInt items, uInt size) {
+    /*
+    Summary:
+        The zlib allocation callback, so the codec state is working memory like every other per-image buffer.
+
+    Args:
+        opaque (voidpf): Unused.
+        items (uInt): The number of items to allocate.
+        size (uInt): The size of each item.
+
+    Return:
+        Returns the allocated memory, or NULL, which zlib turns into Z_MEM_ERROR.
+    */
+
+    (void)opaque;
+
+    return workAlloc((size_t)items * size);
+}
+
+static void codecFree(voidpf opaque, voidpf pointer) {
+    /*
+    Summary:
+        The zlib release callback, the counterpart of codecAlloc().
+
+    Args:
+        opaque (voidpf): Unused.
+        pointer (voidpf): The memory to release.
+
+    Return:
+        This function does not return any value.
+    */
+
+    (void)opaque;
+
+    workFree(pointer);
+}
+
+const char *codecName(int codec) {
+    /*
+    Summary:
+        Gives the name a payload codec is selected by on the command line and reported as.
+
+    Args:
+        codec (int): One of the STEGO_CODEC values.
+
+    Return:
+        Returns the name, or "unknown" for a value that is not a codec.
+    */
+
+    switch (codec) {
+        case STEGO_CODEC_NONE: return "none";
+        case STEGO_CODEC_DEFLATE: return "deflate";
+        default: return "unknown";
+    }
+}
+
+bool parseCodec(const char *name, int *codec) {
+    /*
+    Summary:
+        Looks up a payload codec by name: "none", or "deflate" (also accepted as "zlib").
+
+    Args:
+        name (const char*): The name to look up.
+        codec (int*): Receives the STEGO_CODEC value.
+
+    Return:
+        Returns true if the name is known, false otherwise (codec is left unchanged).
+    */
+
+    if (strcmp(name, "none") == 0) *codec = STEGO_CODEC_NONE;
+    else if (strcmp(name, "deflate") == 0 || strcmp(name, "zlib") == 0) *codec = STEGO_CODEC_DEFLATE;
+    else return false;
+
+    return true;
+}
+
+size_t compressedBound(int codec, size_t length) {
+    /*
+    Summary:
+        Gives the size of a buffer that always holds a payload once compressed, even one that does not compress.
+
+    Args:
+        codec (int): The codec that will compress it.
+        length (size_t): The number of bytes in the payload.
+
+    Return:
+        Returns the buffer size in bytes.
+    */
+
+    return codec == STEGO_CODEC_DEFLATE ? (size_t)compressBound((uLong)length) : length;
+}
+
+bool compressPayload(int codec, int level, const unsigned char *input, size_t length, unsigned char *output,
+                     size_t capacity, size_t *written) {
+    /*
+    Summary:
+        Compresses a whole payload in one pass, before it is embedded. Deflate is written raw, without the zlib header
+        and Adler-32 trailer, since the header checksum is computed over the compressed bytes anyway; its state is
+        working memory and is released before returning.
+
+    Args:
+        codec (int): The codec to compress with; STEGO_CODEC_NONE copies the payload.
+        level (int): The deflate level, 1 (fastest) to 9 (smallest).
+        input (const unsigned char*): The payload.
+        length (size_t): The number of bytes in the payload.
+        output (unsigned char*): The buffer that receives the compressed payload.
+        capacity (size_t): The size of the output buffer; compressedBound() bytes are always enough.
+        written (size_t*): Receives the number of compressed bytes.
+
+    Return:
+        Returns true if the payload was compressed, false if the codec or level is invalid, the output buffer is too
+        small or memory allocation fails.
+    */
+
+    if (codec == STEGO_CODEC_NONE) {
+        if (length > capacity) return false;
+
+        if (length > 0) memcpy(output, input, length);
+
+        *written = length;
+        return true;
+    }
+
+    if (codec != STEGO_CODEC_DEFLATE || level < 1 || level > 9) return false;
+
+    z_stream stream;
+
+    memset(&stream, 0, sizeof(stream));
+    stream.zalloc = codecAlloc;
+    stream.zfree = codecFree;
+
+    if (deflateInit2(&stream, level, Z_DEFLATED, CODEC_WINDOW_BITS, 8, Z_DEFAULT_STRATEGY) != Z_OK) return false;
+
+    size_t consumed = 0;
+    size_t produced = 0;
+    int result = Z_OK;
+
+    // zlib counts in 32 bits, so larger payloads are handed over a slice at a time
+    while (result == Z_OK) {
+        size_t in = length - consumed < CODEC_SLICE ? length - consumed : CODEC_SLICE;
+        size_t out = capacity - produced < CODEC_SLICE ? capacity - produced : CODEC_SLICE;
+
+        if (out == 0) break;
+
+        stream.next_in = (Bytef *)(input + consumed);
+        stream.avail_in = (uInt)in;
+        stream.next_out = output + produced;
+        stream.avail_out = (uInt)out;
+        result = deflate(&stream, consumed + in == length ? Z_FINISH : Z_NO_FLUSH);
+        consumed += in - stream.avail_in;
+        produced += out - stream.avail_out;
+
+        if (result == Z_BUF_ERROR && stream.avail_out > 0) result = Z_OK;
+    }
+
+    deflateEnd(&stream);
+    *written = produced;
+
+    return result == Z_STREAM_END;
+}
+
+bool initPayloadDecoder(PayloadDecoder *decoder, int codec) {
+    /*
+    Summary:
+        Prepares to decompress an extracted payload piece by piece with decodePayload(), so a large payload never has
+        to be held whole, compressed or not.
+
+    Args:
+        decoder (PayloadDecoder*): The decoder to initialise; release it with finishPayloadDecoder().
+        codec (int): The codec recorded in the header of the payload.
+
+    Return:
+        Returns true if the decoder is ready, false if the codec is unknown or memory allocation fails (nothing needs
+        releasing then).
+    */
+
+    memset(decoder, 0, sizeof(*decoder));
+    decoder->codec = codec;
+
+    if (codec == STEGO_CODEC_NONE) return true;
+
+    if (codec != STEGO_CODEC_DEFLATE) return false;
+
+    decoder->output = (unsigned char *)workAlloc(CODEC_CHUNK);
+    decoder->stream.zalloc = codecAlloc;
+    decoder->stream.zfree = codecFree;
+
+    if (!decoder->output || inflateInit2(&decoder->stream, CODEC_WINDOW_BITS) != Z_OK) {
+        workFree(decoder->output);
+        decoder->output = NULL;
+        return false;
+    }
+
+    decoder->started = true;
+
+    return true;
+}
+
+bool decodePayload(PayloadDecoder *decoder, const unsigned char *input, size_t length, PayloadSink sink, void *context) {
+    /*
+    Summary:
+        Decompresses the next piece of an extracted payload and hands the result to a sink CODEC_CHUNK bytes at a time.
+        Pieces may be split anywhere; an uncompressed payload is passed straight through.
+
+    Args:
+        decoder (PayloadDecoder*): The decoder set up by initPayloadDecoder().
+        input (const unsigned char*): The next bytes of the payload as extracted.
+        length (size_t): The number of bytes.
+        sink (PayloadSink): Called with every piece of decompressed payload; returning false stops decoding.
+        context (void*): Passed to the sink.
+
+    Return:
+        Returns true if the piece was decoded, false if the compressed data is damaged, continues past the end of its
+        stream, or the sink failed.
+    */
+
+    if (decoder->codec == STEGO_CODEC_NONE) return length == 0 || sink(context, input, length);
+
+    size_t consumed = 0;
+
+    while (consumed < length) {
+        size_t in = length - consumed < CODEC_SLICE ? length - consumed : CODEC_SLICE;
+
+        if (decoder->finished) return false;
+
+        decoder->stream.next_in = (Bytef *)(input + consumed);
+        decoder->stream.avail_in = (uInt)in;
+
+        do {
+            decoder->stream.next_out = decoder->output;
+            decoder->stream.avail_out = CODEC_CHUNK;
+
+            int result = inflate(&decoder->stream, Z_NO_FLUSH);
+            size_t produced = CODEC_CHUNK - decoder->stream.avail_out;
+
+            if (result != Z_OK && result != Z_STREAM_END && result != Z_BUF_ERROR) return false;
+
+            if (produced > 0 && !sink(context, decoder->output, produced)) return false;
+
+            if (result == Z_STREAM_END) decoder->finished = true;
+        } while (!decoder->finished && (decoder->stream.avail_in > 0 || decoder->stream.avail_out == 0));
+
+        consumed += in - decoder->stream.avail_in;
+
+        if (decoder->finished && consumed < length) return false;
+    }
+
+    return true;
+}
+
+bool finishPayloadDecoder(PayloadDecoder *decoder) {
+    /*
+    Summary:
+        Releases a decoder once the whole payload has been passed to decodePayload(), and checks that the compressed
+        stream ended exactly there.
+
+    Args:
+        decoder (PayloadDecoder*): The decoder set up by initPayloadDecoder().
+
+    Return:
+        Returns true if the payload was complete, false if the compressed stream was cut short.
+    */
+
+    bool complete = decoder->codec == STEGO_CODEC_NONE || decoder->finished;
+
+    if (decoder->started) inflateEnd(&decoder->stream);
+
+    workFree(decoder->output);
+    decoder->output = NULL;
+    decoder->started = false;
+
+    return complete;
+}
@@ -0,0 +1,27 @@
+#ifndef CODEC_H
+#define CODEC_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <zlib.h>
+
+typedef bool (*PayloadSink)(void *context, const unsigned char *bytes, size_t length);
+
+typedef struct {
+    int codec;
+    bool started;
+    bool finished;
+    z_stream stream;
+    unsigned char *output;
+} PayloadDecoder;
+
+const char *codecName(int codec);
+bool parseCodec(const char *name, int *codec);
+size_t compressedBound(int codec, size_t length);
+bool compressPayload(int codec, int level, const unsigned char *input, size_t length, unsigned char *output,
+                     size_t capacity, size_t *written);
+bool initPayloadDecoder(PayloadDecoder *decoder, int codec);
+bool decodePayload(PayloadDecoder *decoder, const unsigned char *input, size_t length, PayloadSink sink, void *context);
+bool finishPayloadDecoder(PayloadDecoder *decoder);
+
+#endif
@@ -0,0 +1,422 @@
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "crc32c.h"
+
+#if defined(__x86_64__)
+#include <immintrin.h>
+#define CRC_X86 1
+#endif
+
+// The Castagnoli polynomial, bit-reversed: bit 31 stands for x^0, as the crc32 instruction expects
+#define CRC32C_POLY 0x82F63B78u
+// Bytes per lane when the hardware kernel runs three lanes at once: long lanes for bulk data, short ones for the rest
+#define CRC_LONG_LANE 1024
+#define CRC_SHORT_LANE 128
+
+typedef uint32_t (*CrcKernel)(uint32_t state, const unsigned char *bytes, size_t length);
+
+// Advances a CRC over a run of zero bytes of a fixed length: a table per byte of the CRC, and the same operator as a
+// constant for a carry-less multiply
+typedef struct {
+    uint32_t table[4][256];
+    uint64_t constant;
+} CrcShift;
+
+static CrcKernel crcKernel = NULL;
+static const char *kernelName = "none";
+static uint32_t crcTable[8][256];
+// x^(2^k) modulo the polynomial, from which any power of x is built
+static uint32_t powers[64];
+#ifdef CRC_X86
+static CrcShift longShifts[2];
+static CrcShift shortShifts[2];
+static bool useClmul = false;
+#endif
+
+static uint32_t multiplyModP(uint32_t a, uint32_t b);
+static uint32_t xPowerModP(uint64_t exponent);
+static uint32_t crcBytes(uint32_t state, const unsigned char *bytes, size_t length);
+static uint32_t crcSliced(uint32_t state, const unsigned char *bytes, size_t length);
+#ifdef CRC_X86
+static void initCrcShift(CrcShift *shift, uint64_t length);
+static uint32_t shiftTable(const CrcShift *shift, uint32_t state);
+static uint32_t shiftClmul(const CrcShift *shift, uint32_t state);
+static uint32_t crcLanes(uint64_t state, const unsigned char **bytes, size_t *length, size_t lane, const CrcShift *shifts);
+static uint32_t crcHardware(uint32_t state, const unsigned char *bytes, size_t length);
+#endif
+
+static uint32_t multiplyModP(uint32_t a, uint32_t b) {
+    /*
+    Summary:
+        Multiplies two polynomials modulo the CRC-32C polynomial, both in the bit-reversed form the CRC uses. This is
+        how a CRC is moved past bytes that are not there, to join CRCs computed separately.
+
+    Args:
+        a (uint32_t): The first polynomial.
+        b (uint32_t): The second polynomial.
+
+    Return:
+        Returns the product modulo the polynomial.
+    */
+
+    uint32_t product = 0;
+
+    for (uint32_t mask = 0x80000000u; mask != 0; mask >>= 1) {
+        if (a & mask) product ^= b;
+
+        b = b & 1 ? (b >> 1) ^ CRC32C_POLY : b >> 1;
+    }
+
+    return product;
+}
+
+static uint32_t xPowerModP(uint64_t exponent) {
+    /*
+    Summary:
+        Computes x^exponent modulo the CRC-32C polynomial from the precomputed powers x^(2^k).
+
+    Args:
+        exponent (uint64_t): The power of x.
+
+    Return:
+        Returns the power in bit-reversed form.
+    */
+
+    uint32_t power = 0x80000000u;
+
+    for (int bit = 0; exponent != 0; bit++, exponent >>= 1) {
+        if (exponent & 1) power = multiplyModP(powers[bit], power);
+    }
+
+    return power;
+}
+
+static uint32_t crcBytes(uint32_t state, const unsigned char *bytes, size_t length) {
+    /*
+    Summary:
+        Advances a CRC state one byte at a time with the first table.
+
+    Args:
+        state (uint32_t): The CRC state, without the final inversion.
+        bytes (const unsigned char*): The data.
+        length (size_t): The number of bytes.
+
+    Return:
+        Returns the new state.
+    */
+
+    while (length-- > 0) state = (state >> 8) ^ crcTable[0][(state ^ *bytes++) & 0xFF];
+
+    return state;
+}
+
+static uint32_t crcSliced(uint32_t state, const unsigned char *bytes, size_t length) {
+    /*
+    Summary:
+        The portable kernel: slicing-by-8, eight table lookups per 8 bytes. Runs on any CPU, at about a quarter of
+        the speed of the hardware kernel.
+
+    Args:
+        state (uint32_t): The CRC state, without the final inversion.
+        bytes (const unsigned char*): The data.
+        length (size_t): The number of bytes.
+
+    Return:
+        Returns the new state.
+    */
+
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+    while (length >= 8) {
+        uint64_t word;
+
+        memcpy(&word, bytes, 8);
+        word ^= state;
+        state = crcTable[7][word & 0xFF] ^ crcTable[6][(word >> 8) & 0xFF] ^ crcTable[5][(word >> 16) & 0xFF] ^
+                crcTable[4][(word >> 24) & 0xFF] ^ crcTable[3][(word >> 32) & 0xFF] ^ crcTable[2][(word >> 40) & 0xFF] ^
+                crcTable[1][(word >> 48) & 0xFF] ^ crcTable[0][word >> 56];
+        bytes += 8;
+        length -= 8;
+    }
+#endif
+
+    return crcBytes(state, bytes, length);
+}
+
+#ifdef CRC_X86
+
+static void initCrcShift(CrcShift *shift, uint64_t length) {
+    /*
+    Summary:
+        Prepares the operator that advances a CRC state over length zero bytes. The table form splits the state into
+        its four bytes; the constant is x^(8 * length - 33), which a carry-less multiply followed by a crc32 of the
+        64-bit product turns into the same operator (the crc32 multiplies by x^32 and the product of two bit-reversed
+        values comes out one bit short).
+
+    Args:
+        shift (CrcShift*): The operator to fill in.
+        length (uint64_t): The number of bytes it skips.
+
+    Return:
+        This function does not return any value.
+    */
+
+    uint32_t power = xPowerModP(8 * length);
+
+    for (int byte = 0; byte < 4; byte++) {
+        for (uint32_t value = 0; value < 256; value++) {
+            shift->table[byte][value] = multiplyModP(power, value << (8 * byte));
+        }
+    }
+
+    shift->constant = xPowerModP(8 * length - 33);
+}
+
+static uint32_t shiftTable(const CrcShift *shift, uint32_t state) {
+    /*
+    Summary:
+        Advances a CRC state over the zero bytes of a shift with four table lookups.
+
+    Args:
+        shift (const CrcShift*): The operator.
+        state (uint32_t): The CRC state.
+
+    Return:
+        Returns the advanced state.
+    */
+
+    return shift->table[0][state & 0xFF] ^ shift->table[1][(state >> 8) & 0xFF] ^
+           shift->table[2][(state >> 16) & 0xFF] ^ shift->table[3][state >> 24];
+}
+
+__attribute__((target("sse4.2,pclmul")))
+static uint32_t shiftClmul(const CrcShift *shift, uint32_t state) {
+    /*
+    Summary:
+        Advances a CRC state over the zero bytes of a shift with one carry-less multiply and one crc32, which needs
+        no memory access.
+
+    Args:
+        shift (const CrcShift*): The operator.
+        state (uint32_t): The CRC state.
+
+    Return:
+        Returns the advanced state.
+    */
+
+    __m128i product = _mm_clmulepi64_si128(_mm_cvtsi32_si128((int)state), _mm_cvtsi64_si128((long long)shift->constant), 0);
+
+    return (uint32_t)_mm_crc32_u64(0, (uint64_t)_mm_cvtsi128_si64(product));
+}
+
+__attribute__((target("sse4.2,pclmul")))
+static uint32_t crcLanes(uint64_t state, const unsigned char **bytes, size_t *length, size_t lane, const CrcShift *shifts) {
+    /*
+    Summary:
+        Runs the crc32 instruction over blocks of three lanes at once. The instruction takes three cycles but can
+        start every cycle, so three independent CRCs keep it busy; the lane CRCs are then joined by advancing the
+        first two over the lanes that follow them.
+
+    Args:
+        state (uint64_t): The CRC state before the first block.
+        bytes (const unsigned char**): The data; advanced past the blocks processed.
+        length (size_t*): The number of bytes; reduced by the blocks processed.
+        lane (size_t): The bytes per lane, a multiple of 8.
+        shifts (const CrcShift*): The operators skipping two lanes and one lane.
+
+    Return:
+        Returns the state after the last whole block.
+    */
+
+    const unsigned char *data = *bytes;
+
+    while (*length >= 3 * lane) {
+        uint64_t second = 0;
+        uint64_t third = 0;
+
+        for (const unsigned char *end = data + lane; data < end; data += 8) {
+            uint64_t words[3];
+
+            memcpy(&words[0], data, 8);
+            memcpy(&words[1], data + lane, 8);
+            memcpy(&words[2], data + 2 * lane, 8);
+            state = _mm_crc32_u64(state, words[0]);
+            second = _mm_crc32_u64(second, words[1]);
+            third = _mm_crc32_u64(third, words[2]);
+        }
+
+        if (useClmul) state = shiftClmul(&shifts[0], (uint32_t)state) ^ shiftClmul(&shifts[1], (uint32_t)second) ^ third;
+        else state = shiftTable(&shifts[0], (uint32_t)state) ^ shiftTable(&shifts[1], (uint32_t)second) ^ third;
+
+        data += 2 * lane;
+        *length -= 3 * lane;
+    }
+
+    *bytes = data;
+
+    return (uint32_t)state;
+}
+
+__attribute__((target("sse4.2,pclmul")))
+static uint32_t crcHardware(uint32_t state, const unsigned char *bytes, size_t length) {
+    /*
+    Summary:
+        The SSE4.2 kernel: three lanes of the crc32 instruction in long blocks, then short ones, then eight bytes and
+        finally one byte at a time.
+
+    Args:
+        state (uint32_t): The CRC state, without the final inversion.
+        bytes (const unsigned char*): The data.
+        length (size_t): The number of bytes.
+
+    Return:
+        Returns the new state.
+    */
+
+    state = crcLanes(state, &bytes, &length, CRC_LONG_LANE, longShifts);
+    state = crcLanes(state, &bytes, &length, CRC_SHORT_LANE, shortShifts);
+
+    uint64_t wide = state;
+
+    for (; length >= 8; bytes += 8, length -= 8) {
+        uint64_t word;
+
+        memcpy(&word, bytes, 8);
+        wide = _mm_crc32_u64(wide, word);
+    }
+
+    state = (uint32_t)wide;
+
+    for (; length > 0; bytes++, length--) state = _mm_crc32_u8(state, *bytes);
+
+    return state;
+}
+
+#endif
+
+void initCrc32c(void) {
+    /*
+    Summary:
+        Builds the tables and picks the fastest CRC-32C kernel the CPU supports: the SSE4.2 crc32 instruction, with
+        lanes joined by a PCLMULQDQ multiply where available and by tables otherwise, or the portable slicing-by-8
+        loop. The choice can be forced by setting STEGO_CRC_KERNEL to "table", "sse4.2" or "pclmul", which is useful
+        for comparing kernels; a kernel the CPU does not support is never selected.
+
+    Args:
+        None.
+
+    Return:
+        This function does not return any value; it sets the kernel used by crc32c().
+
+    Note:
+        Not thread-safe: it runs once, from stegoInit(), before crc32c(), crc32cShift() or crc32cKernelName() is used.
+    */
+
+    for (uint32_t value = 0; value < 256; value++) {
+        uint32_t crc = value;
+
+        for (int bit = 0; bit < 8; bit++) crc = crc & 1 ? (crc >> 1) ^ CRC32C_POLY : crc >> 1;
+
+        crcTable[0][value] = crc;
+    }
+
+    for (int slice = 1; slice < 8; slice++) {
+        for (int value = 0; value < 256; value++) {
+            crcTable[slice][value] = (crcTable[slice - 1][value] >> 8) ^ crcTable[0][crcTable[slice - 1][value] & 0xFF];
+        }
+    }
+
+    powers[0] = 0x40000000u;
+
+    for (int bit = 1; bit < 64; bit++) powers[bit] = multiplyModP(powers[bit - 1], powers[bit - 1]);
+
+    const char *requested = getenv("STEGO_CRC_KERNEL");
+
+    crcKernel = crcSliced;
+    kernelName = "table";
+
+#ifdef CRC_X86
+    __builtin_cpu_init();
+
+    if (__builtin_cpu_supports("sse4.2") && !(requested && strcmp(requested, "table") == 0)) {
+        initCrcShift(&longShifts[0], 2 * CRC_LONG_LANE);
+        initCrcShift(&longShifts[1], CRC_LONG_LANE);
+        initCrcShift(&shortShifts[0], 2 * CRC_SHORT_LANE);
+        initCrcShift(&shortShifts[1], CRC_SHORT_LANE);
+        useClmul = __builtin_cpu_supports("pclmul") && !(requested && strcmp(requested, "sse4.2") == 0);
+        crcKernel = crcHardware;
+        kernelName = useClmul ? "pclmul" : "sse4.2";
+    }
+#else
+    (void)requested;
+#endif
+}
+
+const char *crc32cKernelName(void) {
+    /*
+    Summary:
+        Returns the name of the kernel chosen by initCrc32c(), for diagnostics and benchmarks.
+
+    Args:
+        None.
+
+    Return:
+        Returns a static string: "pclmul", "sse4.2" or "table".
+    */
+
+    return kernelName;
+}
+
+uint32_t crc32c(uint32_t crc, const unsigned char *bytes, size_t length) {
+    /*
+    Summary:
+        Computes the CRC-32C (Castagnoli) of a buffer, the checksum the stego header holds. It can be built up piece
+        by piece: crc32c(crc32c(0, a, n), b, m) is the CRC of a followed by b.
+
+    Args:
+        crc (uint32_t): The CRC of the preceding data, or 0 to start a new one.
+        bytes (const unsigned char*): The next data.
+        length (size_t): The number of bytes.
+
+    Return:
+        Returns the CRC of the data so far.
+    */
+
+    return ~crcKernel(~crc, bytes, length);
+}
+
+uint32_t crc32cShift(uint64_t length) {
+    /*
+    Summary:
+        Prepares crc32cCombine() for joining the CRC of some data with the CRC of the length bytes that follow it.
+        Computing it takes about as long as a CRC of 100 bytes, so it pays to reuse it for pieces of the same length.
+
+    Args:
+        length (uint64_t): The length of the second piece.
+
+    Return:
+        Returns the operator to pass to crc32cCombine().
+    */
+
+    return xPowerModP(8 * length);
+}
+
+uint32_t crc32cCombine(uint32_t shift, uint32_t first, uint32_t second) {
+    /*
+    Summary:
+        Joins the CRCs of two consecutive pieces of data computed separately, such as pieces checked in parallel, into
+        the CRC of both, without touching the data.
+
+    Args:
+        shift (uint32_t): crc32cShift() of the length of the second piece.
+        first (uint32_t): The CRC of the first piece.
+        second (uint32_t): The CRC of the second piece, started from 0.
+
+    Return:
+        Returns the CRC of the first piece followed by the second.
+    */
+
+    return multiplyModP(shift, first) ^ second;
+}
@@ -0,0 +1,13 @@
+#ifndef CRC32C_H
+#define CRC32C_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+void initCrc32c(void);
+const char *crc32cKernelName(void);
+uint32_t crc32c(uint32_t crc, const unsigned char *bytes, size_t length);
+uint32_t crc32cShift(uint64_t length);
+uint32_t crc32cCombine(uint32_t shift, uint32_t first, uint32_t second);
+
+#endif
@@ -0,0 +1,1025 @@
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <png.h>
+#include <zlib.h>
+
+#include "arena.h"
+
+// The decoder's buffers are working memory, so they come from the thread's arena when one is attached
+#define STBI_MALLOC(size) workAlloc(size)
+#define STBI_REALLOC(pointer, size) workRealloc(pointer, size)
+#define STBI_FREE(pointer) workFree(pointer)
+#define STB_IMAGE_IMPLEMENTATION
+#include "stb/stb_image.h"
+#define STB_IMAGE_WRITE_IMPLEMENTATION
+#include "stb/stb_image_write.h"
+
+#include "image.h"
+
+struct ImageBackend {
+    const char *name;
+    bool (*accepts)(const unsigned char *signature, size_t length);
+    bool (*open)(ImageReader *reader, StegoImage *image);
+    bool (*readRows)(ImageReader *reader, StegoImage *image, int rows);
+    void (*close)(ImageReader *reader);
+};
+
+// The backend selectImageBackend() chose, or NULL to pick one by file signature
+static const ImageBackend *chosenBackend = NULL;
+
+static bool acceptsPng(const unsigned char *signature, size_t length);
+static bool openPng(ImageReader *reader, StegoImage *image);
+static bool readPngRows(ImageReader *reader, StegoImage *image, int rows);
+static void closePng(ImageReader *reader);
+static bool acceptsAny(const unsigned char *signature, size_t length);
+static bool openStb(ImageReader *reader, StegoImage *image);
+static bool readStbRows(ImageReader *reader, StegoImage *image, int rows);
+static void closeStb(ImageReader *reader);
+static bool openImageFile(FILE *file, ImageReader *reader, StegoImage *image);
+static png_voidp pngMalloc(png_structp png, png_alloc_size_t size);
+static void pngFree(png_structp png, png_voidp pointer);
+static void countPngBytes(png_structp png, png_bytep data, png_size_t length);
+static void appendPngBytes(png_structp png, png_bytep data, png_size_t length);
+
+static bool acceptsPng(const unsigned char *signature, size_t length) {
+    /*
+    Summary:
+        Tells whether a file starts with the PNG signature.
+
+    Args:
+        signature (const unsigned char*): The first bytes of the file.
+        length (size_t): The number of bytes read, at most 8.
+
+    Return:
+        Returns true for a PNG, false otherwise.
+    */
+
+    return length == 8 && png_sig_cmp(signature, 0, 8) == 0;
+}
+
+static bool openPng(ImageReader *reader, StegoImage *image) {
+    /*
+    Summary:
+        Reads the PNG header with libpng and sets up the same transformations stb_image applies, so both backends
+        hand out identical pixels: palettes, low bit depths and transparency are expanded, and 16-bit samples are
+        swapped to host byte order.
+
+    Args:
+        reader (ImageReader*): The reader, with its file positioned at the start of the PNG.
+        image (StegoImage*): Receives the layout of the decoded image.
+
+    Return:
+        Returns true if the header was read, false otherwise.
+    */
+
+    reader->png = createPngReader();
+    reader->info = reader->png ? png_create_info_struct(reader->png) : NULL;
+
+    if (!reader->info || setjmp(png_jmpbuf(reader->png))) return false;
+
+    png_init_io(reader->png, reader->file);
+    png_read_info(reader->png, reader->info);
+    reader->interlaced = png_get_interlace_type(reader->png, reader->info) != PNG_INTERLACE_NONE;
+    reader->incremental = !reader->interlaced;
+    png_set_expand(reader->png);
+    swapPng16(reader->png, png_get_bit_depth(reader->png, reader->info));
+
+    if (reader->interlaced) png_set_interlace_handling(reader->png);
+
+    png_read_update_info(reader->png, reader->info);
+
+    image->width = (int)png_get_image_width(reader->png, reader->info);
+    image->height = (int)png_get_image_height(reader->png, reader->info);
+    image->channels = png_get_channels(reader->png, reader->info);
+    image->bitDepth = png_get_bit_depth(reader->png, reader->info);
+
+    return png_get_rowbytes(reader->png, reader->info) == (size_t)image->width * image->channels * (image->bitDepth / 8);
+}
+
+static bool readPngRows(ImageReader *reader, StegoImage *image, int rows) {
+    /*
+    Summary:
+        Decodes rows of a PNG straight into the image buffer, growing it to hold them. Rows are decoded from where the
+        last call stopped, so decoding the top of an image and later a little more costs no more than decoding the
+        larger part once. Interlaced images only have final rows after the last pass, so they are decoded whole (and
+        never have rows dropped, so their buffer always starts at the top).
+
+    Args:
+        reader (ImageReader*): The reader, whose count of decoded rows is advanced.
+        image (StegoImage*): The image whose buffer receives the rows, starting with row reader->firstRow.
+        rows (int): The number of rows from the top that must be decoded, at most the image height.
+
+    Return:
+        Returns true if the rows were decoded, false if the PNG is damaged or memory allocation fails.
+    */
+
+    png_bytep *volatile pointers = NULL;
+    volatile bool read = false;
+    volatile int target = reader->interlaced ? image->height : rows;
+    size_t size = (size_t)(target - reader->firstRow) * image->stride;
+    unsigned char *pixels = (unsigned char *)workRealloc(image->pixels, size);
+
+    if (!pixels) return false;
+
+    image->pixels = pixels;
+
+    if (!setjmp(png_jmpbuf(reader->png))) {
+        if (reader->interlaced) {
+            pointers = (png_bytep *)workAlloc(sizeof(png_bytep) * target);
+
+            if (pointers) {
+                for (int row = 0; row < target; row++) pointers[row] = imageRow(image, row);
+
+                png_read_image(reader->png, pointers);
+                reader->rows = target;
+                read = true;
+            }
+        } else {
+            for (; reader->rows < target; reader->rows++) {
+                png_read_row(reader->png, imageRow(image, reader->rows - reader->firstRow), NULL);
+            }
+
+            read = true;
+        }
+    }
+
+    workFree(pointers);
+
+    return read;
+}
+
+static void closePng(ImageReader *reader) {
+    /*
+    Summary:
+        Releases the libpng state of a reader. Whatever is left of the PNG after the last decoded row is never read.
+
+    Args:
+        reader (ImageReader*): The reader.
+
+    Return:
+        This function does not return any value.
+    */
+
+    if (reader->png) png_destroy_read_struct(&reader->png, reader->info ? &reader->info : NULL, NULL);
+}
+
+static bool acceptsAny(const unsigned char *signature, size_t length) {
+    /*
+    Summary:
+        Accepts every file; stb_image sorts out the format itself and fails on the ones it does not know.
+
+    Args:
+        signature (const unsigned char*): The first bytes of the file (unused).
+        length (size_t): The number of bytes read (unused).
+
+    Return:
+        Returns true.
+    */
+
+    (void)signature;
+    (void)length;
+
+    return true;
+}
+
+static bool openStb(ImageReader *reader, StegoImage *image) {
+    /*
+    Summary:
+        Reads the header of any format stb_image supports. stb_image leaves the file where it was, so the pixels can
+        be decoded from the same file afterwards.
+
+    Args:
+        reader (ImageReader*): The reader, with its file positioned at the start of the image.
+        image (StegoImage*): Receives the layout of the decoded image.
+
+    Return:
+        Returns true if the header was read, false otherwise.
+    */
+
+    if (!stbi_info_from_file(reader->file, &image->width, &image->height, &image->channels)) return false;
+
+    image->bitDepth = stbi_is_16_bit_from_file(reader->file) ? 16 : 8;
+
+    return true;
+}
+
+static bool readStbRows(ImageReader *reader, StegoImage *image, int rows) {
+    /*
+    Summary:
+        Decodes the whole image with stb_image, which cannot stop part of the way through, into a buffer of its own
+        that becomes the image buffer.
+
+    Args:
+        reader (ImageReader*): The reader; nothing has been decoded from it yet, and afterwards every row has.
+        image (StegoImage*): The image whose buffer receives the pixels.
+        rows (int): The number of rows needed (unused; all of them are decoded).
+
+    Return:
+        Returns true if the image was decoded with the layout openStb() reported, false otherwise.
+    */
+
+    int width;
+    int height;
+    int channels;
+
+    (void)rows;
+
+    if (image->bitDepth == 16) {
+        image->pixels = (unsigned char *)stbi_load_from_file_16(reader->file, &width, &height, &channels, 0);
+    } else {
+        image->pixels = stbi_load_from_file(reader->file, &width, &height, &channels, 0);
+    }
+
+    if (!image->pixels || width != image->width || height != image->height || channels != image->channels) return false;
+
+    reader->rows = image->height;
+
+    return true;
+}
+
+static void closeStb(ImageReader *reader) {
+    /*
+    Summary:
+        stb_image keeps no state between calls, so there is nothing to release.
+
+    Args:
+        reader (ImageReader*): The reader (unused).
+
+    Return:
+        This function does not return any value.
+    */
+
+    (void)reader;
+}
+
+static const ImageBackend imageBackends[] = {
+    {"libpng", acceptsPng, openPng, readPngRows, closePng},
+    {"stb", acceptsAny, openStb, readStbRows, closeStb},
+};
+
+void initImageBackend(void) {
+    /*
+    Summary:
+        Applies the backend named by the environment variable STEGO_IMAGE_BACKEND, if it names one, as if it had been
+        passed to selectImageBackend(); otherwise images are opened the "auto" way.
+
+    Args:
+        This function does not take any arguments.
+
+    Return:
+        This function does not return any value.
+
+    Note:
+        Call it once at startup, before images are opened on other threads.
+    */
+
+    const char *requested = getenv("STEGO_IMAGE_BACKEND");
+
+    if (!requested || !selectImageBackend(requested)) selectImageBackend("auto");
+}
+
+bool selectImageBackend(const char *name) {
+    /*
+    Summary:
+        Chooses the backend every image is opened with from now on: "libpng", "stb", or "auto" to use libpng for PNGs
+        and stb_image for everything else, which is the default. A backend that cannot read a file's format still
+        falls back to the others, so forcing "libpng" does not stop other formats from loading. initImageBackend()
+        makes the same choice from the environment variable STEGO_IMAGE_BACKEND.
+
+    Args:
+        name (const char*): The backend to use.
+
+    Return:
+        Returns true if the name is known, false otherwise, in which case the choice is left as it was.
+
+    Note:
+        Call it before images are opened on other threads; the choice is not synchronised.
+    */
+
+    const ImageBackend *backend = NULL;
+
+    if (strcmp(name, "auto") != 0) {
+        for (size_t index = 0; index < sizeof(imageBackends) / sizeof(imageBackends[0]) && !backend; index++) {
+            if (strcmp(name, imageBackends[index].name) == 0) backend = &imageBackends[index];
+        }
+
+        if (!backend) return false;
+    }
+
+    chosenBackend = backend;
+
+    return true;
+}
+
+const char *imageBackendName(const ImageReader *reader) {
+    /*
+    Summary:
+        Names the backend an image was opened with, for reports.
+
+    Args:
+        reader (const ImageReader*): The reader returned by openImage().
+
+    Return:
+        Returns a static string.
+    */
+
+    return reader->backend->name;
+}
+
+static bool openImageFile(FILE *file, ImageReader *reader, StegoImage *image) {
+    /*
+    Summary:
+        Opens an image on a file that is already open: the preferred backend is tried first, then the others in order,
+        and the first one that recognises the file and reads its header is kept.
+
+    Args:
+        file (FILE*): The file, positioned at its start; the reader takes it over and closes it in every case.
+        reader (ImageReader*): The reader to initialise.
+        image (StegoImage*): Receives the layout of the image; pixels is set to NULL.
+
+    Return:
+        Returns true if a backend read the header, false otherwise.
+    */
+
+    const ImageBackend *preferred = chosenBackend;
+    size_t count = sizeof(imageBackends) / sizeof(imageBackends[0]);
+    unsigned char signature[8];
+    size_t length = fread(signature, 1, sizeof(signature), file);
+
+    image->pixels = NULL;
+    reader->file = file;
+    reader->png = NULL;
+    reader->info = NULL;
+    reader->rows = 0;
+    reader->firstRow = 0;
+    reader->interlaced = false;
+    reader->incremental = false;
+
+    for (size_t index = 0; index <= count; index++) {
+        const ImageBackend *backend = index == 0 ? preferred : &imageBackends[index - 1];
+
+        if (!backend || (index > 0 && backend == preferred) || !backend->accepts(signature, length)) continue;
+
+        reader->backend = backend;
+        rewind(file);
+
+        if (backend->open(reader, image)) {
+            image->stride = (size_t)image->width * image->channels * (image->bitDepth / 8);
+            return true;
+        }
+
+        backend->close(reader);
+    }
+
+    fclose(file);
+    reader->file = NULL;
+
+    return false;
+}
+
+bool openImage(char *fileName, ImageReader *reader, StegoImage *image) {
+    /*
+    Summary:
+        Opens an image file and reads its header, without decoding any pixels: PNGs go through libpng, which can
+        decode just the top rows of an image, and every other format through stb_image (see selectImageBackend()).
+        Gray, gray+alpha, RGB and RGBA images keep their channel count, and 16-bit images have 16-bit samples in host
+        byte order, so nothing is converted on the way in or out.
+
+    Args:
+        fileName (char*): The name of the image file.
+        reader (ImageReader*): The reader to initialise; pass it to readImageRows() and closeImage().
+        image (StegoImage*): Receives the dimensions, channel count, row stride and bit depth of the whole image; its
+            pixels are NULL until readImageRows() is called.
+
+    Return:
+        Returns true if the header was read, false otherwise. On success the caller must call closeImage(), and
+        freeImage() once rows have been read.
+    */
+
+    FILE *file = fopen(fileName, "rb");
+
+    return file && openImageFile(file, reader, image);
+}
+
+bool openImageFromMemory(const unsigned char *bytes, size_t length, ImageReader *reader, StegoImage *image) {
+    /*
+    Summary:
+        Opens an image that is already in memory, such as a PNG built by writePngToMemory(), the same way openImage()
+        opens a file.
+
+    Args:
+        bytes (const unsigned char*): The encoded image; it must outlive the reader.
+        length (size_t): The number of bytes in the encoded image.
+        reader (ImageReader*): The reader to initialise.
+        image (StegoImage*): Receives the layout of the image.
+
+    Return:
+        Returns true if the header was read, false otherwise.
+    */
+
+    FILE *file = length > 0 ? fmemopen((void *)bytes, length, "rb") : NULL;
+
+    return file && openImageFile(file, reader, image);
+}
+
+bool readImageRows(ImageReader *reader, StegoImage *image, int rows) {
+    /*
+    Summary:
+        Makes sure at least the top rows of an image are decoded into its pixel buffer. The buffer is a single
+        row-major block that grows with the rows decoded, and every other stage (embedding, writing and decoding) works
+        on it in place. Reading a message only needs the rows that hold it, so the rest of a large carrier is never
+        inflated. Once rows have been dropped with dropImageRows(), the buffer starts at row reader->firstRow.
+
+    Args:
+        reader (ImageReader*): The reader returned by openImage().
+        image (StegoImage*): The image opened with it.
+        rows (int): The number of rows from the top that are needed; it is clamped to the image height.
+
+    Return:
+        Returns true if at least that many rows are now in image->pixels, false if decoding failed. Some backends
+        decode more rows than asked for; only the rows asked for may be relied on, and the buffer may hold no more.
+    */
+
+    if (rows > image->height) rows = image->height;
+
+    if (rows <= reader->rows) return true;
+
+    return reader->backend->readRows(reader, image, rows);
+}
+
+bool dropImageRows(ImageReader *reader, StegoImage *image, int firstRow) {
+    /*
+    Summary:
+        Discards the decoded rows above firstRow, moving the rest to the start of the pixel buffer, so that rows
+        decoded afterwards reuse the space instead of growing the buffer. Reading an image through a window of rows
+        that slides down this way decodes it with a buffer only a few rows high.
+
+    Args:
+        reader (ImageReader*): The reader returned by openImage().
+        image (StegoImage*): The image opened with it.
+        firstRow (int): The first row to keep; it is clamped to the rows decoded so far.
+
+    Return:
+        Returns true if the rows were dropped, false if the backend decodes the whole image at once (stb_image and
+        interlaced PNGs), in which case the buffer is left as it is.
+    */
+
+    if (!reader->incremental) return false;
+
+    if (firstRow > reader->rows) firstRow = reader->rows;
+
+    if (firstRow <= reader->firstRow) return true;
+
+    size_t kept = (size_t)(reader->rows - firstRow) * image->stride;
+
+    memmove(image->pixels, imageRow(image, firstRow - reader->firstRow), kept);
+    reader->firstRow = firstRow;
+
+    return true;
+}
+
+void closeImage(ImageReader *reader) {
+    /*
+    Summary:
+        Releases the decoder state and the file of a reader. The pixel buffer belongs to the image and is released
+        with freeImage().
+
+    Args:
+        reader (ImageReader*): The reader returned by openImage().
+
+    Return:
+        This function does not return any value.
+    */
+
+    reader->backend->close(reader);
+    fclose(reader->file);
+    reader->file = NULL;
+}
+
+bool loadImage(char *fileName, StegoImage *image) {
+    /*
+    Summary:
+        Loads a whole image file and wraps the decoded buffer in a StegoImage, as openImage() followed by
+        readImageRows() for every row.
+
+    Args:
+        fileName (char*): The name of the image file to load.
+        image (StegoImage*): The StegoImage to fill in with the pixel buffer, dimensions, channel count, row stride and
+            bit depth.
+
+    Return:
+        Returns true if the image was loaded, false otherwise. On success the caller must release the buffer with
+        freeImage().
+    */
+
+    ImageReader reader;
+
+    if (!openImage(fileName, &reader, image)) return false;
+
+    bool loaded = readImageRows(&reader, image, image->height);
+
+    closeImage(&reader);
+
+    if (!loaded) freeImage(image);
+
+    return loaded;
+}
+
+bool loadImageFromMemory(const unsigned char *bytes, size_t length, StegoImage *image) {
+    /*
+    Summary:
+        Decodes a whole image that is already in memory the same way loadImage() decodes a file.
+
+    Args:
+        bytes (const unsigned char*): The encoded image.
+        length (size_t): The number of bytes in the encoded image.
+        image (StegoImage*): The StegoImage to fill in with the pixel buffer, dimensions, channel count, row stride and
+            bit depth.
+
+    Return:
+        Returns true if the image was decoded, false otherwise. On success the caller must release the buffer with
+        freeImage().
+    */
+
+    ImageReader reader;
+
+    if (!openImageFromMemory(bytes, length, &reader, image)) return false;
+
+    bool loaded = readImageRows(&reader, image, image->height);
+
+    closeImage(&reader);
+
+    if (!loaded) freeImage(image);
+
+    return loaded;
+}
+
+bool readImageInfo(char *fileName, StegoImage *image) {
+    /*
+    Summary:
+        Reads the dimensions, channel count and bit depth of an image file without decoding its pixels, so capacity can
+        be checked before anything is allocated.
+
+    Args:
+        fileName (char*): The name of the image file.
+        image (StegoImage*): Receives the layout of the image that loadImage() would produce; pixels is set to NULL.
+
+    Return:
+        Returns true if the header could be read, false otherwise.
+    */
+
+    ImageReader reader;
+
+    if (!openImage(fileName, &reader, image)) return false;
+
+    closeImage(&reader);
+
+    return true;
+}
+
+static png_voidp pngMalloc(png_structp png, png_alloc_size_t size) {
+    /*
+    Summary:
+        The libpng allocation callback. libpng also hands it zlib's allocations, so both come from workAlloc().
+
+    Args:
+        png (png_structp): The struct allocating (unused).
+        size (png_alloc_size_t): The number of bytes to allocate.
+
+    Return:
+        Returns the allocated memory, or NULL, which libpng turns into an error.
+    */
+
+    (void)png;
+
+    return workAlloc(size);
+}
+
+static void pngFree(png_structp png, png_voidp pointer) {
+    /*
+    Summary:
+        The libpng release callback matching pngMalloc().
+
+    Args:
+        png (png_structp): The struct releasing memory (unused).
+        pointer (png_voidp): The memory to release.
+
+    Return:
+        This function does not return any value.
+    */
+
+    (void)png;
+    workFree(pointer);
+}
+
+png_structp createPngReader(void) {
+    /*
+    Summary:
+        Creates a libpng read struct whose memory, including zlib's, is allocated through workAlloc().
+
+    Args:
+        This function does not take any arguments.
+
+    Return:
+        Returns the read struct, or NULL if it could not be created.
+    */
+
+    return png_create_read_struct_2(PNG_LIBPNG_VER_STRING, NULL, NULL, NULL, NULL, pngMalloc, pngFree);
+}
+
+png_structp createPngWriter(void) {
+    /*
+    Summary:
+        Creates a libpng write struct whose memory, including zlib's, is allocated through workAlloc().
+
+    Args:
+        This function does not take any arguments.
+
+    Return:
+        Returns the write struct, or NULL if it could not be created.
+    */
+
+    return png_create_write_struct_2(PNG_LIBPNG_VER_STRING, NULL, NULL, NULL, NULL, pngMalloc, pngFree);
+}
+
+unsigned char *imageRow(StegoImage *image, int row) {
+    /*
+    Summary:
+        Returns a pointer to the first byte of a row of pixels inside the image buffer.
+
+    Args:
+        image (StegoImage*): The image to index into.
+        row (int): The row of pixels, counted from the top of the image.
+
+    Return:
+        Returns a pointer into the image buffer; no memory is allocated.
+    */
+
+    return image->pixels + (size_t)row * image->stride;
+}
+
+void freeImage(StegoImage *image) {
+    /*
+    Summary:
+        Releases the pixel buffer owned by a StegoImage and clears the pointer so the image cannot be used again by accident.
+
+    Args:
+        image (StegoImage*): The image whose buffer should be released.
+
+    Return:
+        This function does not return any value; it frees the pixel buffer.
+    */
+
+    workFree(image->pixels);
+    image->pixels = NULL;
+}
+
+bool parsePngPreset(const char *name, PngOptions *options) {
+    /*
+    Summary:
+        Sets the PNG output options to one of the named presets, trading write speed against file size:
+            none: no row filter and stored (level 0) deflate blocks; fastest and largest
+            fast: the cheap sub row filter, zlib level 1 with run-length matching only
+            default: libpng's own choices (adaptive filtering, zlib level 6)
+            small: every row filter tried per row, zlib level 9; slowest and smallest
+
+    Args:
+        name (const char*): The name of the preset.
+        options (PngOptions*): The options to overwrite.
+
+    Return:
+        Returns true if the preset exists, false otherwise (options are left unchanged).
+    */
+
+    if (strcmp(name, "none") == 0) {
+        options->compressionLevel = 0;
+        options->filters = PNG_FILTER_NONE;
+        options->strategy = Z_DEFAULT_STRATEGY;
+    } else if (strcmp(name, "fast") == 0) {
+        options->compressionLevel = 1;
+        options->filters = PNG_FILTER_SUB;
+        options->strategy = Z_RLE;
+    } else if (strcmp(name, "default") == 0) {
+        options->compressionLevel = -1;
+        options->filters = -1;
+        options->strategy = -1;
+    } else if (strcmp(name, "small") == 0) {
+        options->compressionLevel = 9;
+        options->filters = PNG_ALL_FILTERS;
+        options->strategy = Z_FILTERED;
+    } else return false;
+
+    return true;
+}
+
+bool parsePngFilter(const char *name, PngOptions *options) {
+    /*
+    Summary:
+        Selects the PNG row filter used when writing: none, sub, up, avg, paeth, or all (libpng picks the best filter
+        for every row, which costs the most time).
+
+    Args:
+        name (const char*): The name of the filter.
+        options (PngOptions*): The options to update.
+
+    Return:
+        Returns true if the filter exists, false otherwise.
+    */
+
+    const char *names[] = {"none", "sub", "up", "avg", "paeth", "all"};
+    const int filters[] = {PNG_FILTER_NONE, PNG_FILTER_SUB, PNG_FILTER_UP, PNG_FILTER_AVG, PNG_FILTER_PAETH, PNG_ALL_FILTERS};
+
+    for (int index = 0; index < 6; index++) {
+        if (strcmp(name, names[index]) == 0) {
+            options->filters = filters[index];
+            return true;
+        }
+    }
+
+    return false;
+}
+
+bool parsePngStrategy(const char *name, PngOptions *options) {
+    /*
+    Summary:
+        Selects the zlib strategy used to deflate the image data: default, filtered, huffman (no string matching),
+        rle (matches only runs) or fixed (fixed Huffman codes).
+
+    Args:
+        name (const char*): The name of the strategy.
+        options (PngOptions*): The options to update.
+
+    Return:
+        Returns true if the strategy exists, false otherwise.
+    */
+
+    const char *names[] = {"default", "filtered", "huffman", "rle", "fixed"};
+    const int strategies[] = {Z_DEFAULT_STRATEGY, Z_FILTERED, Z_HUFFMAN_ONLY, Z_RLE, Z_FIXED};
+
+    for (int index = 0; index < 5; index++) {
+        if (strcmp(name, names[index]) == 0) {
+            options->strategy = strategies[index];
+            return true;
+        }
+    }
+
+    return false;
+}
+
+void applyPngOptions(png_structp png, const PngOptions *options) {
+    /*
+    Summary:
+        Applies the compression level, row filter and zlib strategy to a libpng write struct. Settings left at -1 keep
+        libpng's defaults.
+
+    Args:
+        png (png_structp): The write struct, before png_write_info() is called.
+        options (const PngOptions*): The options to apply.
+
+    Return:
+        This function does not return any value.
+    */
+
+    if (options->compressionLevel >= 0) png_set_compression_level(png, options->compressionLevel);
+
+    if (options->filters >= 0) png_set_filter(png, PNG_FILTER_TYPE_BASE, options->filters);
+
+    if (options->strategy >= 0) png_set_compression_strategy(png, options->strategy);
+}
+
+int pngColorType(int channels) {
+    /*
+    Summary:
+        Maps a channel count to the PNG colour type that stores it.
+
+    Args:
+        channels (int): The number of samples per pixel: 1 (gray), 2 (gray+alpha), 3 (RGB) or 4 (RGBA).
+
+    Return:
+        Returns the PNG_COLOR_TYPE_* value.
+    */
+
+    const int colorTypes[] = {PNG_COLOR_TYPE_GRAY, PNG_COLOR_TYPE_GRAY_ALPHA, PNG_COLOR_TYPE_RGB, PNG_COLOR_TYPE_RGBA};
+
+    return colorTypes[channels - 1];
+}
+
+void swapPng16(png_structp png, int bitDepth) {
+    /*
+    Summary:
+        PNG stores 16-bit samples big-endian while the image buffers hold them in host byte order; on little-endian
+        CPUs this asks libpng to swap the bytes of every sample as rows are read or written.
+
+    Args:
+        png (png_structp): The read or write struct.
+        bitDepth (int): The bit depth of the image; nothing happens for 8-bit images.
+
+    Return:
+        This function does not return any value.
+    */
+
+#if !defined(__BYTE_ORDER__) || __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+    if (bitDepth == 16) png_set_swap(png);
+#else
+    (void)png;
+    (void)bitDepth;
+#endif
+}
+
+void writePngImage(png_structp png, png_infop info, StegoImage *image, const PngOptions *options) {
+    /*
+    Summary:
+        Writes the header, rows and end of a PNG through an already initialised libpng write struct. Rows are handed
+        to libpng straight out of the image buffer, so no intermediate row buffer is needed.
+
+    Args:
+        png (png_structp): The write struct, with its output set up and its jump buffer armed by the caller.
+        info (png_infop): The info struct belonging to png.
+        image (StegoImage*): The image to write, gray, gray+alpha, RGB or RGBA at 8 or 16 bits per sample.
+        options (const PngOptions*): The compression settings.
+
+    Return:
+        This function does not return any value; libpng errors longjmp to the caller's jump buffer.
+    */
+
+    int bitDepth = image->bitDepth == 16 ? 16 : 8;
+
+    png_set_IHDR(png, info, image->width, image->height, bitDepth, pngColorType(image->channels), PNG_INTERLACE_NONE,
+                 PNG_COMPRESSION_TYPE_DEFAULT, PNG_FILTER_TYPE_DEFAULT);
+    applyPngOptions(png, options);
+    png_write_info(png, info);
+    swapPng16(png, bitDepth);
+
+    for (int y = 0; y < image->height; y++) png_write_row(png, imageRow(image, y));
+
+    png_write_end(png, NULL);
+}
+
+bool createPng(char *filename, StegoImage *image, const PngOptions *options) {
+    /*
+    Summary:
+        Creates a PNG image file from an image buffer. The function writes pixel data to the file specified by the given
+        filename, keeping the channel count and bit depth of the image.
+
+    Args:
+        filename (char*): The name of the file where the PNG image will be saved.
+        image (StegoImage*): The image to write, gray, gray+alpha, RGB or RGBA at 8 or 16 bits per sample.
+        options (const PngOptions*): The compression level, row filter and zlib strategy to write with.
+
+    Return:
+        Returns true once the PNG file has been written, false if any step failed.
+
+    Note:
+        If any step (file opening, PNG struct creation, writing) fails, the function prints an error message and returns false.
+        The caller must ensure valid pixel data is passed and handle memory freeing after use.
+    */
+
+    FILE *fp = fopen(filename, "wb");
+    
+    if (!fp) {
+        fprintf(stderr, "Error opening file: %s\n", filename);
+        return false;
+    }
+
+    png_structp png = createPngWriter();
+
+    if (!png) {
+        fclose(fp);
+        return false;
+    }
+
+    png_infop info = png_create_info_struct(png);
+
+    if (!info) {
+        png_destroy_write_struct(&png, NULL);
+        fclose(fp);
+        return false;
+    }
+
+    if (setjmp(png_jmpbuf(png))) {
+        fprintf(stderr, "Error writing %s\n", filename);
+        png_destroy_write_struct(&png, &info);
+        fclose(fp);
+        return false;
+    }
+
+    png_init_io(png, fp);
+    writePngImage(png, info, image, options);
+    png_destroy_write_struct(&png, &info);
+
+    return fclose(fp) == 0;
+}
+
+static void countPngBytes(png_structp png, png_bytep data, png_size_t length) {
+    /*
+    Summary:
+        A libpng write callback that throws the data away and only counts how many bytes would have been written.
+
+    Args:
+        png (png_structp): The write struct; its io pointer is the size_t counter.
+        data (png_bytep): The bytes being written (unused).
+        length (png_size_t): The number of bytes being written.
+
+    Return:
+        This function does not return any value.
+    */
+
+    (void)data;
+    *(size_t *)png_get_io_ptr(png) += length;
+}
+
+bool measurePngWrite(StegoImage *image, const PngOptions *options, size_t *bytes) {
+    /*
+    Summary:
+        Compresses an image to PNG in memory with the given options, counting the output size without touching disk.
+
+    Args:
+        image (StegoImage*): The image to compress.
+        options (const PngOptions*): The compression settings.
+        bytes (size_t*): Receives the size of the PNG file that would have been written.
+
+    Return:
+        Returns true on success, false if libpng fails.
+    */
+
+    png_structp png = createPngWriter();
+    png_infop info = png ? png_create_info_struct(png) : NULL;
+
+    *bytes = 0;
+
+    if (!info || setjmp(png_jmpbuf(png))) {
+        png_destroy_write_struct(&png, info ? &info : NULL);
+        return false;
+    }
+
+    png_set_write_fn(png, bytes, countPngBytes, NULL);
+    writePngImage(png, info, image, options);
+    png_destroy_write_struct(&png, &info);
+
+    return true;
+}
+
+
+static void appendPngBytes(png_structp png, png_bytep data, png_size_t length) {
+    /*
+    Summary:
+        A libpng write callback that appends the data to a growing PngMemory buffer, doubling it as needed.
+
+    Args:
+        png (png_structp): The write struct; its io pointer is the PngMemory.
+        data (png_bytep): The bytes being written.
+        length (png_size_t): The number of bytes being written.
+
+    Return:
+        This function does not return any value; it raises a libpng error if memory runs out.
+    */
+
+    PngMemory *memory = (PngMemory *)png_get_io_ptr(png);
+
+    if (memory->length + length > memory->capacity) {
+        size_t capacity = memory->capacity ? memory->capacity : 65536;
+
+        while (capacity < memory->length + length) capacity *= 2;
+
+        unsigned char *bytes = (unsigned char *)realloc(memory->bytes, capacity);
+
+        if (!bytes) png_error(png, "out of memory");
+
+        memory->bytes = bytes;
+        memory->capacity = capacity;
+    }
+
+    memcpy(memory->bytes + memory->length, data, length);
+    memory->length += length;
+}
+
+bool writePngToMemory(StegoImage *image, const PngOptions *options, PngMemory *memory) {
+    /*
+    Summary:
+        Compresses an image to a PNG held in memory, for callers that want the encoded bytes without a file.
+
+    Args:
+        image (StegoImage*): The image to compress.
+        options (const PngOptions*): The compression settings.
+        memory (PngMemory*): The buffer the PNG is appended to. Start with all fields zeroed; the caller frees bytes.
+
+    Return:
+        Returns true on success, false if libpng fails or memory runs out.
+    */
+
+    png_structp png = createPngWriter();
+    png_infop info = png ? png_create_info_struct(png) : NULL;
+
+    if (!info || setjmp(png_jmpbuf(png))) {
+        png_destroy_write_struct(&png, info ? &info : NULL);
+        return false;
+    }
+
+    png_set_write_fn(png, memory, appendPngBytes, NULL);
+    writePngImage(png, info, image, options);
+    png_destroy_write_struct(&png, &info);
+
+    return true;
+}
@@ -0,0 +1,62 @@
+#ifndef IMAGE_H
+#define IMAGE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <png.h>
+
+#include "stego.h"
+
+typedef struct {
+    int compressionLevel;
+    int filters;
+    int strategy;
+} PngOptions;
+
+typedef struct {
+    unsigned char *bytes;
+    size_t length;
+    size_t capacity;
+} PngMemory;
+
+typedef struct ImageBackend ImageBackend;
+
+typedef struct {
+    const ImageBackend *backend;
+    FILE *file;
+    png_structp png;
+    png_infop info;
+    int rows;
+    int firstRow;
+    bool interlaced;
+    bool incremental;
+} ImageReader;
+
+void initImageBackend(void);
+bool selectImageBackend(const char *name);
+const char *imageBackendName(const ImageReader *reader);
+bool openImage(char *fileName, ImageReader *reader, StegoImage *image);
+bool openImageFromMemory(const unsigned char *bytes, size_t length, ImageReader *reader, StegoImage *image);
+bool readImageRows(ImageReader *reader, StegoImage *image, int rows);
+bool dropImageRows(ImageReader *reader, StegoImage *image, int firstRow);
+void closeImage(ImageReader *reader);
+bool loadImage(char *fileName, StegoImage *image);
+bool loadImageFromMemory(const unsigned char *bytes, size_t length, StegoImage *image);
+bool readImageInfo(char *fileName, StegoImage *image);
+unsigned char *imageRow(StegoImage *image, int row);
+void freeImage(StegoImage *image);
+png_structp createPngReader(void);
+png_structp createPngWriter(void);
+bool parsePngPreset(const char *name, PngOptions *options);
+bool parsePngFilter(const char *name, PngOptions *options);
+bool parsePngStrategy(const char *name, PngOptions *options);
+void applyPngOptions(png_structp png, const PngOptions *options);
+int pngColorType(int channels);
+void swapPng16(png_structp png, int bitDepth);
+void writePngImage(png_structp png, png_infop info, StegoImage *image, const PngOptions *options);
+bool createPng(char *fileName, StegoImage *image, const PngOptions *options);
+bool measurePngWrite(StegoImage *image, const PngOptions *options, size_t *bytes);
+bool writePngToMemory(StegoImage *image, const PngOptions *options, PngMemory *memory);
+
+#endif
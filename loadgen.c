@@ -0,0 +1,359 @@
+#include <errno.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#include "pool.h"
+#include "server.h"
+
+typedef struct {
+    const char *socketPath;
+    char **requests;
+    size_t requestCount;
+    size_t total;
+    double *latencies;
+    atomic_size_t next;
+    atomic_size_t failures;
+    atomic_size_t lost;
+} LoadJob;
+
+static double elapsedSeconds(struct timespec *start);
+static int connectServer(const char *socketPath);
+static bool exchange(int fd, const char *request, char *reply, size_t replyCapacity);
+static size_t readRequests(const char *fileName, char ***requests);
+static void runClient(void *context, size_t chunk, int worker);
+static int compareLatencies(const void *left, const void *right);
+static double percentile(const double *sorted, size_t count, int percent);
+
+int main(int argc, char *argv[]) {
+    /*
+    USE CASE
+        Drives a running ./stegano --serve daemon with a closed loop of requests and reports the throughput and the
+        latency percentiles seen by the clients, followed by the daemon's own statistics.
+            Step 1: Run make stegano stegano-load
+            Step 2: ./stegano -j 8 --serve {socket path} &
+                    ./stegano-load [-c CONNECTIONS] [-n REQUESTS] {socket path} {file of request lines}
+        Every line of the request file is one daemon request, such as "check<TAB>a-output.png" or
+        "decode<TAB>a-output.png<TAB>a.txt"; blank lines and lines starting with '#' are skipped, and "-" reads the
+        file from stdin. The requests are sent in turn, starting over at the end of the file, until REQUESTS (by
+        default as many as there are lines) have been answered. Each of the CONNECTIONS (default 1) clients keeps one
+        connection open and sends its next request as soon as the previous one is answered.
+    */
+
+    int connections = 1;
+    size_t total = 0;
+    int arg = 1;
+
+    while (arg + 1 < argc) {
+        if (strcmp("-c", argv[arg]) == 0) connections = atoi(argv[arg + 1]);
+        else if (strcmp("-n", argv[arg]) == 0) total = strtoull(argv[arg + 1], NULL, 10);
+        else break;
+
+        arg += 2;
+    }
+
+    if (argc - arg != 2 || connections < 1) {
+        fprintf(stderr, "Usage: %s [-c CONNECTIONS] [-n REQUESTS] SOCKET REQUEST_FILE\n", argv[0]);
+        return 1;
+    }
+
+    LoadJob job;
+    struct timespec start;
+
+    job.socketPath = argv[arg];
+    job.requestCount = readRequests(argv[arg + 1], &job.requests);
+    job.total = total ? total : job.requestCount;
+    job.latencies = (double *)malloc((job.total ? job.total : 1) * sizeof(double));
+    atomic_init(&job.next, 0);
+    atomic_init(&job.failures, 0);
+    atomic_init(&job.lost, 0);
+
+    if (job.requestCount == 0 || !job.latencies) {
+        fprintf(stderr, job.requestCount == 0 ? "No requests to send\n" : "Memory allocation failed\n");
+        return 1;
+    }
+
+    WorkerPool *pool = createWorkerPool(connections);
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    runParallel(pool, (size_t)connections, runClient, &job);
+
+    double seconds = elapsedSeconds(&start);
+    size_t answered = atomic_load(&job.next) < job.total ? atomic_load(&job.next) : job.total;
+    size_t lost = atomic_load(&job.lost);
+    size_t samples = 0;
+
+    destroyWorkerPool(pool);
+
+    // Requests whose connection broke have no latency
+    for (size_t index = 0; index < answered; index++) {
+        if (job.latencies[index] >= 0) job.latencies[samples++] = job.latencies[index];
+    }
+
+    qsort(job.latencies, samples, sizeof(double), compareLatencies);
+
+    printf("%zu requests, %zu failed, %zu lost, %d connections, %.3f s, %.1f requests/s\n", samples,
+           atomic_load(&job.failures), lost, connections, seconds, seconds > 0 ? samples / seconds : 0.0);
+    printf("latency ms: p50 %.3f, p90 %.3f, p99 %.3f, max %.3f\n", percentile(job.latencies, samples, 50),
+           percentile(job.latencies, samples, 90), percentile(job.latencies, samples, 99),
+           samples ? job.latencies[samples - 1] : 0.0);
+
+    int fd = connectServer(job.socketPath);
+    char reply[SERVER_LINE_MAX];
+
+    if (fd >= 0 && exchange(fd, "stats", reply, sizeof(reply))) printf("server: %s\n", reply);
+
+    if (fd >= 0) close(fd);
+
+    for (size_t index = 0; index < job.requestCount; index++) free(job.requests[index]);
+
+    free(job.requests);
+    free(job.latencies);
+
+    return lost == 0 && atomic_load(&job.failures) == 0 ? 0 : 1;
+}
+
+static double elapsedSeconds(struct timespec *start) {
+    /*
+    Summary:
+        Measures the time elapsed since a point taken with CLOCK_MONOTONIC.
+
+    Args:
+        start (struct timespec*): The starting point.
+
+    Return:
+        Returns the elapsed time in seconds.
+    */
+
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+
+    return (now.tv_sec - start->tv_sec) + (now.tv_nsec - start->tv_nsec) / 1e9;
+}
+
+static int connectServer(const char *socketPath) {
+    /*
+    Summary:
+        Connects to the daemon's Unix domain socket.
+
+    Args:
+        socketPath (const char*): The path the daemon listens on.
+
+    Return:
+        Returns the connected socket, or -1 after printing an error to stderr.
+    */
+
+    struct sockaddr_un address;
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+
+    memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    strncpy(address.sun_path, socketPath, sizeof(address.sun_path) - 1);
+
+    if (fd < 0 || connect(fd, (struct sockaddr *)&address, sizeof(address)) != 0) {
+        fprintf(stderr, "Error connecting to %s: %s\n", socketPath, strerror(errno));
+
+        if (fd >= 0) close(fd);
+
+        return -1;
+    }
+
+    return fd;
+}
+
+static bool exchange(int fd, const char *request, char *reply, size_t replyCapacity) {
+    /*
+    Summary:
+        Sends one request line and reads its reply line. Only one request is outstanding on a connection at a time,
+        so everything read up to the newline belongs to this reply.
+
+    Args:
+        fd (int): The connection.
+        request (const char*): The request, without a newline.
+        reply (char*): Receives the reply, without its newline.
+        replyCapacity (size_t): The size of the reply buffer.
+
+    Return:
+        Returns true if a whole reply was read, false if the request or the reply is longer than SERVER_LINE_MAX or
+        the connection broke.
+    */
+
+    char line[SERVER_LINE_MAX];
+    int length = snprintf(line, sizeof(line), "%s\n", request);
+    size_t used = 0;
+
+    // The whole line goes in one send, so the daemon sees it complete on its first read
+    if (length < 0 || (size_t)length >= sizeof(line) || send(fd, line, (size_t)length, MSG_NOSIGNAL) != length) {
+        return false;
+    }
+
+    while (used + 1 < replyCapacity) {
+        ssize_t got = read(fd, reply + used, replyCapacity - 1 - used);
+
+        if (got < 0 && errno == EINTR) continue;
+
+        if (got <= 0) return false;
+
+        char *end = (char *)memchr(reply + used, '\n', (size_t)got);
+
+        used += (size_t)got;
+
+        if (end) {
+            *end = '\0';
+            return true;
+        }
+    }
+
+    return false;
+}
+
+static size_t readRequests(const char *fileName, char ***requests) {
+    /*
+    Summary:
+        Reads the request lines to send, skipping blank lines and lines starting with '#'.
+
+    Args:
+        fileName (const char*): The file to read, or "-" for stdin.
+        requests (char***): Receives a dynamically allocated array of requests, each allocated separately; the caller
+            frees them and the array.
+
+    Return:
+        Returns the number of requests read; errors are printed to stderr and end the list early.
+    */
+
+    FILE *file = strcmp(fileName, "-") == 0 ? stdin : fopen(fileName, "r");
+    char *line = NULL;
+    size_t lineCapacity = 0;
+    size_t count = 0;
+    size_t capacity = 0;
+    ssize_t lineLength;
+
+    *requests = NULL;
+
+    if (!file) {
+        fprintf(stderr, "Error opening file: %s\n", fileName);
+        return 0;
+    }
+
+    while ((lineLength = getline(&line, &lineCapacity, file)) >= 0) {
+        while (lineLength > 0 && (line[lineLength - 1] == '\n' || line[lineLength - 1] == '\r')) {
+            line[--lineLength] = '\0';
+        }
+
+        if (lineLength == 0 || line[0] == '#') continue;
+
+        if (count == capacity) {
+            size_t grown = capacity ? capacity * 2 : 64;
+            char **resized = (char **)realloc(*requests, grown * sizeof(char *));
+
+            if (!resized) break;
+
+            *requests = resized;
+            capacity = grown;
+        }
+
+        if (!((*requests)[count] = strdup(line))) break;
+
+        count++;
+    }
+
+    free(line);
+
+    if (file != stdin) fclose(file);
+
+    return count;
+}
+
+static void runClient(void *context, size_t chunk, int worker) {
+    /*
+    Summary:
+        One client: opens a connection and sends requests over it one after the other, claiming the next request
+        index from the shared counter, until the run is complete. The latency of every request is stored at its
+        index; a failed reply is counted, and a broken connection ends the client.
+
+    Args:
+        context (void*): The LoadJob.
+        chunk (size_t): The index of the client; unused.
+        worker (int): The index of the running thread; unused.
+
+    Return:
+        This function does not return any value.
+    */
+
+    LoadJob *job = (LoadJob *)context;
+    int fd = connectServer(job->socketPath);
+    char reply[SERVER_LINE_MAX];
+    size_t index;
+
+    (void)chunk;
+    (void)worker;
+
+    if (fd < 0) {
+        atomic_fetch_add(&job->lost, 1);
+        return;
+    }
+
+    while ((index = atomic_fetch_add(&job->next, 1)) < job->total) {
+        struct timespec start;
+
+        clock_gettime(CLOCK_MONOTONIC, &start);
+
+        if (!exchange(fd, job->requests[index % job->requestCount], reply, sizeof(reply))) {
+            fprintf(stderr, "Connection to %s lost\n", job->socketPath);
+            job->latencies[index] = -1.0;
+            atomic_fetch_add(&job->lost, 1);
+            break;
+        }
+
+        job->latencies[index] = elapsedSeconds(&start) * 1e3;
+
+        if (strncmp(reply, "FAILED", 6) == 0) atomic_fetch_add(&job->failures, 1);
+    }
+
+    close(fd);
+}
+
+static int compareLatencies(const void *left, const void *right) {
+    /*
+    Summary:
+        Orders latencies for qsort().
+
+    Args:
+        left (const void*): The first latency.
+        right (const void*): The second latency.
+
+    Return:
+        Returns a negative value, zero or a positive value as the first is smaller, equal or larger.
+    */
+
+    double a = *(const double *)left;
+    double b = *(const double *)right;
+
+    return (a > b) - (a < b);
+}
+
+static double percentile(const double *sorted, size_t count, int percent) {
+    /*
+    Summary:
+        Picks a percentile by nearest rank: the smallest sample at or above the given share of the samples.
+
+    Args:
+        sorted (const double*): The samples, in ascending order.
+        count (size_t): The number of samples.
+        percent (int): The percentile, 1 to 100.
+
+    Return:
+        Returns the percentile, or 0 if there are no samples.
+    */
+
+    if (count == 0) return 0.0;
+
+    return sorted[(count * (size_t)percent + 99) / 100 - 1];
+}
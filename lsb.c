@@ -0,0 +1,541 @@
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "lsb.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define LSB_X86 1
+#endif
+
+typedef void (*EmbedKernel)(unsigned char *carrier, const unsigned char *bits, size_t count);
+typedef void (*ExtractKernel)(const unsigned char *carrier, unsigned char *bits, size_t count);
+typedef void (*EmbedFieldKernel)(unsigned char *carrier, const unsigned char *bits, size_t groups, int bitsPerByte);
+typedef void (*ExtractFieldKernel)(const unsigned char *carrier, unsigned char *bits, size_t groups, int bitsPerByte);
+
+static EmbedKernel embedKernel = NULL;
+static ExtractKernel extractKernel = NULL;
+static EmbedFieldKernel embedFieldKernel = NULL;
+static ExtractFieldKernel extractFieldKernel = NULL;
+static EmbedFieldKernel embedFieldFallback = NULL;
+static ExtractFieldKernel extractFieldFallback = NULL;
+static const char *kernelName = "none";
+static unsigned char reversedBits[256];
+
+static void embedScalar(unsigned char *carrier, const unsigned char *bits, size_t count) {
+    /*
+    Summary:
+        Spreads count payload bytes across 8 * count carrier bytes, one bit per carrier byte, most significant bit first.
+        The least significant bit of each carrier byte is replaced and the other 7 bits are left untouched.
+
+    Args:
+        carrier (unsigned char*): The carrier bytes to update in place.
+        bits (const unsigned char*): The packed payload bits.
+        count (size_t): The number of payload bytes to embed.
+
+    Return:
+        This function does not return any value; it modifies the carrier in place.
+    */
+
+    for (size_t byte = 0; byte < count; byte++) {
+        unsigned char value = bits[byte];
+
+        for (int bit = 0; bit < 8; bit++) {
+            carrier[byte * 8 + bit] = (unsigned char)((carrier[byte * 8 + bit] & 0xFE) | ((value >> (7 - bit)) & 1));
+        }
+    }
+}
+
+static void extractScalar(const unsigned char *carrier, unsigned char *bits, size_t count) {
+    /*
+    Summary:
+        Collects the least significant bit of 8 * count carrier bytes back into count packed payload bytes, most
+        significant bit first. This is the inverse of embedScalar().
+
+    Args:
+        carrier (const unsigned char*): The carrier bytes to read.
+        bits (unsigned char*): The buffer that receives the packed payload bits.
+        count (size_t): The number of payload bytes to extract.
+
+    Return:
+        This function does not return any value; it fills the bits buffer.
+    */
+
+    for (size_t byte = 0; byte < count; byte++) {
+        unsigned char value = 0;
+
+        for (int bit = 0; bit < 8; bit++) value = (unsigned char)((value << 1) | (carrier[byte * 8 + bit] & 1));
+
+        bits[byte] = value;
+    }
+}
+
+static void embedFieldsScalar(unsigned char *carrier, const unsigned char *bits, size_t groups, int bitsPerByte) {
+    /*
+    Summary:
+        Embeds bitsPerByte payload bits into the low bits of every carrier byte. The work is done in groups of
+        bitsPerByte payload bytes, which fill exactly 8 carrier bytes: the group is loaded as one big-endian word and
+        each carrier byte takes its field with a shift and a mask.
+
+    Args:
+        carrier (unsigned char*): The carrier bytes to update in place, 8 * groups of them.
+        bits (const unsigned char*): The packed payload bits, bitsPerByte * groups bytes.
+        groups (size_t): The number of groups to embed.
+        bitsPerByte (int): The number of low bits replaced in each carrier byte, 1 to 4.
+
+    Return:
+        This function does not return any value; it modifies the carrier in place.
+    */
+
+    unsigned char mask = (unsigned char)((1 << bitsPerByte) - 1);
+
+    for (size_t group = 0; group < groups; group++) {
+        uint32_t word = 0;
+
+        for (int byte = 0; byte < bitsPerByte; byte++) word = (word << 8) | bits[group * bitsPerByte + byte];
+
+        for (int field = 0; field < 8; field++) {
+            unsigned char value = (unsigned char)(word >> (bitsPerByte * (7 - field))) & mask;
+
+            carrier[group * 8 + field] = (unsigned char)((carrier[group * 8 + field] & ~mask) | value);
+        }
+    }
+}
+
+static void extractFieldsScalar(const unsigned char *carrier, unsigned char *bits, size_t groups, int bitsPerByte) {
+    /*
+    Summary:
+        Collects the low bitsPerByte bits of every carrier byte back into packed payload bytes. This is the inverse of
+        embedFieldsScalar().
+
+    Args:
+        carrier (const unsigned char*): The carrier bytes to read, 8 * groups of them.
+        bits (unsigned char*): The buffer that receives bitsPerByte * groups packed payload bytes.
+        groups (size_t): The number of groups to extract.
+        bitsPerByte (int): The number of low bits used in each carrier byte, 1 to 4.
+
+    Return:
+        This function does not return any value; it fills the bits buffer.
+    */
+
+    unsigned char mask = (unsigned char)((1 << bitsPerByte) - 1);
+
+    for (size_t group = 0; group < groups; group++) {
+        uint32_t word = 0;
+
+        for (int field = 0; field < 8; field++) word = (word << bitsPerByte) | (carrier[group * 8 + field] & mask);
+
+        for (int byte = 0; byte < bitsPerByte; byte++) {
+            bits[group * bitsPerByte + byte] = (unsigned char)(word >> (8 * (bitsPerByte - 1 - byte)));
+        }
+    }
+}
+
+#ifdef LSB_X86
+
+// Each payload byte is broadcast over 8 carrier bytes, and byte k of the group is tested against 0x80 >> k.
+__attribute__((target("sse2")))
+static void embedSse2(unsigned char *carrier, const unsigned char *bits, size_t count) {
+    const __m128i masks = _mm_set_epi8(1, 2, 4, 8, 16, 32, 64, -128, 1, 2, 4, 8, 16, 32, 64, -128);
+    const __m128i clear = _mm_set1_epi8((char)0xFE);
+    const __m128i one = _mm_set1_epi8(1);
+    size_t byte = 0;
+
+    for (; byte + 2 <= count; byte += 2) {
+        __m128i value = _mm_cvtsi32_si128(bits[byte] | (bits[byte + 1] << 8));
+
+        value = _mm_unpacklo_epi8(value, value);
+        value = _mm_unpacklo_epi16(value, value);
+        value = _mm_unpacklo_epi32(value, value);
+
+        __m128i set = _mm_and_si128(_mm_cmpeq_epi8(_mm_and_si128(value, masks), masks), one);
+        __m128i pixels = _mm_loadu_si128((const __m128i *)(carrier + byte * 8));
+
+        _mm_storeu_si128((__m128i *)(carrier + byte * 8), _mm_or_si128(_mm_and_si128(pixels, clear), set));
+    }
+
+    embedScalar(carrier + byte * 8, bits + byte, count - byte);
+}
+
+// Shifting each 16-bit lane left by 7 moves bit 0 of both bytes into their sign bits for movemask.
+__attribute__((target("sse2")))
+static void extractSse2(const unsigned char *carrier, unsigned char *bits, size_t count) {
+    size_t byte = 0;
+
+    for (; byte + 2 <= count; byte += 2) {
+        __m128i pixels = _mm_loadu_si128((const __m128i *)(carrier + byte * 8));
+        int mask = _mm_movemask_epi8(_mm_slli_epi16(pixels, 7));
+
+        bits[byte] = reversedBits[mask & 0xFF];
+        bits[byte + 1] = reversedBits[(mask >> 8) & 0xFF];
+    }
+
+    extractScalar(carrier + byte * 8, bits + byte, count - byte);
+}
+
+__attribute__((target("avx2")))
+static void embedAvx2(unsigned char *carrier, const unsigned char *bits, size_t count) {
+    const __m256i spread = _mm256_setr_epi8(0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 1, 1, 1, 1,
+                                            2, 2, 2, 2, 2, 2, 2, 2, 3, 3, 3, 3, 3, 3, 3, 3);
+    const __m256i masks = _mm256_set1_epi64x((long long)0x0102040810204080ULL);
+    const __m256i clear = _mm256_set1_epi8((char)0xFE);
+    const __m256i one = _mm256_set1_epi8(1);
+    size_t byte = 0;
+
+    for (; byte + 4 <= count; byte += 4) {
+        uint32_t word;
+
+        memcpy(&word, bits + byte, sizeof(word));
+
+        __m256i value = _mm256_shuffle_epi8(_mm256_set1_epi32((int)word), spread);
+        __m256i set = _mm256_and_si256(_mm256_cmpeq_epi8(_mm256_and_si256(value, masks), masks), one);
+        __m256i pixels = _mm256_loadu_si256((const __m256i *)(carrier + byte * 8));
+
+        _mm256_storeu_si256((__m256i *)(carrier + byte * 8), _mm256_or_si256(_mm256_and_si256(pixels, clear), set));
+    }
+
+    embedSse2(carrier + byte * 8, bits + byte, count - byte);
+}
+
+// Reversing every group of 8 carrier bytes first makes movemask produce the payload bytes in order.
+__attribute__((target("avx2")))
+static void extractAvx2(const unsigned char *carrier, unsigned char *bits, size_t count) {
+    const __m256i reverse = _mm256_setr_epi8(7, 6, 5, 4, 3, 2, 1, 0, 15, 14, 13, 12, 11, 10, 9, 8,
+                                             7, 6, 5, 4, 3, 2, 1, 0, 15, 14, 13, 12, 11, 10, 9, 8);
+    size_t byte = 0;
+
+    for (; byte + 4 <= count; byte += 4) {
+        __m256i pixels = _mm256_shuffle_epi8(_mm256_loadu_si256((const __m256i *)(carrier + byte * 8)), reverse);
+        uint32_t word = (uint32_t)_mm256_movemask_epi8(_mm256_slli_epi16(pixels, 7));
+
+        memcpy(bits + byte, &word, sizeof(word));
+    }
+
+    extractSse2(carrier + byte * 8, bits + byte, count - byte);
+}
+
+static const unsigned char spreadIndices512[64] = {
+    0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 1, 1, 1, 1,
+    2, 2, 2, 2, 2, 2, 2, 2, 3, 3, 3, 3, 3, 3, 3, 3,
+    4, 4, 4, 4, 4, 4, 4, 4, 5, 5, 5, 5, 5, 5, 5, 5,
+    6, 6, 6, 6, 6, 6, 6, 6, 7, 7, 7, 7, 7, 7, 7, 7
+};
+
+static const unsigned char reverseIndices512[64] = {
+    7, 6, 5, 4, 3, 2, 1, 0, 15, 14, 13, 12, 11, 10, 9, 8,
+    7, 6, 5, 4, 3, 2, 1, 0, 15, 14, 13, 12, 11, 10, 9, 8,
+    7, 6, 5, 4, 3, 2, 1, 0, 15, 14, 13, 12, 11, 10, 9, 8,
+    7, 6, 5, 4, 3, 2, 1, 0, 15, 14, 13, 12, 11, 10, 9, 8
+};
+
+// AVX-512BW turns the spread payload straight into a byte mask, so the LSB is set with one masked add.
+__attribute__((target("avx512f,avx512bw")))
+static void embedAvx512(unsigned char *carrier, const unsigned char *bits, size_t count) {
+    const __m512i spread = _mm512_loadu_si512((const void *)spreadIndices512);
+    const __m512i masks = _mm512_set1_epi64((long long)0x0102040810204080ULL);
+    const __m512i clear = _mm512_set1_epi8((char)0xFE);
+    const __m512i one = _mm512_set1_epi8(1);
+    size_t byte = 0;
+
+    for (; byte + 8 <= count; byte += 8) {
+        uint64_t word;
+
+        memcpy(&word, bits + byte, sizeof(word));
+
+        __m512i value = _mm512_shuffle_epi8(_mm512_set1_epi64((long long)word), spread);
+        __mmask64 set = _mm512_test_epi8_mask(value, masks);
+        __m512i pixels = _mm512_and_si512(_mm512_loadu_si512((const void *)(carrier + byte * 8)), clear);
+
+        _mm512_storeu_si512((void *)(carrier + byte * 8), _mm512_mask_add_epi8(pixels, set, pixels, one));
+    }
+
+    embedAvx2(carrier + byte * 8, bits + byte, count - byte);
+}
+
+__attribute__((target("avx512f,avx512bw")))
+static void extractAvx512(const unsigned char *carrier, unsigned char *bits, size_t count) {
+    const __m512i reverse = _mm512_loadu_si512((const void *)reverseIndices512);
+    const __m512i one = _mm512_set1_epi8(1);
+    size_t byte = 0;
+
+    for (; byte + 8 <= count; byte += 8) {
+        __m512i pixels = _mm512_shuffle_epi8(_mm512_loadu_si512((const void *)(carrier + byte * 8)), reverse);
+        uint64_t word = (uint64_t)_mm512_test_epi8_mask(pixels, one);
+
+        memcpy(bits + byte, &word, sizeof(word));
+    }
+
+    extractAvx2(carrier + byte * 8, bits + byte, count - byte);
+}
+
+static const uint64_t fieldMasks[5] = {0, 0x0101010101010101ULL, 0x0303030303030303ULL, 0x0707070707070707ULL,
+                                       0x0F0F0F0F0F0F0F0FULL};
+
+// pdep deposits the group's last field into carrier byte 0, so the 8 carrier bytes are byte-swapped into order.
+__attribute__((target("bmi2")))
+static void embedFieldsBmi2(unsigned char *carrier, const unsigned char *bits, size_t groups, int bitsPerByte) {
+    const uint64_t mask = fieldMasks[bitsPerByte];
+
+    for (size_t group = 0; group < groups; group++) {
+        uint64_t word = 0;
+        uint64_t pixels;
+
+        for (int byte = 0; byte < bitsPerByte; byte++) word = (word << 8) | bits[group * bitsPerByte + byte];
+
+        memcpy(&pixels, carrier + group * 8, sizeof(pixels));
+        pixels = (pixels & ~mask) | __builtin_bswap64(_pdep_u64(word, mask));
+        memcpy(carrier + group * 8, &pixels, sizeof(pixels));
+    }
+}
+
+__attribute__((target("bmi2")))
+static void extractFieldsBmi2(const unsigned char *carrier, unsigned char *bits, size_t groups, int bitsPerByte) {
+    const uint64_t mask = fieldMasks[bitsPerByte];
+
+    for (size_t group = 0; group < groups; group++) {
+        uint64_t pixels;
+
+        memcpy(&pixels, carrier + group * 8, sizeof(pixels));
+
+        uint64_t word = _pext_u64(__builtin_bswap64(pixels), mask);
+
+        for (int byte = 0; byte < bitsPerByte; byte++) {
+            bits[group * bitsPerByte + byte] = (unsigned char)(word >> (8 * (bitsPerByte - 1 - byte)));
+        }
+    }
+}
+
+// Widens 16 bytes to 16-bit lanes and splits each into its high and low part, high part first in memory.
+__attribute__((target("avx2")))
+static inline __m256i splitFieldsAvx2(__m128i value, int shift) {
+    __m256i wide = _mm256_cvtepu8_epi16(value);
+    __m256i low = _mm256_and_si256(wide, _mm256_set1_epi16((short)((1 << shift) - 1)));
+
+    return _mm256_or_si256(_mm256_srli_epi16(wide, shift), _mm256_slli_epi16(low, 8));
+}
+
+// 2 and 4 bits per byte split every payload byte into nibbles (and those into 2-bit fields) without crossing bytes.
+__attribute__((target("avx2")))
+static void embedFieldsAvx2(unsigned char *carrier, const unsigned char *bits, size_t groups, int bitsPerByte) {
+    size_t group = 0;
+
+    if (bitsPerByte == 4) {
+        const __m256i clear = _mm256_set1_epi8((char)0xF0);
+
+        for (; group + 4 <= groups; group += 4) {
+            __m256i fields = splitFieldsAvx2(_mm_loadu_si128((const __m128i *)(bits + group * 4)), 4);
+            __m256i pixels = _mm256_loadu_si256((const __m256i *)(carrier + group * 8));
+
+            _mm256_storeu_si256((__m256i *)(carrier + group * 8), _mm256_or_si256(_mm256_and_si256(pixels, clear), fields));
+        }
+    } else if (bitsPerByte == 2) {
+        const __m256i clear = _mm256_set1_epi8((char)0xFC);
+
+        for (; group + 8 <= groups; group += 8) {
+            __m256i nibbles = splitFieldsAvx2(_mm_loadu_si128((const __m128i *)(bits + group * 2)), 4);
+            __m256i low = splitFieldsAvx2(_mm256_castsi256_si128(nibbles), 2);
+            __m256i high = splitFieldsAvx2(_mm256_extracti128_si256(nibbles, 1), 2);
+            __m256i first = _mm256_loadu_si256((const __m256i *)(carrier + group * 8));
+            __m256i second = _mm256_loadu_si256((const __m256i *)(carrier + group * 8 + 32));
+
+            _mm256_storeu_si256((__m256i *)(carrier + group * 8), _mm256_or_si256(_mm256_and_si256(first, clear), low));
+            _mm256_storeu_si256((__m256i *)(carrier + group * 8 + 32), _mm256_or_si256(_mm256_and_si256(second, clear), high));
+        }
+    }
+
+    embedFieldFallback(carrier + group * 8, bits + group * bitsPerByte, groups - group, bitsPerByte);
+}
+
+// maddubs joins neighbouring fields into 16-bit lanes (and madd joins those again for 2 bits), then packs narrow them.
+__attribute__((target("avx2")))
+static void extractFieldsAvx2(const unsigned char *carrier, unsigned char *bits, size_t groups, int bitsPerByte) {
+    size_t group = 0;
+
+    if (bitsPerByte == 4) {
+        const __m256i mask = _mm256_set1_epi8(0x0F);
+        const __m256i weights = _mm256_set1_epi16(0x0110);
+
+        for (; group + 4 <= groups; group += 4) {
+            __m256i pixels = _mm256_and_si256(_mm256_loadu_si256((const __m256i *)(carrier + group * 8)), mask);
+            __m256i words = _mm256_maddubs_epi16(pixels, weights);
+
+            _mm_storeu_si128((__m128i *)(bits + group * 4),
+                             _mm_packus_epi16(_mm256_castsi256_si128(words), _mm256_extracti128_si256(words, 1)));
+        }
+    } else if (bitsPerByte == 2) {
+        const __m256i mask = _mm256_set1_epi8(0x03);
+        const __m256i pairs = _mm256_set1_epi16(0x0104);
+        const __m256i nibbles = _mm256_set1_epi32(0x00010010);
+
+        for (; group + 8 <= groups; group += 8) {
+            __m256i first = _mm256_and_si256(_mm256_loadu_si256((const __m256i *)(carrier + group * 8)), mask);
+            __m256i second = _mm256_and_si256(_mm256_loadu_si256((const __m256i *)(carrier + group * 8 + 32)), mask);
+
+            first = _mm256_madd_epi16(_mm256_maddubs_epi16(first, pairs), nibbles);
+            second = _mm256_madd_epi16(_mm256_maddubs_epi16(second, pairs), nibbles);
+
+            __m128i low = _mm_packs_epi32(_mm256_castsi256_si128(first), _mm256_extracti128_si256(first, 1));
+            __m128i high = _mm_packs_epi32(_mm256_castsi256_si128(second), _mm256_extracti128_si256(second, 1));
+
+            _mm_storeu_si128((__m128i *)(bits + group * 2), _mm_packus_epi16(low, high));
+        }
+    }
+
+    extractFieldFallback(carrier + group * 8, bits + group * bitsPerByte, groups - group, bitsPerByte);
+}
+
+#endif
+
+void initLsbKernels(void) {
+    /*
+    Summary:
+        Picks the fastest embed/extract kernels the CPU supports (AVX-512BW, AVX2, SSE2, or the portable scalar loop)
+        using cpuid. The choice can be forced by setting STEGO_LSB_KERNEL to "scalar", "sse2", "avx2" or "avx512",
+        which is useful for comparing kernels; a kernel the CPU does not support is never selected. Embedding 2 or 4
+        bits per carrier byte uses AVX2 when available; 3 bits, and CPUs without AVX2, use BMI2 pdep/pext where it is
+        fast and the shift-and-mask loop otherwise.
+
+    Args:
+        None.
+
+    Return:
+        This function does not return any value; it sets the kernels used by embedBits() and extractBits().
+
+    Note:
+        Not thread-safe: it runs once, from stegoInit(), before embedBits(), extractBits() or lsbKernelName() is used.
+    */
+
+    for (int value = 0; value < 256; value++) {
+        unsigned char reversed = 0;
+
+        for (int bit = 0; bit < 8; bit++) reversed |= (unsigned char)(((value >> bit) & 1) << (7 - bit));
+
+        reversedBits[value] = reversed;
+    }
+
+    const char *requested = getenv("STEGO_LSB_KERNEL");
+
+    embedKernel = embedScalar;
+    extractKernel = extractScalar;
+    embedFieldKernel = embedFieldsScalar;
+    extractFieldKernel = extractFieldsScalar;
+    kernelName = "scalar";
+
+    if (requested && strcmp(requested, "scalar") == 0) return;
+
+#ifdef LSB_X86
+    __builtin_cpu_init();
+
+    // AMD cores before Zen 3 implement pdep/pext in microcode, which is slower than the scalar loop
+    bool slowBmi2 = __builtin_cpu_is("amdfam15h") || __builtin_cpu_is("znver1") || __builtin_cpu_is("znver2");
+
+    if (__builtin_cpu_supports("bmi2") && !slowBmi2) {
+        embedFieldKernel = embedFieldsBmi2;
+        extractFieldKernel = extractFieldsBmi2;
+    }
+
+    bool any = !requested;
+
+    if (__builtin_cpu_supports("avx2") && (any || strcmp(requested, "sse2") != 0)) {
+        embedFieldFallback = embedFieldKernel;
+        extractFieldFallback = extractFieldKernel;
+        embedFieldKernel = embedFieldsAvx2;
+        extractFieldKernel = extractFieldsAvx2;
+    }
+
+    if (__builtin_cpu_supports("avx512bw") && (any || strcmp(requested, "avx512") == 0)) {
+        embedKernel = embedAvx512;
+        extractKernel = extractAvx512;
+        kernelName = "avx512";
+    } else if (__builtin_cpu_supports("avx2") && (any || strcmp(requested, "avx2") == 0)) {
+        embedKernel = embedAvx2;
+        extractKernel = extractAvx2;
+        kernelName = "avx2";
+    } else if (__builtin_cpu_supports("sse2") && (any || strcmp(requested, "sse2") == 0)) {
+        embedKernel = embedSse2;
+        extractKernel = extractSse2;
+        kernelName = "sse2";
+    }
+#endif
+}
+
+const char *lsbKernelName(void) {
+    /*
+    Summary:
+        Returns the name of the kernel chosen by initLsbKernels(), for diagnostics and benchmarks.
+
+    Args:
+        None.
+
+    Return:
+        Returns a static string such as "avx2" or "scalar".
+    */
+
+    return kernelName;
+}
+
+void embedBits(unsigned char *carrier, const unsigned char *bits, size_t bitCount, int bitsPerByte) {
+    /*
+    Summary:
+        Replaces the low bitsPerByte bits of consecutive carrier bytes with bitCount payload bits taken most significant
+        bit first from a packed buffer; carrier byte i receives payload bits i * bitsPerByte onwards, highest bit first.
+        Whole groups of 8 carrier bytes go through the selected kernel; a trailing partial group is handled here, and
+        only the carrier bits that receive payload bits are changed.
+
+    Args:
+        carrier (unsigned char*): The carrier bytes to update in place.
+        bits (const unsigned char*): The packed payload bits, at least (bitCount + 7) / 8 bytes long.
+        bitCount (size_t): The number of bits to embed.
+        bitsPerByte (int): The number of low bits used in each carrier byte, 1 to 4.
+
+    Return:
+        This function does not return any value; it modifies the carrier in place.
+    */
+
+    size_t groups = bitCount / (8 * bitsPerByte);
+
+    if (bitsPerByte == 1) embedKernel(carrier, bits, groups);
+    else embedFieldKernel(carrier, bits, groups, bitsPerByte);
+
+    for (size_t bit = groups * 8 * bitsPerByte; bit < bitCount; bit++) {
+        int shift = bitsPerByte - 1 - (int)(bit % bitsPerByte);
+        int value = (bits[bit / 8] >> (7 - (int)(bit % 8))) & 1;
+        size_t byte = bit / bitsPerByte;
+
+        carrier[byte] = (unsigned char)((carrier[byte] & ~(1 << shift)) | (value << shift));
+    }
+}
+
+void extractBits(const unsigned char *carrier, unsigned char *bits, size_t bitCount, int bitsPerByte) {
+    /*
+    Summary:
+        Collects bitCount bits from the low bitsPerByte bits of consecutive carrier bytes into a packed buffer, most
+        significant bit first. This is the inverse of embedBits(). Unused low bits of a trailing partial byte are set
+        to 0.
+
+    Args:
+        carrier (const unsigned char*): The carrier bytes to read.
+        bits (unsigned char*): The buffer that receives the bits, at least (bitCount + 7) / 8 bytes long.
+        bitCount (size_t): The number of bits to extract.
+        bitsPerByte (int): The number of low bits used in each carrier byte, 1 to 4.
+
+    Return:
+        This function does not return any value; it fills the bits buffer.
+    */
+
+    size_t groups = bitCount / (8 * bitsPerByte);
+    size_t first = groups * 8 * bitsPerByte;
+
+    if (bitsPerByte == 1) extractKernel(carrier, bits, groups);
+    else extractFieldKernel(carrier, bits, groups, bitsPerByte);
+
+    if (first < bitCount) memset(bits + first / 8, 0, (bitCount + 7) / 8 - first / 8);
+
+    for (size_t bit = first; bit < bitCount; bit++) {
+        int value = (carrier[bit / bitsPerByte] >> (bitsPerByte - 1 - (int)(bit % bitsPerByte))) & 1;
+
+        bits[bit / 8] |= (unsigned char)(value << (7 - (int)(bit % 8)));
+    }
+}
@@ -0,0 +1,11 @@
+#ifndef LSB_H
+#define LSB_H
+
+#include <stddef.h>
+
+void initLsbKernels(void);
+const char *lsbKernelName(void);
+void embedBits(unsigned char *carrier, const unsigned char *bits, size_t bitCount, int bitsPerByte);
+void extractBits(const unsigned char *carrier, unsigned char *bits, size_t bitCount, int bitsPerByte);
+
+#endif
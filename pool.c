@@ -0,0 +1,226 @@
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "pool.h"
+
+struct WorkerPool {
+    pthread_t *workers;
+    int threads;
+    pthread_mutex_t lock;
+    pthread_cond_t wake;
+    pthread_cond_t done;
+    unsigned long generation;
+    int busy;
+    bool stopping;
+    ChunkWork work;
+    void *context;
+    size_t chunkCount;
+    atomic_size_t nextChunk;
+    atomic_int startedWorkers;
+};
+
+static void runChunks(WorkerPool *pool, int worker) {
+    /*
+    Summary:
+        Claims chunks from the shared counter and runs the current job on them until none are left. Both the workers
+        and the thread that called runParallel() execute this loop, so chunks are balanced dynamically.
+
+    Args:
+        pool (WorkerPool*): The pool whose current job should be worked on.
+        worker (int): The index of the calling thread, passed on to the work function.
+
+    Return:
+        This function does not return any value.
+    */
+
+    size_t chunk;
+
+    while ((chunk = atomic_fetch_add(&pool->nextChunk, 1)) < pool->chunkCount) pool->work(pool->context, chunk, worker);
+}
+
+static void *workerMain(void *argument) {
+    /*
+    Summary:
+        The body of every worker thread. It sleeps until runParallel() publishes a new job, helps run it, then reports
+        back and goes to sleep again, until the pool is destroyed.
+
+    Args:
+        argument (void*): The WorkerPool the thread belongs to.
+
+    Return:
+        Returns NULL when the pool is destroyed.
+    */
+
+    WorkerPool *pool = (WorkerPool *)argument;
+    int worker = atomic_fetch_add(&pool->startedWorkers, 1) + 1;
+    unsigned long seen = 0;
+
+    pthread_mutex_lock(&pool->lock);
+
+    while (true) {
+        while (!pool->stopping && pool->generation == seen) pthread_cond_wait(&pool->wake, &pool->lock);
+
+        if (pool->stopping) break;
+
+        seen = pool->generation;
+        pthread_mutex_unlock(&pool->lock);
+
+        runChunks(pool, worker);
+
+        pthread_mutex_lock(&pool->lock);
+
+        if (--pool->busy == 0) pthread_cond_signal(&pool->done);
+    }
+
+    pthread_mutex_unlock(&pool->lock);
+
+    return NULL;
+}
+
+WorkerPool *createWorkerPool(int threads) {
+    /*
+    Summary:
+        Creates a pool of threads - 1 worker threads; the thread calling runParallel() acts as the last worker. The
+        threads are started once and reused for every job, so a job costs a wake-up rather than a thread creation.
+
+    Args:
+        threads (int): The total number of threads that should run each job. Values below 1 are treated as 1.
+
+    Return:
+        Returns a pointer to the new pool, or NULL if memory allocation or thread creation fails. The pool must be
+        released with destroyWorkerPool().
+    */
+
+    WorkerPool *pool = (WorkerPool *)calloc(1, sizeof(WorkerPool));
+
+    if (!pool) return NULL;
+
+    pool->threads = threads < 1 ? 1 : threads;
+    pool->workers = (pthread_t *)calloc((size_t)pool->threads, sizeof(pthread_t));
+
+    if (!pool->workers) {
+        free(pool);
+        return NULL;
+    }
+
+    pthread_mutex_init(&pool->lock, NULL);
+    pthread_cond_init(&pool->wake, NULL);
+    pthread_cond_init(&pool->done, NULL);
+    atomic_init(&pool->nextChunk, 0);
+    atomic_init(&pool->startedWorkers, 0);
+
+    for (int worker = 0; worker < pool->threads - 1; worker++) {
+        if (pthread_create(&pool->workers[worker], NULL, workerMain, pool) != 0) {
+            pool->threads = worker + 1;
+            destroyWorkerPool(pool);
+            return NULL;
+        }
+    }
+
+    return pool;
+}
+
+int workerPoolThreads(WorkerPool *pool) {
+    /*
+    Summary:
+        Returns the number of threads that run each job, including the calling thread.
+
+    Args:
+        pool (WorkerPool*): The pool to query. NULL stands for running everything on the calling thread.
+
+    Return:
+        Returns the thread count, at least 1.
+    */
+
+    return pool ? pool->threads : 1;
+}
+
+void runParallel(WorkerPool *pool, size_t chunkCount, ChunkWork work, void *context) {
+    /*
+    Summary:
+        Runs work(context, chunk, worker) for every chunk in [0, chunkCount) across the pool and returns once all of
+        them have finished. Chunks are handed out one at a time from an atomic counter, so the work function must only
+        touch data that belongs to its own chunk, or to its worker: worker is the index of the running thread, from 0
+        (the caller) to workerPoolThreads(pool) - 1, and no two chunks run on the same worker at once.
+
+    Args:
+        pool (WorkerPool*): The pool to run on. NULL runs every chunk on the calling thread.
+        chunkCount (size_t): The number of chunks.
+        work (ChunkWork): The function to call for each chunk.
+        context (void*): Passed unchanged to every call of work.
+
+    Return:
+        This function does not return any value.
+    */
+
+    if (!pool || pool->threads == 1 || chunkCount < 2) {
+        for (size_t chunk = 0; chunk < chunkCount; chunk++) work(context, chunk, 0);
+        return;
+    }
+
+    pthread_mutex_lock(&pool->lock);
+    pool->work = work;
+    pool->context = context;
+    pool->chunkCount = chunkCount;
+    atomic_store(&pool->nextChunk, 0);
+    pool->busy = pool->threads - 1;
+    pool->generation++;
+    pthread_cond_broadcast(&pool->wake);
+    pthread_mutex_unlock(&pool->lock);
+
+    runChunks(pool, 0);
+
+    pthread_mutex_lock(&pool->lock);
+
+    while (pool->busy > 0) pthread_cond_wait(&pool->done, &pool->lock);
+
+    pthread_mutex_unlock(&pool->lock);
+}
+
+void destroyWorkerPool(WorkerPool *pool) {
+    /*
+    Summary:
+        Stops and joins the worker threads and frees the pool.
+
+    Args:
+        pool (WorkerPool*): The pool to destroy. NULL is ignored.
+
+    Return:
+        This function does not return any value.
+    */
+
+    if (!pool) return;
+
+    pthread_mutex_lock(&pool->lock);
+    pool->stopping = true;
+    pthread_cond_broadcast(&pool->wake);
+    pthread_mutex_unlock(&pool->lock);
+
+    for (int worker = 0; worker < pool->threads - 1; worker++) pthread_join(pool->workers[worker], NULL);
+
+    pthread_cond_destroy(&pool->done);
+    pthread_cond_destroy(&pool->wake);
+    pthread_mutex_destroy(&pool->lock);
+    free(pool->workers);
+    free(pool);
+}
+
+int defaultThreadCount(void) {
+    /*
+    Summary:
+        Returns the number of online CPUs, used when no -j option is given.
+
+    Args:
+        None.
+
+    Return:
+        Returns the CPU count, at least 1.
+    */
+
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+
+    return cpus < 1 ? 1 : (int)cpus;
+}
@@ -0,0 +1,16 @@
+#ifndef POOL_H
+#define POOL_H
+
+#include <stddef.h>
+
+typedef void (*ChunkWork)(void *context, size_t chunk, int worker);
+
+typedef struct WorkerPool WorkerPool;
+
+WorkerPool *createWorkerPool(int threads);
+int workerPoolThreads(WorkerPool *pool);
+void runParallel(WorkerPool *pool, size_t chunkCount, ChunkWork work, void *context);
+void destroyWorkerPool(WorkerPool *pool);
+int defaultThreadCount(void);
+
+#endif
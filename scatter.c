@@ -0,0 +1,129 @@
+#include "scatter.h"
+
+uint64_t mixKey(uint64_t value) {
+    /*
+    Summary:
+        Scrambles a 64-bit value with the splitmix64 finaliser: every input bit affects every output bit, and equal
+        inputs always give equal outputs, which is what both the round function and the key schedule need.
+
+    Args:
+        value (uint64_t): The value to scramble.
+
+    Return:
+        Returns the scrambled value.
+    */
+
+    value ^= value >> 30;
+    value *= 0xBF58476D1CE4E5B9u;
+    value ^= value >> 27;
+    value *= 0x94D049BB133111EBu;
+    value ^= value >> 31;
+
+    return value;
+}
+
+void initScatterMap(ScatterMap *map, uint64_t key, size_t carrierBytes, int blockBits) {
+    /*
+    Summary:
+        Prepares the keyed permutation that spreads a payload over the carrier bytes after the header. The carrier is
+        cut into blocks of 2^blockBits bytes; whole blocks are permuted with a Feistel network over the block index,
+        and the bytes inside every block are rotated by a keyed amount. A partial block at the end of the image
+        is not used.
+
+    Args:
+        map (ScatterMap*): The map to initialise.
+        key (uint64_t): The secret the permutation is derived from; the same key gives the same permutation.
+        carrierBytes (size_t): The number of carrier bytes available to the payload.
+        blockBits (int): The base-2 logarithm of the block size in carrier bytes; 0 spreads single bytes.
+
+    Return:
+        This function does not return any value; it fills in the map.
+
+    Note:
+        The Feistel network works on the smallest power of two that holds every block index and walks the cycle
+        until it lands inside the image, so fewer than two rounds of the network are needed per block on average.
+    */
+
+    int domainBits = 0;
+
+    map->blockBits = blockBits;
+    map->blockCount = carrierBytes >> blockBits;
+
+    while (domainBits < 63 && ((size_t)1 << domainBits) < map->blockCount) domainBits++;
+
+    map->leftBits = domainBits / 2;
+    map->rightBits = domainBits - map->leftBits;
+
+    for (int round = 0; round < SCATTER_ROUNDS; round++) {
+        map->roundKeys[round] = mixKey(key + 0x9E3779B97F4A7C15u * (round + 1));
+    }
+
+    map->rotationKey = mixKey(key ^ 0xD6E8FEB86659FD93u);
+}
+
+size_t scatterSlots(const ScatterMap *map) {
+    /*
+    Summary:
+        Returns how many carrier bytes the permutation covers: every byte of every whole block.
+
+    Args:
+        map (const ScatterMap*): The map.
+
+    Return:
+        Returns the number of payload slots.
+    */
+
+    return map->blockCount << map->blockBits;
+}
+
+size_t scatterBlock(const ScatterMap *map, size_t block) {
+    /*
+    Summary:
+        Maps a logical block to the block of the carrier it is stored in. The map is a bijection and needs no state
+        besides the key, so any thread can compute the position of any part of the payload on its own.
+
+    Args:
+        map (const ScatterMap*): The map.
+        block (size_t): The logical block, less than map->blockCount.
+
+    Return:
+        Returns the physical block, less than map->blockCount.
+    */
+
+    uint64_t leftMask = ((uint64_t)1 << map->leftBits) - 1;
+    uint64_t rightMask = ((uint64_t)1 << map->rightBits) - 1;
+    uint64_t value = block;
+
+    do {
+        uint64_t left = value >> map->rightBits;
+        uint64_t right = value & rightMask;
+
+        // Alternating rounds keep the network a bijection even when the halves differ in size
+        for (int round = 0; round < SCATTER_ROUNDS; round += 2) {
+            left ^= mixKey(right ^ map->roundKeys[round]) & leftMask;
+            right ^= mixKey(left ^ map->roundKeys[round + 1]) & rightMask;
+        }
+
+        value = (left << map->rightBits) | right;
+    } while (value >= map->blockCount);
+
+    return (size_t)value;
+}
+
+size_t blockRotation(const ScatterMap *map, size_t block) {
+    /*
+    Summary:
+        Returns the keyed rotation of the bytes inside one block: slot s of the block is stored at byte
+        (s + rotation) mod 2^blockBits. A rotation keeps the slots in at most two contiguous runs, so a block is still
+        copied with two memcpy() calls.
+
+    Args:
+        map (const ScatterMap*): The map.
+        block (size_t): The logical block.
+
+    Return:
+        Returns the rotation, less than 2^blockBits.
+    */
+
+    return (size_t)(mixKey(block ^ map->rotationKey) & (((uint64_t)1 << map->blockBits) - 1));
+}
@@ -0,0 +1,24 @@
+#ifndef SCATTER_H
+#define SCATTER_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define SCATTER_ROUNDS 4
+
+typedef struct {
+    uint64_t roundKeys[SCATTER_ROUNDS];
+    uint64_t rotationKey;
+    size_t blockCount;
+    int blockBits;
+    int leftBits;
+    int rightBits;
+} ScatterMap;
+
+void initScatterMap(ScatterMap *map, uint64_t key, size_t carrierBytes, int blockBits);
+size_t scatterSlots(const ScatterMap *map);
+size_t scatterBlock(const ScatterMap *map, size_t block);
+size_t blockRotation(const ScatterMap *map, size_t block);
+uint64_t mixKey(uint64_t value);
+
+#endif
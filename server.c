@@ -0,0 +1,698 @@
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+
+#include "pool.h"
+#include "server.h"
+
+// Connections open at once; further clients are turned away until one closes
+#define SERVER_MAX_CONNECTIONS 1024
+// Latencies of the most recent requests, from which the percentiles are taken
+#define SERVER_LATENCY_SAMPLES 8192
+// Connections the kernel keeps waiting for accept()
+#define SERVER_BACKLOG 128
+
+typedef struct {
+    int fd;
+    size_t used;
+    struct timespec ready;
+    char line[SERVER_LINE_MAX];
+} Connection;
+
+typedef struct {
+    int listener;
+    int wake[2];
+    int threads;
+    RequestHandler handler;
+    void *context;
+    pthread_mutex_t lock;
+    pthread_cond_t queued;
+    bool stopping;
+    Connection *queue[SERVER_MAX_CONNECTIONS];
+    size_t queueHead;
+    size_t queueDepth;
+    size_t maxQueueDepth;
+    Connection *returned[SERVER_MAX_CONNECTIONS];
+    size_t returnedCount;
+    size_t connections;
+    size_t busy;
+    uint64_t requests;
+    uint64_t failures;
+    double latencies[SERVER_LATENCY_SAMPLES];
+    struct timespec started;
+} ServerState;
+
+// Set by SIGINT and SIGTERM, which also write to the wake pipe so the acceptor notices at once
+static volatile sig_atomic_t stopRequested = 0;
+static int stopWake = -1;
+
+static void handleStopSignal(int signalNumber);
+static void wakeAcceptor(int fd);
+static double millisecondsSince(const struct timespec *start);
+static int compareLatencies(const void *left, const void *right);
+static void formatServerStats(ServerState *server, char *reply, size_t replyCapacity);
+static bool sendAll(int fd, const char *bytes, size_t length);
+static bool answerRequest(ServerState *server, Connection *connection, char *request, int worker);
+static bool serveConnection(ServerState *server, Connection *connection, int worker);
+static void acceptConnections(ServerState *server);
+static void serveRequests(ServerState *server, int worker);
+static void serverThread(void *context, size_t chunk, int worker);
+static int openListener(const char *socketPath);
+
+static void handleStopSignal(int signalNumber) {
+    /*
+    Summary:
+        The SIGINT and SIGTERM handler: asks the server to stop once the requests being served are answered.
+
+    Args:
+        signalNumber (int): The signal received.
+
+    Return:
+        This function does not return any value.
+    */
+
+    (void)signalNumber;
+
+    stopRequested = 1;
+
+    if (stopWake >= 0) wakeAcceptor(stopWake);
+}
+
+static void wakeAcceptor(int fd) {
+    /*
+    Summary:
+        Writes a byte to the wake pipe, so the acceptor returns from poll() and picks up handed back connections or a
+        stop request. The pipe is non-blocking: if it is full, the acceptor is waking up anyway.
+
+    Args:
+        fd (int): The write end of the wake pipe.
+
+    Return:
+        This function does not return any value.
+    */
+
+    ssize_t written = write(fd, "", 1);
+
+    (void)written;
+}
+
+static double millisecondsSince(const struct timespec *start) {
+    /*
+    Summary:
+        Measures the time elapsed since a point taken with CLOCK_MONOTONIC.
+
+    Args:
+        start (const struct timespec*): The starting point.
+
+    Return:
+        Returns the elapsed time in milliseconds.
+    */
+
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+
+    return (now.tv_sec - start->tv_sec) * 1e3 + (now.tv_nsec - start->tv_nsec) / 1e6;
+}
+
+static int compareLatencies(const void *left, const void *right) {
+    /*
+    Summary:
+        Orders latencies for qsort().
+
+    Args:
+        left (const void*): The first latency.
+        right (const void*): The second latency.
+
+    Return:
+        Returns a negative value, zero or a positive value as the first is smaller, equal or larger.
+    */
+
+    double a = *(const double *)left;
+    double b = *(const double *)right;
+
+    return (a > b) - (a < b);
+}
+
+static void formatServerStats(ServerState *server, char *reply, size_t replyCapacity) {
+    /*
+    Summary:
+        Writes the answer to a "stats" request: one line of JSON with the request and failure counts, the connections
+        and busy workers, the current and largest queue depth (requests waiting for a worker), the throughput since
+        start-up, and the median, 99th percentile and largest latency of the last SERVER_LATENCY_SAMPLES requests.
+        A request's latency runs from the moment its connection became readable to the moment the reply was sent, so
+        it includes the time spent in the queue:
+            {"requests":1200,"failed":0,"connections":8,"workers":4,"busy":4,"queue_depth":3,"max_queue_depth":7,
+             "uptime_s":12.4,"requests_per_s":96.8,"samples":1200,"p50_ms":31.2,"p99_ms":58.9,"max_ms":61.0}
+
+    Args:
+        server (ServerState*): The running server.
+        reply (char*): The buffer that receives the line, without a newline.
+        replyCapacity (size_t): The size of the buffer.
+
+    Return:
+        This function does not return any value.
+    */
+
+    double *latencies = (double *)malloc(SERVER_LATENCY_SAMPLES * sizeof(double));
+
+    pthread_mutex_lock(&server->lock);
+
+    uint64_t requests = server->requests;
+    uint64_t failures = server->failures;
+    size_t samples = requests < SERVER_LATENCY_SAMPLES ? (size_t)requests : SERVER_LATENCY_SAMPLES;
+    size_t connections = server->connections;
+    size_t busy = server->busy;
+    size_t queueDepth = server->queueDepth;
+    size_t maxQueueDepth = server->maxQueueDepth;
+
+    if (latencies) memcpy(latencies, server->latencies, samples * sizeof(double));
+    else samples = 0;
+
+    pthread_mutex_unlock(&server->lock);
+
+    double uptime = millisecondsSince(&server->started) / 1e3;
+    double p50 = 0.0;
+    double p99 = 0.0;
+    double slowest = 0.0;
+
+    // Nearest rank: the smallest sample at or above the given share of the samples
+    if (samples > 0) {
+        qsort(latencies, samples, sizeof(double), compareLatencies);
+        p50 = latencies[(samples + 1) / 2 - 1];
+        p99 = latencies[(samples * 99 + 99) / 100 - 1];
+        slowest = latencies[samples - 1];
+    }
+
+    snprintf(reply, replyCapacity,
+             "{\"requests\":%llu,\"failed\":%llu,\"connections\":%zu,\"workers\":%d,\"busy\":%zu,\"queue_depth\":%zu,"
+             "\"max_queue_depth\":%zu,\"uptime_s\":%.1f,\"requests_per_s\":%.1f,\"samples\":%zu,\"p50_ms\":%.3f,"
+             "\"p99_ms\":%.3f,\"max_ms\":%.3f}",
+             (unsigned long long)requests, (unsigned long long)failures, connections, server->threads, busy, queueDepth,
+             maxQueueDepth, uptime, uptime > 0 ? requests / uptime : 0.0, samples, p50, p99, slowest);
+
+    free(latencies);
+}
+
+static bool sendAll(int fd, const char *bytes, size_t length) {
+    /*
+    Summary:
+        Sends a whole reply. A client that went away makes send() fail instead of raising SIGPIPE.
+
+    Args:
+        fd (int): The connection.
+        bytes (const char*): The reply.
+        length (size_t): The number of bytes.
+
+    Return:
+        Returns true if everything was sent, false otherwise.
+    */
+
+    while (length > 0) {
+        ssize_t sent = send(fd, bytes, length, MSG_NOSIGNAL);
+
+        if (sent < 0 && errno == EINTR) continue;
+
+        if (sent <= 0) return false;
+
+        bytes += sent;
+        length -= (size_t)sent;
+    }
+
+    return true;
+}
+
+static bool answerRequest(ServerState *server, Connection *connection, char *request, int worker) {
+    /*
+    Summary:
+        Answers one request line: "stats" is answered by the server itself, everything else by the handler. The
+        latency of every handled request is recorded once its reply has been sent.
+
+    Args:
+        server (ServerState*): The running server.
+        connection (Connection*): The connection the request came in on.
+        request (char*): The request, without its line ending; the handler may modify it.
+        worker (int): The index of the serving thread, passed on to the handler.
+
+    Return:
+        Returns true if the reply was sent, false if the client has gone away.
+    */
+
+    char reply[SERVER_LINE_MAX];
+    bool stats = strcmp(request, "stats") == 0;
+    bool ok = true;
+
+    reply[0] = '\0';
+
+    if (stats) formatServerStats(server, reply, sizeof(reply) - 1);
+    else ok = server->handler(server->context, request, worker, reply, sizeof(reply) - 1);
+
+    size_t length = strnlen(reply, sizeof(reply) - 1);
+
+    reply[length++] = '\n';
+
+    bool sent = sendAll(connection->fd, reply, length);
+
+    if (stats) return sent;
+
+    double latency = millisecondsSince(&connection->ready);
+
+    pthread_mutex_lock(&server->lock);
+    server->latencies[server->requests % SERVER_LATENCY_SAMPLES] = latency;
+    server->requests++;
+
+    if (!ok) server->failures++;
+
+    pthread_mutex_unlock(&server->lock);
+
+    return sent;
+}
+
+static bool serveConnection(ServerState *server, Connection *connection, int worker) {
+    /*
+    Summary:
+        Reads what a readable connection has sent and answers every complete request line in it. A partial line is
+        kept for when the rest arrives, so a worker never waits on a slow client.
+
+    Args:
+        server (ServerState*): The running server.
+        connection (Connection*): The connection, which poll() reported readable.
+        worker (int): The index of the serving thread.
+
+    Return:
+        Returns true if the connection stays open, false if the client closed it, sent a line longer than
+        SERVER_LINE_MAX or went away while being answered.
+    */
+
+    ssize_t got;
+
+    do got = read(connection->fd, connection->line + connection->used, SERVER_LINE_MAX - connection->used);
+    while (got < 0 && errno == EINTR);
+
+    if (got <= 0) return false;
+
+    connection->used += (size_t)got;
+
+    char *start = connection->line;
+    char *end = connection->line + connection->used;
+    char *newline;
+
+    while ((newline = (char *)memchr(start, '\n', (size_t)(end - start))) != NULL) {
+        *newline = '\0';
+
+        if (newline > start && newline[-1] == '\r') newline[-1] = '\0';
+
+        if (!answerRequest(server, connection, start, worker)) return false;
+
+        start = newline + 1;
+    }
+
+    connection->used = (size_t)(end - start);
+
+    if (connection->used == SERVER_LINE_MAX) {
+        static const char tooLong[] = "FAILED\trequest too long\n";
+
+        sendAll(connection->fd, tooLong, sizeof(tooLong) - 1);
+        return false;
+    }
+
+    memmove(connection->line, start, connection->used);
+
+    return true;
+}
+
+static void acceptConnections(ServerState *server) {
+    /*
+    Summary:
+        The acceptor: accepts new clients and watches every idle connection with poll(). A connection that becomes
+        readable is stamped and queued for the workers; once a worker has answered it, it is handed back through the
+        wake pipe and watched again. Runs until a stop is requested, then wakes the workers so they stop too.
+
+    Args:
+        server (ServerState*): The running server.
+
+    Return:
+        This function does not return any value.
+    */
+
+    Connection **idle = (Connection **)calloc(SERVER_MAX_CONNECTIONS, sizeof(Connection *));
+    struct pollfd *fds = (struct pollfd *)calloc(SERVER_MAX_CONNECTIONS + 2, sizeof(struct pollfd));
+    size_t idleCount = 0;
+
+    if (!idle || !fds) fprintf(stderr, "Memory allocation failed\n");
+
+    while (idle && fds && !stopRequested) {
+        fds[0].fd = server->listener;
+        fds[0].events = POLLIN;
+        fds[1].fd = server->wake[0];
+        fds[1].events = POLLIN;
+
+        for (size_t index = 0; index < idleCount; index++) {
+            fds[index + 2].fd = idle[index]->fd;
+            fds[index + 2].events = POLLIN;
+        }
+
+        if (poll(fds, idleCount + 2, -1) < 0) {
+            if (errno == EINTR) continue;
+
+            perror("poll");
+            break;
+        }
+
+        if (fds[1].revents) {
+            char drain[64];
+
+            while (read(server->wake[0], drain, sizeof(drain)) > 0) continue;
+        }
+
+        size_t kept = 0;
+        size_t queued = 0;
+
+        pthread_mutex_lock(&server->lock);
+
+        for (size_t index = 0; index < idleCount; index++) {
+            Connection *connection = idle[index];
+
+            if (!fds[index + 2].revents) {
+                idle[kept++] = connection;
+                continue;
+            }
+
+            clock_gettime(CLOCK_MONOTONIC, &connection->ready);
+            server->queue[(server->queueHead + server->queueDepth) % SERVER_MAX_CONNECTIONS] = connection;
+            server->queueDepth++;
+            queued++;
+        }
+
+        if (server->queueDepth > server->maxQueueDepth) server->maxQueueDepth = server->queueDepth;
+
+        if (queued > 0) pthread_cond_broadcast(&server->queued);
+
+        idleCount = kept;
+
+        while (server->returnedCount > 0) idle[idleCount++] = server->returned[--server->returnedCount];
+
+        pthread_mutex_unlock(&server->lock);
+
+        if (!(fds[0].revents & POLLIN)) continue;
+
+        int fd = accept(server->listener, NULL, NULL);
+
+        if (fd < 0) continue;
+
+        Connection *connection = NULL;
+
+        pthread_mutex_lock(&server->lock);
+
+        if (server->connections < SERVER_MAX_CONNECTIONS) {
+            connection = (Connection *)calloc(1, sizeof(Connection));
+
+            if (connection) server->connections++;
+        }
+
+        pthread_mutex_unlock(&server->lock);
+
+        if (!connection) {
+            close(fd);
+            continue;
+        }
+
+        fcntl(fd, F_SETFD, FD_CLOEXEC);
+        connection->fd = fd;
+        idle[idleCount++] = connection;
+    }
+
+    pthread_mutex_lock(&server->lock);
+    server->stopping = true;
+    server->connections -= idleCount;
+    pthread_cond_broadcast(&server->queued);
+    pthread_mutex_unlock(&server->lock);
+
+    for (size_t index = 0; index < idleCount; index++) {
+        close(idle[index]->fd);
+        free(idle[index]);
+    }
+
+    free(fds);
+    free(idle);
+}
+
+static void serveRequests(ServerState *server, int worker) {
+    /*
+    Summary:
+        A worker: takes readable connections off the queue one at a time and answers their requests, then hands them
+        back to the acceptor, or closes them if the client is done. Runs until the server stops.
+
+    Args:
+        server (ServerState*): The running server.
+        worker (int): The index of the serving thread.
+
+    Return:
+        This function does not return any value.
+    */
+
+    while (true) {
+        pthread_mutex_lock(&server->lock);
+
+        while (!server->stopping && server->queueDepth == 0) pthread_cond_wait(&server->queued, &server->lock);
+
+        if (server->stopping) {
+            pthread_mutex_unlock(&server->lock);
+            return;
+        }
+
+        Connection *connection = server->queue[server->queueHead];
+
+        server->queueHead = (server->queueHead + 1) % SERVER_MAX_CONNECTIONS;
+        server->queueDepth--;
+        server->busy++;
+        pthread_mutex_unlock(&server->lock);
+
+        bool open = serveConnection(server, connection, worker);
+
+        pthread_mutex_lock(&server->lock);
+        server->busy--;
+
+        if (open) server->returned[server->returnedCount++] = connection;
+        else server->connections--;
+
+        pthread_mutex_unlock(&server->lock);
+
+        if (open) wakeAcceptor(server->wake[1]);
+        else {
+            close(connection->fd);
+            free(connection);
+        }
+    }
+}
+
+static void serverThread(void *context, size_t chunk, int worker) {
+    /*
+    Summary:
+        The body of every server thread, run as one chunk each across the pool: chunk 0 is the acceptor and the others
+        are workers. None of them returns before the server stops, so every thread of the pool gets exactly one.
+
+    Args:
+        context (void*): The ServerState.
+        chunk (size_t): 0 for the acceptor, a worker otherwise.
+        worker (int): The index of the running thread.
+
+    Return:
+        This function does not return any value.
+    */
+
+    ServerState *server = (ServerState *)context;
+
+    if (chunk == 0) acceptConnections(server);
+    else serveRequests(server, worker);
+}
+
+static int openListener(const char *socketPath) {
+    /*
+    Summary:
+        Creates the listening Unix domain socket. A socket file left behind by a server that is no longer running is
+        replaced; one that still accepts connections, or any other file at the path, is left alone.
+
+    Args:
+        socketPath (const char*): The path to listen on.
+
+    Return:
+        Returns the listening socket, or -1 after printing an error to stderr.
+    */
+
+    struct sockaddr_un address;
+    struct stat status;
+
+    memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+
+    if (strlen(socketPath) >= sizeof(address.sun_path)) {
+        fprintf(stderr, "Socket path is too long: %s\n", socketPath);
+        return -1;
+    }
+
+    strcpy(address.sun_path, socketPath);
+
+    if (lstat(socketPath, &status) == 0) {
+        int probe = socket(AF_UNIX, SOCK_STREAM, 0);
+        bool live = probe >= 0 && connect(probe, (struct sockaddr *)&address, sizeof(address)) == 0;
+
+        if (probe >= 0) close(probe);
+
+        if (!S_ISSOCK(status.st_mode) || live) {
+            fprintf(stderr, "%s is already in use\n", socketPath);
+            return -1;
+        }
+
+        unlink(socketPath);
+    }
+
+    int listener = socket(AF_UNIX, SOCK_STREAM, 0);
+
+    if (listener < 0 || bind(listener, (struct sockaddr *)&address, sizeof(address)) != 0 ||
+        listen(listener, SERVER_BACKLOG) != 0) {
+        fprintf(stderr, "Error listening on %s: %s\n", socketPath, strerror(errno));
+
+        if (listener >= 0) close(listener);
+
+        return -1;
+    }
+
+    fcntl(listener, F_SETFD, FD_CLOEXEC);
+
+    return listener;
+}
+
+bool runServer(const char *socketPath, int threads, RequestHandler handler, void *context) {
+    /*
+    Summary:
+        Serves requests on a Unix domain socket until SIGINT or SIGTERM. Clients send one request per line and get
+        one reply line per request, in order, and may keep a connection open for as many requests as they like. The
+        threads are started once: one acceptor watches the socket and every open connection, and the workers take
+        connections with a complete request off a queue, so a request never pays for process start-up, and every
+        worker keeps its warm working memory from one request to the next. Requests are answered by the handler,
+        except "stats", which returns the server's counters, queue depth and latency percentiles as JSON (see
+        formatServerStats()). The same line is printed to stderr when the server stops.
+
+    Args:
+        socketPath (const char*): The path to listen on; the socket file is removed on exit.
+        threads (int): The number of workers, so the number of requests answered at once.
+        handler (RequestHandler): Answers a request: it writes a reply line without a newline and returns false if
+            the request failed, which is counted. It runs on the worker threads, several at a time, and is told the
+            index of the thread (0 to threads) so it can keep per-thread state.
+        context (void*): Passed to the handler.
+
+    Return:
+        Returns true once the server has been stopped by a signal, false if it could not start (an error is printed
+        to stderr).
+
+    Note:
+        A client that sends a line longer than SERVER_LINE_MAX is answered with a failure and disconnected. Requests
+        still queued when the server stops are dropped; those being answered are finished first.
+    */
+
+    ServerState *server = (ServerState *)calloc(1, sizeof(ServerState));
+    WorkerPool *pool = NULL;
+    struct sigaction stop;
+    struct sigaction previousInterrupt;
+    struct sigaction previousTerminate;
+    bool ok = false;
+
+    if (!server) {
+        fprintf(stderr, "Memory allocation failed\n");
+        return false;
+    }
+
+    server->threads = threads < 1 ? 1 : threads;
+    server->handler = handler;
+    server->context = context;
+    server->listener = openListener(socketPath);
+    server->wake[0] = server->wake[1] = -1;
+
+    if (server->listener < 0) {
+        free(server);
+        return false;
+    }
+
+    if (pipe(server->wake) != 0) {
+        fprintf(stderr, "Error creating pipe: %s\n", strerror(errno));
+        goto cleanup;
+    }
+
+    for (int end = 0; end < 2; end++) {
+        fcntl(server->wake[end], F_SETFL, O_NONBLOCK);
+        fcntl(server->wake[end], F_SETFD, FD_CLOEXEC);
+    }
+
+    // One thread more than the workers, for the acceptor
+    pool = createWorkerPool(server->threads + 1);
+
+    if (!pool) {
+        fprintf(stderr, "Error creating thread pool\n");
+        goto cleanup;
+    }
+
+    pthread_mutex_init(&server->lock, NULL);
+    pthread_cond_init(&server->queued, NULL);
+    clock_gettime(CLOCK_MONOTONIC, &server->started);
+
+    memset(&stop, 0, sizeof(stop));
+    stop.sa_handler = handleStopSignal;
+    sigemptyset(&stop.sa_mask);
+    stopRequested = 0;
+    stopWake = server->wake[1];
+    sigaction(SIGINT, &stop, &previousInterrupt);
+    sigaction(SIGTERM, &stop, &previousTerminate);
+
+    fprintf(stderr, "Listening on %s with %d workers\n", socketPath, server->threads);
+    runParallel(pool, (size_t)server->threads + 1, serverThread, server);
+
+    sigaction(SIGINT, &previousInterrupt, NULL);
+    sigaction(SIGTERM, &previousTerminate, NULL);
+    stopWake = -1;
+
+    char stats[SERVER_LINE_MAX];
+
+    formatServerStats(server, stats, sizeof(stats));
+    fprintf(stderr, "%s\n", stats);
+
+    for (size_t index = 0; index < server->queueDepth; index++) {
+        Connection *connection = server->queue[(server->queueHead + index) % SERVER_MAX_CONNECTIONS];
+
+        close(connection->fd);
+        free(connection);
+    }
+
+    for (size_t index = 0; index < server->returnedCount; index++) {
+        close(server->returned[index]->fd);
+        free(server->returned[index]);
+    }
+
+    pthread_cond_destroy(&server->queued);
+    pthread_mutex_destroy(&server->lock);
+    ok = true;
+
+cleanup:
+    destroyWorkerPool(pool);
+
+    if (server->wake[0] >= 0) close(server->wake[0]);
+
+    if (server->wake[1] >= 0) close(server->wake[1]);
+
+    close(server->listener);
+    unlink(socketPath);
+    free(server);
+
+    return ok;
+}
@@ -0,0 +1,14 @@
+#ifndef SERVER_H
+#define SERVER_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+// Longest request line, including its newline, and longest reply
+#define SERVER_LINE_MAX 8192
+
+typedef bool (*RequestHandler)(void *context, char *request, int worker, char *reply, size_t replyCapacity);
+
+bool runServer(const char *socketPath, int threads, RequestHandler handler, void *context);
+
+#endif
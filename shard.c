@@ -0,0 +1,134 @@
+#include "shard.h"
+
+static void putBigEndian(unsigned char *bytes, uint64_t value, int width);
+static uint64_t getBigEndian(const unsigned char *bytes, int width);
+
+static void putBigEndian(unsigned char *bytes, uint64_t value, int width) {
+    /*
+    Summary:
+        Stores an integer in big-endian order, the byte order of every field in the stego header.
+
+    Args:
+        bytes (unsigned char*): The buffer that receives width bytes.
+        value (uint64_t): The value to store.
+        width (int): The number of bytes, 4 or 8.
+
+    Return:
+        This function does not return any value.
+    */
+
+    for (int index = 0; index < width; index++) bytes[index] = (unsigned char)(value >> (8 * (width - 1 - index)));
+}
+
+static uint64_t getBigEndian(const unsigned char *bytes, int width) {
+    /*
+    Summary:
+        Reads an integer stored by putBigEndian().
+
+    Args:
+        bytes (const unsigned char*): The width bytes to read.
+        width (int): The number of bytes, 4 or 8.
+
+    Return:
+        Returns the value.
+    */
+
+    uint64_t value = 0;
+
+    for (int index = 0; index < width; index++) value = (value << 8) | bytes[index];
+
+    return value;
+}
+
+void packStegoShard(const StegoShard *shard, unsigned char *bytes) {
+    /*
+    Summary:
+        Serialises a shard record into the SHARD_RECORD_BYTES that start the payload of every shard: the id of the
+        sharded payload, the shard's index and the number of shards, the length of the whole payload and the offset of
+        the shard's data in it, all big-endian. The record is embedded as part of the payload, so the header checksum
+        covers it.
+
+    Args:
+        shard (const StegoShard*): The record to serialise.
+        bytes (unsigned char*): The buffer that receives SHARD_RECORD_BYTES bytes.
+
+    Return:
+        This function does not return any value; it fills the buffer.
+    */
+
+    putBigEndian(bytes, shard->id, 8);
+    putBigEndian(bytes + 8, shard->index, 4);
+    putBigEndian(bytes + 12, shard->count, 4);
+    putBigEndian(bytes + 16, shard->totalLength, 8);
+    putBigEndian(bytes + 24, shard->offset, 8);
+}
+
+bool unpackStegoShard(const unsigned char *bytes, StegoShard *shard) {
+    /*
+    Summary:
+        Parses a shard record written by packStegoShard(), so a shard can be written to its place in the output as
+        soon as its record has been extracted.
+
+    Args:
+        bytes (const unsigned char*): The SHARD_RECORD_BYTES bytes to parse.
+        shard (StegoShard*): The record to fill in.
+
+    Return:
+        Returns true if the index is below the shard count and the offset inside the whole payload, false otherwise.
+        Whether the data that follows stays inside the payload is up to the caller to check as it arrives.
+    */
+
+    shard->id = getBigEndian(bytes, 8);
+    shard->index = (uint32_t)getBigEndian(bytes + 8, 4);
+    shard->count = (uint32_t)getBigEndian(bytes + 12, 4);
+    shard->totalLength = getBigEndian(bytes + 16, 8);
+    shard->offset = getBigEndian(bytes + 24, 8);
+
+    return shard->index < shard->count && shard->offset <= shard->totalLength;
+}
+
+bool planShards(const size_t *capacities, size_t count, uint64_t totalLength, uint64_t *lengths) {
+    /*
+    Summary:
+        Splits a payload over carriers in proportion to their capacities, so every shard fills the same share of its
+        carrier and shards embedded in parallel take about as long as each other. Whatever rounding leaves over goes
+        to the first carriers with room for it.
+
+    Args:
+        capacities (const size_t*): The payload bytes each carrier can hold once the shard record is taken off.
+        count (size_t): The number of carriers.
+        totalLength (uint64_t): The length of the payload.
+        lengths (uint64_t*): Receives the number of payload bytes for each carrier, in carrier order.
+
+    Return:
+        Returns true if the payload fits, false if it is larger than all the carriers together.
+    */
+
+    uint64_t totalCapacity = 0;
+
+    for (size_t index = 0; index < count; index++) totalCapacity += capacities[index];
+
+    if (totalLength > totalCapacity) return false;
+
+    uint64_t planned = 0;
+
+    for (size_t index = 0; index < count; index++) {
+        // totalLength <= totalCapacity, so the share never exceeds the carrier's capacity
+        lengths[index] = totalCapacity ? (uint64_t)((long double)totalLength * capacities[index] / totalCapacity) : 0;
+
+        if (lengths[index] > capacities[index]) lengths[index] = capacities[index];
+
+        planned += lengths[index];
+    }
+
+    for (size_t index = 0; index < count && planned < totalLength; index++) {
+        uint64_t extra = capacities[index] - lengths[index];
+
+        if (extra > totalLength - planned) extra = totalLength - planned;
+
+        lengths[index] += extra;
+        planned += extra;
+    }
+
+    return true;
+}
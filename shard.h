@@ -0,0 +1,23 @@
+#ifndef SHARD_H
+#define SHARD_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// Bytes of the record at the start of every shard's payload
+#define SHARD_RECORD_BYTES 32
+
+typedef struct {
+    uint64_t id;
+    uint32_t index;
+    uint32_t count;
+    uint64_t totalLength;
+    uint64_t offset;
+} StegoShard;
+
+void packStegoShard(const StegoShard *shard, unsigned char *bytes);
+bool unpackStegoShard(const unsigned char *bytes, StegoShard *shard);
+bool planShards(const size_t *capacities, size_t count, uint64_t totalLength, uint64_t *lengths);
+
+#endif
@@ -0,0 +1,149 @@
+#include <string.h>
+#include <time.h>
+
+#include "stats.h"
+
+_Thread_local StegoStats *attachedStats = NULL;
+
+static uint64_t monotonicNanoseconds(void);
+
+static uint64_t monotonicNanoseconds(void) {
+    /*
+    Summary:
+        Reads the monotonic clock, which never jumps when the wall clock is adjusted.
+
+    Args:
+        This function does not take any arguments.
+
+    Return:
+        Returns the current monotonic time in nanoseconds.
+    */
+
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+
+    return (uint64_t)now.tv_sec * 1000000000u + (uint64_t)now.tv_nsec;
+}
+
+void stegoStatsBegin(StegoStats *stats) {
+    /*
+    Summary:
+        Clears a set of statistics and starts recording into it on the calling thread. Every stage the thread runs
+        from now on, and every heap allocation its working memory needs (see workAlloc()), is added to it until
+        stegoStatsEnd() is called.
+
+    Args:
+        stats (StegoStats*): The statistics to record into.
+
+    Return:
+        This function does not return any value.
+
+    Note:
+        Recording is per thread, so images processed on different threads at the same time each get their own
+        statistics. Work that the library hands to a WorkerPool is timed by the thread that started it.
+    */
+
+    memset(stats, 0, sizeof(*stats));
+    stats->current = STEGO_STAGE_OTHER;
+    stats->started = monotonicNanoseconds();
+    attachedStats = stats;
+}
+
+void stegoStatsEnd(void) {
+    /*
+    Summary:
+        Stops recording on the calling thread and stores the total time since stegoStatsBegin().
+
+    Args:
+        This function does not take any arguments.
+
+    Return:
+        This function does not return any value; it does nothing if the thread is not recording.
+    */
+
+    if (!attachedStats) return;
+
+    attachedStats->totalNanoseconds = monotonicNanoseconds() - attachedStats->started;
+    attachedStats = NULL;
+}
+
+const char *stegoStageName(StegoStage stage) {
+    /*
+    Summary:
+        Names a stage, for reports.
+
+    Args:
+        stage (StegoStage): The stage to name.
+
+    Return:
+        Returns a static lowercase string, or "unknown" for a value outside the enumeration.
+    */
+
+    static const char *names[STEGO_STAGE_COUNT] = {"other", "payload", "load", "header", "embed", "extract", "write",
+                                                   "codec"};
+
+    return stage >= 0 && stage < STEGO_STAGE_COUNT ? names[stage] : "unknown";
+}
+
+void startStage(StageTimer *timer, StegoStage stage) {
+    /*
+    Summary:
+        The recording half of beginStage(): reads the clock and makes the stage the one allocations are charged to.
+        Stages may nest; the outer stage is restored by finishStage().
+
+    Args:
+        timer (StageTimer*): The timer to start, whose stats are already set.
+        stage (StegoStage): The stage being timed.
+
+    Return:
+        This function does not return any value.
+    */
+
+    timer->stage = stage;
+    timer->outer = timer->stats->current;
+    timer->stats->current = stage;
+    timer->started = monotonicNanoseconds();
+}
+
+void finishStage(StageTimer *timer, uint64_t bytes) {
+    /*
+    Summary:
+        The recording half of endStage(): adds the elapsed time, the bytes and one call to the stage.
+
+    Args:
+        timer (StageTimer*): The timer to stop.
+        bytes (uint64_t): The number of bytes the stage processed in this call.
+
+    Return:
+        This function does not return any value.
+    */
+
+    StegoStageStats *stage = &timer->stats->stages[timer->stage];
+
+    stage->nanoseconds += monotonicNanoseconds() - timer->started;
+    stage->bytes += bytes;
+    stage->calls++;
+    timer->stats->current = timer->outer;
+}
+
+void countAllocation(size_t size) {
+    /*
+    Summary:
+        Charges one heap allocation to the stage the calling thread is in, if it is recording. It is called by the
+        allocator of working memory (see workAlloc()) whenever it goes to malloc.
+
+    Args:
+        size (size_t): The number of bytes requested.
+
+    Return:
+        This function does not return any value.
+    */
+
+    StegoStats *stats = attachedStats;
+
+    if (!stats) return;
+
+    stats->stages[stats->current].allocations++;
+    stats->stages[stats->current].allocatedBytes += size;
+}
@@ -0,0 +1,104 @@
+#ifndef STATS_H
+#define STATS_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+typedef enum {
+    STEGO_STAGE_OTHER = 0,
+    STEGO_STAGE_PAYLOAD,
+    STEGO_STAGE_LOAD,
+    STEGO_STAGE_HEADER,
+    STEGO_STAGE_EMBED,
+    STEGO_STAGE_EXTRACT,
+    STEGO_STAGE_WRITE,
+    STEGO_STAGE_CODEC,
+    STEGO_STAGE_COUNT
+} StegoStage;
+
+typedef struct {
+    uint64_t nanoseconds;
+    uint64_t bytes;
+    uint64_t calls;
+    uint64_t allocations;
+    uint64_t allocatedBytes;
+} StegoStageStats;
+
+typedef struct {
+    StegoStageStats stages[STEGO_STAGE_COUNT];
+    StegoStage current;
+    uint64_t started;
+    uint64_t totalNanoseconds;
+} StegoStats;
+
+typedef struct {
+    StegoStats *stats;
+    StegoStage stage;
+    StegoStage outer;
+    uint64_t started;
+} StageTimer;
+
+// The statistics the calling thread is recording into, or NULL when recording is off
+extern _Thread_local StegoStats *attachedStats;
+
+void stegoStatsBegin(StegoStats *stats);
+void stegoStatsEnd(void);
+const char *stegoStageName(StegoStage stage);
+void startStage(StageTimer *timer, StegoStage stage);
+void finishStage(StageTimer *timer, uint64_t bytes);
+void countAllocation(size_t size);
+
+static inline void beginStage(StageTimer *timer, StegoStage stage) {
+    /*
+    Summary:
+        Starts timing a stage on the calling thread if it is recording statistics. When it is not, this is a single
+        load and branch, and no clock is read, so the stages can stay instrumented in production builds.
+
+    Args:
+        timer (StageTimer*): The timer to start; it lives on the caller's stack until endStage().
+        stage (StegoStage): The stage being timed.
+
+    Return:
+        This function does not return any value.
+    */
+
+    timer->stats = attachedStats;
+
+    if (timer->stats) startStage(timer, stage);
+}
+
+static inline void endStage(StageTimer *timer, uint64_t bytes) {
+    /*
+    Summary:
+        Stops a timer started by beginStage() and adds its duration and the bytes it processed to the stage.
+
+    Args:
+        timer (StageTimer*): The timer to stop.
+        bytes (uint64_t): The number of bytes the stage processed in this call.
+
+    Return:
+        This function does not return any value.
+    */
+
+    if (timer->stats) finishStage(timer, bytes);
+}
+
+static inline void countStageBytes(StegoStage stage, uint64_t bytes) {
+    /*
+    Summary:
+        Adds bytes to a stage without timing anything, for stages that run in many small steps whose byte count is
+        only known as a whole, such as embedding one streamed row at a time.
+
+    Args:
+        stage (StegoStage): The stage the bytes belong to.
+        bytes (uint64_t): The number of bytes to add.
+
+    Return:
+        This function does not return any value; it does nothing if the thread is not recording.
+    */
+
+    if (attachedStats) attachedStats->stages[stage].bytes += bytes;
+}
+
+#endif
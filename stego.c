@@ -0,0 +1,1332 @@
+#include <pthread.h>
+#include <string.h>
+#include <zlib.h>
+
+#include "carrier.h"
+#include "crc32c.h"
+#include "lsb.h"
+#include "scatter.h"
+#include "stats.h"
+#include "stego.h"
+#include "stego_internal.h"
+
+#define BIT_CHUNK 4096
+// A multiple of 56 carrier bytes, so every chunk starts on both a packed byte and a 7-bit character boundary
+#define CARRIER_CHUNK (56 * 4096)
+// Carrier bytes gathered per step for layouts that are not contiguous and for scattered payloads; a multiple of 8, so
+// every step ends on a byte
+#define CARRIER_WINDOW 8192
+// Chunks extracted per pass over the pool; their checksums are joined in payload order after each pass
+#define CHECKSUM_BATCH 64
+
+#define STEGO_MAGIC "STEG"
+
+// Guards the one-time kernel selection of stegoInit()
+static pthread_once_t kernelsOnce = PTHREAD_ONCE_INIT;
+
+typedef struct {
+    const unsigned char *bytes;
+    size_t length;
+    size_t symbol;
+    int symbolBits;
+    uint64_t accumulator;
+    int accumulatedBits;
+} BitReader;
+
+typedef struct {
+    unsigned char *bytes;
+    size_t length;
+    size_t capacity;
+    int symbolBits;
+    uint64_t accumulator;
+    int accumulatedBits;
+} BitWriter;
+
+typedef struct {
+    StegoImage *image;
+    const ScatterMap *scatter;
+    const unsigned char *message;
+    size_t length;
+    int symbolBits;
+    int bitsPerChannel;
+    size_t totalBits;
+} EmbedJob;
+
+typedef struct {
+    const StegoImage *image;
+    const ScatterMap *scatter;
+    size_t firstCarrier;
+    unsigned char *output;
+    int symbolBits;
+    int bitsPerChannel;
+    size_t totalBits;
+    int version;
+    size_t firstChunk;
+    uint32_t *checksums;
+} ExtractJob;
+
+static void initBitReader(BitReader *reader, const unsigned char *bytes, size_t length, int symbolBits);
+static void readBits(BitReader *reader, unsigned char *packed, size_t count);
+static void seekBitReader(BitReader *reader, size_t bitOffset);
+static void initBitWriter(BitWriter *writer, unsigned char *bytes, size_t capacity, int symbolBits);
+static void writeBits(BitWriter *writer, const unsigned char *packed, size_t count);
+static bool unpackStegoHeader(const unsigned char *bytes, StegoHeader *header);
+static void embedStream(unsigned char *carrier, BitReader *reader, size_t bitCount, int bitsPerChannel);
+static void gatherPermuted(const StegoImage *image, const ScatterMap *scatter, size_t firstSlot, size_t count,
+                           unsigned char *window);
+static void scatterPermuted(StegoImage *image, const ScatterMap *scatter, size_t firstSlot, size_t count,
+                            const unsigned char *window);
+static void embedImageStream(StegoImage *image, const ScatterMap *scatter, size_t firstCarrier, BitReader *reader,
+                             size_t bitCount, int bitsPerChannel);
+static void extractImageStream(const StegoImage *image, const ScatterMap *scatter, size_t firstCarrier, BitWriter *writer,
+                               size_t bitCount, int bitsPerChannel, int version, uint32_t *checksum);
+static uint32_t versionChecksum(int version, uint32_t checksum, const unsigned char *bytes, size_t length);
+static uint32_t joinChecksums(int version, uint32_t first, uint32_t second, size_t secondLength, uint32_t shift);
+static size_t packedChunkBits(int bitsPerChannel);
+static bool initHeaderScatter(const StegoImage *image, const StegoHeader *header, ScatterMap *scatter);
+static void initKernels(void);
+
+void initStegoOptions(StegoOptions *options) {
+    /*
+    Summary:
+        Fills in the default embedding options: one bit per channel byte, which changes the image the least, and the
+        payload stored in order right after the header. Setting scatter and a key instead spreads the payload over
+        the whole image with a keyed permutation of blocks of 2^scatterBlockBits carrier bytes. Setting codec records
+        in the header that the message was compressed with compressPayload() at codecLevel before being embedded, and
+        setting shard that it is one shard of a larger payload, starting with its shard record.
+
+    Args:
+        options (StegoOptions*): The options to initialise.
+
+    Return:
+        This function does not return any value; it fills in the options.
+    */
+
+    options->bitsPerChannel = 1;
+    options->scatter = false;
+    options->key = 0;
+    options->scatterBlockBits = STEGO_DEFAULT_SCATTER_BLOCK_BITS;
+    options->codec = STEGO_CODEC_NONE;
+    options->codecLevel = STEGO_DEFAULT_CODEC_LEVEL;
+    options->shard = false;
+}
+
+void stegoInit(void) {
+    /*
+    Summary:
+        Picks the CPU-specific kernels and builds their tables, once per process however many threads call it. Every
+        stego*() function that touches pixels or checksums calls it first, so library users never need to; programs
+        that use the lower-level functions of stego_internal.h directly call it at startup.
+
+    Args:
+        None.
+
+    Return:
+        This function does not return any value.
+    */
+
+    pthread_once(&kernelsOnce, initKernels);
+}
+
+static void initKernels(void) {
+    /*
+    Summary:
+        The body of stegoInit(), run exactly once: selects the LSB, carrier gather/scatter and CRC-32C kernels.
+
+    Args:
+        None.
+
+    Return:
+        This function does not return any value.
+    */
+
+    initLsbKernels();
+    initCarrierKernels();
+    initCrc32c();
+}
+
+StegoStatus stegoEmbed(StegoImage *image, const unsigned char *message, size_t length, const StegoOptions *options,
+                       WorkerPool *pool) {
+    /*
+    Summary:
+        Hides a message in an image that is already in memory: the header is built from the message and embedded
+        together with it, in place, by embedMessage(). No file I/O happens and no memory is allocated, so it can be
+        called directly on a buffer owned by the caller.
+
+    Args:
+        image (StegoImage*): The image to embed into; its pixels are modified in place.
+        message (const unsigned char*): The message to hide. It may contain any bytes. If options->codec is set, it is
+            the message already compressed with compressPayload(); it is embedded as given.
+        length (size_t): The number of bytes in the message.
+        options (const StegoOptions*): How to embed, or NULL for the defaults of initStegoOptions().
+        pool (WorkerPool*): The pool to run on, or NULL to run on the calling thread.
+
+    Return:
+        Returns STEGO_OK on success, STEGO_ERROR_TOO_LARGE if the message does not fit in the image (the image is then
+        left untouched), or STEGO_ERROR_INVALID_ARGUMENT if image or message is NULL, the pixel layout is not supported
+        or an option is out of range.
+
+    Note:
+        If the calling thread is recording statistics (see stegoStatsBegin()), the header and embed stages are added
+        to them.
+    */
+
+    StegoOptions defaults;
+
+    stegoInit();
+
+    if (!options) {
+        initStegoOptions(&defaults);
+        options = &defaults;
+    }
+
+    if (!image || !image->pixels || !carrierLayoutValid(image) || (!message && length > 0)) return STEGO_ERROR_INVALID_ARGUMENT;
+
+    if (options->bitsPerChannel < 1 || options->bitsPerChannel > 4) return STEGO_ERROR_INVALID_ARGUMENT;
+
+    if (options->scatter && (options->scatterBlockBits < 0 || options->scatterBlockBits > STEGO_MAX_SCATTER_BLOCK_BITS)) {
+        return STEGO_ERROR_INVALID_ARGUMENT;
+    }
+
+    if (options->codec < STEGO_CODEC_NONE || options->codec >= STEGO_CODEC_COUNT) return STEGO_ERROR_INVALID_ARGUMENT;
+
+    StegoHeader header;
+    StageTimer timer;
+
+    beginStage(&timer, STEGO_STAGE_HEADER);
+    initStegoHeader(&header, message, length, options);
+    endStage(&timer, length);
+
+    if (length > payloadCapacity(&header, carrierCount(image))) return STEGO_ERROR_TOO_LARGE;
+
+    beginStage(&timer, STEGO_STAGE_EMBED);
+    embedMessage(image, &header, message, pool);
+    endStage(&timer, length);
+
+    return STEGO_OK;
+}
+
+StegoStatus stegoExtract(const StegoImage *image, unsigned char *output, size_t capacity, size_t *length,
+                         const StegoOptions *options, WorkerPool *pool) {
+    /*
+    Summary:
+        Recovers a message hidden by stegoEmbed() into a buffer owned by the caller, and verifies its checksum. No file
+        I/O happens and no memory is allocated.
+
+    Args:
+        image (const StegoImage*): The image to extract from.
+        output (unsigned char*): The buffer that receives the message.
+        capacity (size_t): The size of the output buffer.
+        length (size_t*): Receives the length of the message whenever the image holds one, including when the buffer
+            is too small, so a call with a capacity of 0 can be used to size the buffer.
+        options (const StegoOptions*): The key of a scattered message, or NULL if none is known. Everything else is
+            read from the header. A compressed message is returned compressed, with its length; stegoReadHeader()
+            gives its codec, and decodePayload() decompresses it.
+        pool (WorkerPool*): The pool to run on, or NULL to run on the calling thread.
+
+    Return:
+        Returns STEGO_OK on success, STEGO_ERROR_NO_MESSAGE if the image holds no message, STEGO_ERROR_KEY_REQUIRED if
+        it is scattered and no key was given, STEGO_ERROR_BUFFER_TOO_SMALL if the message is longer than capacity,
+        STEGO_ERROR_CHECKSUM if the extracted message is damaged (which is also what a wrong key gives), or
+        STEGO_ERROR_INVALID_ARGUMENT if a pointer argument is NULL.
+
+    Note:
+        If the calling thread is recording statistics, the header and extract stages are added to them; the checksum
+        is computed as part of the extraction.
+    */
+
+    StegoHeader header;
+
+    stegoInit();
+
+    if (!length || (!output && capacity > 0)) return STEGO_ERROR_INVALID_ARGUMENT;
+
+    StegoStatus status = stegoReadHeader(image, &header);
+
+    if (status == STEGO_OK) status = stegoUseKey(&header, options);
+
+    if (status != STEGO_OK) return status;
+
+    *length = header.payloadLength;
+
+    if (header.payloadLength > capacity) return STEGO_ERROR_BUFFER_TOO_SMALL;
+
+    StageTimer timer;
+
+    beginStage(&timer, STEGO_STAGE_EXTRACT);
+    uint32_t checksum = extractMessage(image, &header, output, pool);
+    endStage(&timer, header.payloadLength);
+
+    return checksum == header.checksum ? STEGO_OK : STEGO_ERROR_CHECKSUM;
+}
+
+StegoStatus stegoCapacity(const StegoImage *image, const StegoOptions *options, int symbolBits, size_t *capacity) {
+    /*
+    Summary:
+        Reports how many payload bytes an image can hold, without looking at its pixels: only the dimensions, channel
+        count and bit depth are used, so the image may come straight from a file header with pixels left NULL. This
+        lets callers reject a payload before decoding, or even allocating, the image.
+
+    Args:
+        image (const StegoImage*): The image layout to plan for; pixels is not read.
+        options (const StegoOptions*): How the payload would be embedded, or NULL for the defaults of initStegoOptions().
+        symbolBits (int): 7 for a pure ASCII payload or 8 for anything else, as returned by stegoSymbolBits().
+        capacity (size_t*): Receives the largest payload length that fits.
+
+    Return:
+        Returns STEGO_OK on success, or STEGO_ERROR_INVALID_ARGUMENT if a pointer is NULL, the pixel layout is not
+        supported or an option is out of range.
+    */
+
+    StegoOptions defaults;
+    StegoHeader header;
+
+    stegoInit();
+
+    if (!options) {
+        initStegoOptions(&defaults);
+        options = &defaults;
+    }
+
+    if (!image || !capacity || !carrierLayoutValid(image)) return STEGO_ERROR_INVALID_ARGUMENT;
+
+    if (options->bitsPerChannel < 1 || options->bitsPerChannel > 4 || (symbolBits != 7 && symbolBits != 8)) {
+        return STEGO_ERROR_INVALID_ARGUMENT;
+    }
+
+    if (options->scatter && (options->scatterBlockBits < 0 || options->scatterBlockBits > STEGO_MAX_SCATTER_BLOCK_BITS)) {
+        return STEGO_ERROR_INVALID_ARGUMENT;
+    }
+
+    if (options->codec < STEGO_CODEC_NONE || options->codec >= STEGO_CODEC_COUNT) return STEGO_ERROR_INVALID_ARGUMENT;
+
+    initStegoHeader(&header, NULL, 0, options);
+    header.symbolBits = symbolBits;
+    *capacity = payloadCapacity(&header, carrierCount(image));
+
+    return STEGO_OK;
+}
+
+const char *stegoStatusString(StegoStatus status) {
+    /*
+    Summary:
+        Describes a status code in words, for error messages.
+
+    Args:
+        status (StegoStatus): The status to describe.
+
+    Return:
+        Returns a static string; it must not be freed.
+    */
+
+    switch (status) {
+        case STEGO_OK: return "Success";
+        case STEGO_ERROR_INVALID_ARGUMENT: return "Invalid argument";
+        case STEGO_ERROR_TOO_LARGE: return "Message is too large for this image";
+        case STEGO_ERROR_NO_MESSAGE: return "No hidden message found";
+        case STEGO_ERROR_BUFFER_TOO_SMALL: return "Output buffer is too small for the hidden message";
+        case STEGO_ERROR_CHECKSUM: return "Checksum mismatch: the hidden message is damaged";
+        case STEGO_ERROR_KEY_REQUIRED: return "The hidden message is scattered; a key is needed to extract it";
+    }
+
+    return "Unknown error";
+}
+
+uint64_t stegoKeyFromPassphrase(const char *passphrase) {
+    /*
+    Summary:
+        Turns a passphrase into the 64-bit key of StegoOptions, with FNV-1a followed by a bit mixer so that similar
+        passphrases give unrelated keys.
+
+    Args:
+        passphrase (const char*): The passphrase, NUL-terminated.
+
+    Return:
+        Returns the key.
+
+    Note:
+        The key only decides where the payload goes; it does not encrypt it, and 64 bits derived without a slow hash
+        will not stop a determined search. Encrypt the payload first if its content matters.
+    */
+
+    uint64_t hash = 0xCBF29CE484222325u;
+
+    for (const unsigned char *c = (const unsigned char *)passphrase; *c; c++) hash = (hash ^ *c) * 0x100000001B3u;
+
+    return mixKey(hash);
+}
+
+StegoStatus stegoUseKey(StegoHeader *header, const StegoOptions *options) {
+    /*
+    Summary:
+        Hands the key from the options to a header read with stegoReadHeader(), so the payload can be extracted with
+        extractMessage() or extractRange(). Headers of messages stored in order need no key and are left as they are.
+
+    Args:
+        header (StegoHeader*): The header read from the image.
+        options (const StegoOptions*): The options holding the key, or NULL if none is known.
+
+    Return:
+        Returns STEGO_OK if the payload can be extracted, or STEGO_ERROR_KEY_REQUIRED if it is scattered and the
+        options hold no key.
+    */
+
+    if (!(header->flags & STEGO_FLAG_SCATTER)) return STEGO_OK;
+
+    if (!options || !options->scatter) return STEGO_ERROR_KEY_REQUIRED;
+
+    header->key = options->key;
+
+    return STEGO_OK;
+}
+
+static void initBitReader(BitReader *reader, const unsigned char *bytes, size_t length, int symbolBits) {
+    /*
+    Summary:
+        Prepares a bit reader that streams the bits of a byte buffer most significant bit first. Only the low symbolBits
+        bits of every byte are produced: 7 for ASCII text, which packs it densely, or 8 for arbitrary binary data. Once
+        the buffer is exhausted the reader produces 0 bits.
+
+    Args:
+        reader (BitReader*): The reader to initialise.
+        bytes (const unsigned char*): The buffer to read from. It is not copied and must outlive the reader.
+        length (size_t): The number of bytes in the buffer.
+        symbolBits (int): The number of bits read from each byte, between 1 and 8.
+
+    Return:
+        This function does not return any value; it initialises the reader in place.
+    */
+
+    reader->bytes = bytes;
+    reader->length = length;
+    reader->symbol = 0;
+    reader->symbolBits = symbolBits;
+    reader->accumulator = 0;
+    reader->accumulatedBits = 0;
+}
+
+static void readBits(BitReader *reader, unsigned char *packed, size_t count) {
+    /*
+    Summary:
+        Packs the next 8 * count bits of the stream into count bytes, most significant bit first, ready for
+        embedBits(). Symbols are shifted through a 64-bit accumulator, so no memory is allocated and the cost per bit
+        does not depend on how long the message is.
+
+    Args:
+        reader (BitReader*): The reader to advance.
+        packed (unsigned char*): The buffer that receives count bytes of the stream.
+        count (size_t): The number of bytes to produce.
+
+    Return:
+        This function does not return any value; it fills the packed buffer. Bits past the end of the message are 0.
+    */
+
+    unsigned char mask = (unsigned char)((1 << reader->symbolBits) - 1);
+
+    if (reader->symbolBits == 8 && reader->accumulatedBits == 0) {
+        size_t available = reader->symbol < reader->length ? reader->length - reader->symbol : 0;
+        size_t copied = available < count ? available : count;
+
+        memcpy(packed, reader->bytes + reader->symbol, copied);
+        memset(packed + copied, 0, count - copied);
+        reader->symbol += count;
+
+        return;
+    }
+
+    for (size_t byte = 0; byte < count; byte++) {
+        while (reader->accumulatedBits < 8) {
+            unsigned char symbol = reader->symbol < reader->length ? reader->bytes[reader->symbol] & mask : 0;
+
+            reader->accumulator = (reader->accumulator << reader->symbolBits) | symbol;
+            reader->accumulatedBits += reader->symbolBits;
+            reader->symbol++;
+        }
+
+        reader->accumulatedBits -= 8;
+        packed[byte] = (unsigned char)(reader->accumulator >> reader->accumulatedBits);
+    }
+}
+
+static void seekBitReader(BitReader *reader, size_t bitOffset) {
+    /*
+    Summary:
+        Moves the reader to an arbitrary bit of the stream. Because bit i of the stream always comes from the same place
+        in the message, every thread can seek its own reader to the start of its chunk and read independently.
+
+    Args:
+        reader (BitReader*): The reader to move.
+        bitOffset (size_t): The bit of the stream the next readBits() call should start at.
+
+    Return:
+        This function does not return any value; it repositions the reader in place.
+    */
+
+    size_t skip = bitOffset % reader->symbolBits;
+
+    reader->symbol = bitOffset / reader->symbolBits;
+    reader->accumulator = 0;
+    reader->accumulatedBits = 0;
+
+    if (skip) {
+        unsigned char symbol = reader->symbol < reader->length ? reader->bytes[reader->symbol] : 0;
+
+        reader->accumulator = symbol & ((1u << (reader->symbolBits - skip)) - 1);
+        reader->accumulatedBits = reader->symbolBits - (int)skip;
+        reader->symbol++;
+    }
+}
+
+static void initBitWriter(BitWriter *writer, unsigned char *bytes, size_t capacity, int symbolBits) {
+    /*
+    Summary:
+        Prepares a bit writer that unpacks incoming bits, most significant bit first, into symbols of symbolBits bits and
+        stores each completed symbol as one byte of the output buffer. This is the inverse of the BitReader.
+
+    Args:
+        writer (BitWriter*): The writer to initialise.
+        bytes (unsigned char*): The output buffer.
+        capacity (size_t): The number of symbols to store; bits arriving after that are ignored.
+        symbolBits (int): The number of bits that make up one symbol, between 1 and 8.
+
+    Return:
+        This function does not return any value; it initialises the writer in place.
+    */
+
+    writer->bytes = bytes;
+    writer->length = 0;
+    writer->capacity = capacity;
+    writer->symbolBits = symbolBits;
+    writer->accumulator = 0;
+    writer->accumulatedBits = 0;
+}
+
+static void writeBits(BitWriter *writer, const unsigned char *packed, size_t count) {
+    /*
+    Summary:
+        Appends count bytes of packed bits, as produced by extractBits(), to the writer. Every completed symbol is stored
+        in the output buffer and the writer's length grows by one, until the capacity is reached.
+
+    Args:
+        writer (BitWriter*): The writer to append to.
+        packed (const unsigned char*): The packed bits to append.
+        count (size_t): The number of bytes of packed bits.
+
+    Return:
+        This function does not return any value; it fills the output buffer.
+    */
+
+    unsigned char mask = (unsigned char)((1 << writer->symbolBits) - 1);
+
+    if (writer->symbolBits == 8 && writer->accumulatedBits == 0) {
+        size_t copied = writer->capacity - writer->length < count ? writer->capacity - writer->length : count;
+
+        memcpy(writer->bytes + writer->length, packed, copied);
+        writer->length += copied;
+
+        return;
+    }
+
+    for (size_t byte = 0; byte < count && writer->length < writer->capacity; byte++) {
+        writer->accumulator = (writer->accumulator << 8) | packed[byte];
+        writer->accumulatedBits += 8;
+
+        while (writer->accumulatedBits >= writer->symbolBits && writer->length < writer->capacity) {
+            writer->accumulatedBits -= writer->symbolBits;
+            writer->bytes[writer->length++] = (unsigned char)(writer->accumulator >> writer->accumulatedBits) & mask;
+        }
+    }
+}
+
+uint32_t payloadChecksum(uint32_t checksum, const unsigned char *bytes, size_t length) {
+    /*
+    Summary:
+        Computes the CRC-32C of the payload, which is stored in the stego header and checked during extraction. The
+        checksum can be built up piece by piece, so a payload that is streamed in chunks never has to be in memory as a
+        whole.
+
+    Args:
+        checksum (uint32_t): The checksum of the preceding part of the payload, or 0 to start a new one.
+        bytes (const unsigned char*): The next part of the payload.
+        length (size_t): The number of bytes in that part.
+
+    Return:
+        Returns the CRC-32C of the payload so far.
+    */
+
+    return crc32c(checksum, bytes, length);
+}
+
+static uint32_t versionChecksum(int version, uint32_t checksum, const unsigned char *bytes, size_t length) {
+    /*
+    Summary:
+        Extends the checksum of a payload the way its header version defines it: the CRC-32C of payloadChecksum(), or
+        for version 1 headers the zlib CRC-32 they were written with.
+
+    Args:
+        version (int): The header version.
+        checksum (uint32_t): The checksum of the preceding part of the payload, or 0 to start a new one.
+        bytes (const unsigned char*): The next part of the payload.
+        length (size_t): The number of bytes in that part.
+
+    Return:
+        Returns the checksum of the payload so far.
+    */
+
+    if (version != 1) return payloadChecksum(checksum, bytes, length);
+
+    uLong crc = checksum;
+
+    while (length > 0) {
+        uInt block = length > 0x40000000 ? 0x40000000 : (uInt)length;
+
+        crc = crc32(crc, bytes, block);
+        bytes += block;
+        length -= block;
+    }
+
+    return (uint32_t)crc;
+}
+
+static uint32_t joinChecksums(int version, uint32_t first, uint32_t second, size_t secondLength, uint32_t shift) {
+    /*
+    Summary:
+        Joins the checksums of two consecutive parts of a payload into the checksum of both, so parts extracted on
+        different threads can be checked without another pass over their bytes.
+
+    Args:
+        version (int): The header version, which picks the checksum as in versionChecksum().
+        first (uint32_t): The checksum of the first part.
+        second (uint32_t): The checksum of the second part, started from 0.
+        secondLength (size_t): The number of bytes in the second part.
+        shift (uint32_t): crc32cShift(secondLength), computed once by the caller for parts of the same length; unused
+            for version 1.
+
+    Return:
+        Returns the checksum of the two parts together.
+    */
+
+    if (version == 1) return (uint32_t)crc32_combine(first, second, (z_off_t)secondLength);
+
+    return crc32cCombine(shift, first, second);
+}
+
+void initStegoHeader(StegoHeader *header, const unsigned char *message, size_t length, const StegoOptions *options) {
+    /*
+    Summary:
+        Fills in the header for a message. Messages that are pure 7-bit ASCII are stored with 7 bits per character,
+        everything else with 8 bits per byte so that binary payloads survive unchanged.
+
+    Args:
+        header (StegoHeader*): The header to fill in.
+        message (const unsigned char*): The message that will be embedded.
+        length (size_t): The number of bytes in the message.
+        options (const StegoOptions*): The bits per carrier byte and scatter settings, already validated, or NULL for
+            the defaults of initStegoOptions().
+
+    Return:
+        This function does not return any value; it fills in the header. The key is kept in the header for
+        embedMessage(), but it is never written to the image.
+    */
+
+    StegoOptions defaults;
+
+    if (!options) {
+        initStegoOptions(&defaults);
+        options = &defaults;
+    }
+
+    header->version = STEGO_VERSION;
+    header->bitsPerChannel = options->bitsPerChannel;
+    header->symbolBits = stegoSymbolBits(message, length);
+    header->flags = options->scatter ? STEGO_FLAG_SCATTER | options->scatterBlockBits << STEGO_FLAG_BLOCK_SHIFT : 0;
+    header->flags |= options->codec << STEGO_FLAG_CODEC_SHIFT | (options->shard ? STEGO_FLAG_SHARD : 0);
+    header->payloadLength = length;
+    header->checksum = payloadChecksum(0, message, length);
+    header->key = options->scatter ? options->key : 0;
+}
+
+int stegoSymbolBits(const unsigned char *message, size_t length) {
+    /*
+    Summary:
+        Works out how many bits each byte of a message takes once embedded: 7 if it is pure 7-bit ASCII, 8 otherwise.
+
+    Args:
+        message (const unsigned char*): The message.
+        length (size_t): The number of bytes in the message.
+
+    Return:
+        Returns 7 or 8.
+    */
+
+    for (size_t index = 0; index < length; index++) {
+        if (message[index] & 0x80) return 8;
+    }
+
+    return 7;
+}
+
+size_t payloadCapacity(const StegoHeader *header, size_t carrierBytes) {
+    /*
+    Summary:
+        Works out how many payload bytes fit in a carrier, given the symbol width, bits per channel and flags of a
+        header. The header itself always takes the first HEADER_BITS carrier bytes at one bit each; a scattered
+        payload cannot use a partial block at the end.
+
+    Args:
+        header (const StegoHeader*): The header whose symbolBits and bitsPerChannel apply.
+        carrierBytes (size_t): The number of carrier bytes in the image.
+
+    Return:
+        Returns the largest payload length that fits.
+    */
+
+    if (carrierBytes < HEADER_BITS) return 0;
+
+    size_t slots = carrierBytes - HEADER_BITS;
+
+    if (header->flags & STEGO_FLAG_SCATTER) {
+        int blockBits = (header->flags & STEGO_FLAG_BLOCK_MASK) >> STEGO_FLAG_BLOCK_SHIFT;
+
+        slots = slots >> blockBits << blockBits;
+    }
+
+    return slots * header->bitsPerChannel / header->symbolBits;
+}
+
+size_t messageCarriers(const StegoHeader *header, size_t carrierBytes) {
+    /*
+    Summary:
+        Counts the carrier bytes, from the start of the image, that hold the header and payload of a message, which is
+        how much of an image has to be decoded before the message can be extracted.
+
+    Args:
+        header (const StegoHeader*): The header of the message, as read by stegoReadHeader().
+        carrierBytes (size_t): The number of carrier bytes in the image.
+
+    Return:
+        Returns the number of carrier bytes, at most carrierBytes; a scattered payload may use any of them, so all of
+        them are needed.
+    */
+
+    if (header->flags & STEGO_FLAG_SCATTER) return carrierBytes;
+
+    uint64_t bits = header->payloadLength * header->symbolBits;
+    size_t carriers = HEADER_BITS + (size_t)((bits + header->bitsPerChannel - 1) / header->bitsPerChannel);
+
+    return carriers < carrierBytes ? carriers : carrierBytes;
+}
+
+void packStegoHeader(const StegoHeader *header, unsigned char *bytes) {
+    /*
+    Summary:
+        Serialises a header into its HEADER_BYTES on-image form: the 4-byte magic "STEG", then one byte each for the
+        version, bits per channel, bits per symbol and flags (scattering in the low five bits, then the payload codec
+        and whether the payload is a shard), then the payload length as a big-endian 64-bit integer and the payload
+        CRC-32C as a big-endian 32-bit integer. The length and checksum are those of the payload as embedded, compressed
+        if it was.
+
+    Args:
+        header (const StegoHeader*): The header to serialise.
+        bytes (unsigned char*): The buffer that receives HEADER_BYTES bytes.
+
+    Return:
+        This function does not return any value; it fills the buffer.
+    */
+
+    memcpy(bytes, STEGO_MAGIC, 4);
+    bytes[4] = (unsigned char)header->version;
+    bytes[5] = (unsigned char)header->bitsPerChannel;
+    bytes[6] = (unsigned char)header->symbolBits;
+    bytes[7] = (unsigned char)header->flags;
+
+    for (int index = 0; index < 8; index++) bytes[8 + index] = (unsigned char)(header->payloadLength >> (56 - 8 * index));
+
+    for (int index = 0; index < 4; index++) bytes[16 + index] = (unsigned char)(header->checksum >> (24 - 8 * index));
+}
+
+static bool unpackStegoHeader(const unsigned char *bytes, StegoHeader *header) {
+    /*
+    Summary:
+        Parses the on-image form of a header written by packStegoHeader() and checks that it describes something this
+        version can decode.
+
+    Args:
+        bytes (const unsigned char*): The HEADER_BYTES bytes to parse.
+        header (StegoHeader*): The header to fill in.
+
+    Return:
+        Returns true if the magic, version and fields are valid, false otherwise.
+    */
+
+    if (memcmp(bytes, STEGO_MAGIC, 4) != 0) return false;
+
+    header->version = bytes[4];
+    header->bitsPerChannel = bytes[5];
+    header->symbolBits = bytes[6];
+    header->flags = bytes[7];
+    header->payloadLength = 0;
+    header->checksum = 0;
+    header->key = 0;
+
+    for (int index = 0; index < 8; index++) header->payloadLength = (header->payloadLength << 8) | bytes[8 + index];
+
+    for (int index = 0; index < 4; index++) header->checksum = (header->checksum << 8) | bytes[16 + index];
+
+    int codec = (header->flags & STEGO_FLAG_CODEC_MASK) >> STEGO_FLAG_CODEC_SHIFT;
+    int flags = header->flags & ~STEGO_FLAG_SCATTER & ~STEGO_FLAG_CODEC_MASK & ~STEGO_FLAG_SHARD;
+    bool flagsValid = flags == 0 && codec < STEGO_CODEC_COUNT;
+
+    if (header->flags & STEGO_FLAG_SCATTER) {
+        int blockBits = flags >> STEGO_FLAG_BLOCK_SHIFT;
+
+        flagsValid = (flags & ~STEGO_FLAG_BLOCK_MASK) == 0 && blockBits <= STEGO_MAX_SCATTER_BLOCK_BITS &&
+                     codec < STEGO_CODEC_COUNT;
+    }
+
+    return header->version >= STEGO_OLDEST_VERSION && header->version <= STEGO_VERSION && header->bitsPerChannel >= 1 &&
+           header->bitsPerChannel <= 4 && (header->symbolBits == 7 || header->symbolBits == 8) && flagsValid;
+}
+
+StegoStatus stegoReadHeader(const StegoImage *image, StegoHeader *header) {
+    /*
+    Summary:
+        Extracts the header from the first HEADER_BITS carrier bytes of an image and checks that the payload it
+        describes fits in the image. Only those bytes are looked at, so images without a hidden message are rejected
+        without scanning the rest of the image.
+
+    Args:
+        image (const StegoImage*): The image to read from.
+        header (StegoHeader*): The header to fill in.
+
+    Return:
+        Returns STEGO_OK if the image holds a valid header whose payload fits in the image, STEGO_ERROR_NO_MESSAGE if
+        it does not, or STEGO_ERROR_INVALID_ARGUMENT if image or header is NULL or the pixel layout is not supported.
+    */
+
+    stegoInit();
+
+    if (!image || !image->pixels || !header || !carrierLayoutValid(image)) return STEGO_ERROR_INVALID_ARGUMENT;
+
+    size_t carrierBytes = carrierCount(image);
+    unsigned char bytes[HEADER_BYTES];
+    BitWriter writer;
+    StageTimer timer;
+
+    if (carrierBytes < HEADER_BITS) return STEGO_ERROR_NO_MESSAGE;
+
+    beginStage(&timer, STEGO_STAGE_HEADER);
+    initBitWriter(&writer, bytes, HEADER_BYTES, 8);
+    extractImageStream(image, NULL, 0, &writer, HEADER_BITS, 1, 0, NULL);
+    endStage(&timer, HEADER_BYTES);
+
+    if (!unpackStegoHeader(bytes, header)) return STEGO_ERROR_NO_MESSAGE;
+
+    return header->payloadLength <= payloadCapacity(header, carrierBytes) ? STEGO_OK : STEGO_ERROR_NO_MESSAGE;
+}
+
+static size_t packedChunkBits(int bitsPerChannel) {
+    /*
+    Summary:
+        Returns how many bits are packed on the stack per step when embedding or extracting: as close to BIT_CHUNK
+        bytes as possible while filling a whole number of carrier bytes, so every step starts on a carrier byte.
+
+    Args:
+        bitsPerChannel (int): The number of bits stored in each carrier byte.
+
+    Return:
+        Returns the step in bits, a multiple of both 8 and bitsPerChannel.
+    */
+
+    return (size_t)(BIT_CHUNK / bitsPerChannel) * bitsPerChannel * 8;
+}
+
+static void embedStream(unsigned char *carrier, BitReader *reader, size_t bitCount, int bitsPerChannel) {
+    /*
+    Summary:
+        Embeds the next bitCount bits of a reader into consecutive carrier bytes, bitsPerChannel bits per byte,
+        packing them up to BIT_CHUNK bytes at a time on the stack for embedBits().
+
+    Args:
+        carrier (unsigned char*): The first carrier byte to write.
+        reader (BitReader*): The reader positioned at the first bit to embed.
+        bitCount (size_t): The number of bits to embed.
+        bitsPerChannel (int): The number of low bits of each carrier byte that are replaced.
+
+    Return:
+        This function does not return any value; it modifies the carrier in place.
+    */
+
+    unsigned char packed[BIT_CHUNK];
+    size_t step = packedChunkBits(bitsPerChannel);
+
+    for (size_t offset = 0; offset < bitCount; offset += step) {
+        size_t count = bitCount - offset < step ? bitCount - offset : step;
+
+        readBits(reader, packed, (count + 7) / 8);
+        embedBits(carrier + offset / bitsPerChannel, packed, count, bitsPerChannel);
+    }
+}
+
+static void gatherPermuted(const StegoImage *image, const ScatterMap *scatter, size_t firstSlot, size_t count,
+                           unsigned char *window) {
+    /*
+    Summary:
+        Gathers the carrier bytes of a run of payload slots of a scattered payload into a window, in slot order. The
+        slots of a block sit in at most two contiguous runs of carrier bytes, so a block costs one lookup, usually one
+        cache miss, and two copies; larger blocks get closer to the speed of a payload stored in order.
+
+    Args:
+        image (const StegoImage*): The image to read from.
+        scatter (const ScatterMap*): The permutation of the payload.
+        firstSlot (size_t): The first payload slot.
+        count (size_t): The number of slots; firstSlot + count must not exceed scatterSlots().
+        window (unsigned char*): Receives count carrier bytes.
+
+    Return:
+        This function does not return any value; it fills the window.
+    */
+
+    size_t mask = ((size_t)1 << scatter->blockBits) - 1;
+    size_t end = firstSlot + count;
+    bool contiguous = carrierIsContiguous(image);
+
+    for (size_t slot = firstSlot; slot < end;) {
+        size_t block = slot >> scatter->blockBits;
+        size_t carrier = HEADER_BITS + (scatterBlock(scatter, block) << scatter->blockBits);
+        size_t first = slot & mask;
+        size_t slots = mask + 1 - first < end - slot ? mask + 1 - first : end - slot;
+        size_t start = (first + blockRotation(scatter, block)) & mask;
+        size_t head = mask + 1 - start < slots ? mask + 1 - start : slots;
+        unsigned char *bytes = window + (slot - firstSlot);
+
+        if (contiguous) {
+            memcpy(bytes, image->pixels + carrier + start, head);
+            memcpy(bytes + head, image->pixels + carrier, slots - head);
+        } else {
+            gatherCarrier(image, carrier + start, head, bytes);
+            gatherCarrier(image, carrier, slots - head, bytes + head);
+        }
+
+        slot += slots;
+    }
+}
+
+static void scatterPermuted(StegoImage *image, const ScatterMap *scatter, size_t firstSlot, size_t count,
+                            const unsigned char *window) {
+    /*
+    Summary:
+        Writes a window gathered by gatherPermuted() back to the carrier bytes it came from.
+
+    Args:
+        image (StegoImage*): The image to write to.
+        scatter (const ScatterMap*): The permutation of the payload.
+        firstSlot (size_t): The first payload slot.
+        count (size_t): The number of slots.
+        window (const unsigned char*): The carrier bytes to write, in slot order.
+
+    Return:
+        This function does not return any value; it modifies the image in place.
+    */
+
+    size_t mask = ((size_t)1 << scatter->blockBits) - 1;
+    size_t end = firstSlot + count;
+    bool contiguous = carrierIsContiguous(image);
+
+    for (size_t slot = firstSlot; slot < end;) {
+        size_t block = slot >> scatter->blockBits;
+        size_t carrier = HEADER_BITS + (scatterBlock(scatter, block) << scatter->blockBits);
+        size_t first = slot & mask;
+        size_t slots = mask + 1 - first < end - slot ? mask + 1 - first : end - slot;
+        size_t start = (first + blockRotation(scatter, block)) & mask;
+        size_t head = mask + 1 - start < slots ? mask + 1 - start : slots;
+        const unsigned char *bytes = window + (slot - firstSlot);
+
+        if (contiguous) {
+            memcpy(image->pixels + carrier + start, bytes, head);
+            memcpy(image->pixels + carrier, bytes + head, slots - head);
+        } else {
+            scatterCarrier(image, carrier + start, head, bytes);
+            scatterCarrier(image, carrier, slots - head, bytes + head);
+        }
+
+        slot += slots;
+    }
+}
+
+static void embedImageStream(StegoImage *image, const ScatterMap *scatter, size_t firstCarrier, BitReader *reader,
+                             size_t bitCount, int bitsPerChannel) {
+    /*
+    Summary:
+        Embeds the next bitCount bits of a reader into an image from carrier byte firstCarrier on. Contiguous images are
+        handed to embedStream() directly; other layouts, and scattered payloads, are gathered into a CARRIER_WINDOW
+        buffer on the stack, embedded into and scattered back one window at a time.
+
+    Args:
+        image (StegoImage*): The image to embed into.
+        scatter (const ScatterMap*): The permutation of a scattered payload, or NULL to store it in order.
+        firstCarrier (size_t): The first carrier byte to write, or the first payload slot if scatter is given.
+        reader (BitReader*): The reader positioned at the first bit to embed.
+        bitCount (size_t): The number of bits to embed.
+        bitsPerChannel (int): The number of low bits of each carrier byte that are replaced.
+
+    Return:
+        This function does not return any value; it modifies the image in place.
+    */
+
+    if (!scatter && carrierIsContiguous(image)) {
+        embedStream(image->pixels + firstCarrier, reader, bitCount, bitsPerChannel);
+        return;
+    }
+
+    unsigned char window[CARRIER_WINDOW];
+    size_t step = (size_t)CARRIER_WINDOW * bitsPerChannel;
+
+    for (size_t offset = 0; offset < bitCount; offset += step) {
+        size_t count = bitCount - offset < step ? bitCount - offset : step;
+        size_t first = firstCarrier + offset / bitsPerChannel;
+        size_t carriers = (count + bitsPerChannel - 1) / bitsPerChannel;
+
+        if (scatter) gatherPermuted(image, scatter, first, carriers, window);
+        else gatherCarrier(image, first, carriers, window);
+
+        embedStream(window, reader, count, bitsPerChannel);
+
+        if (scatter) scatterPermuted(image, scatter, first, carriers, window);
+        else scatterCarrier(image, first, carriers, window);
+    }
+}
+
+static void extractImageStream(const StegoImage *image, const ScatterMap *scatter, size_t firstCarrier, BitWriter *writer,
+                               size_t bitCount, int bitsPerChannel, int version, uint32_t *checksum) {
+    /*
+    Summary:
+        Extracts bitCount bits from an image, starting at carrier byte firstCarrier, and appends them to a writer.
+        Layouts that are not contiguous, and scattered payloads, are gathered into a CARRIER_WINDOW buffer on the
+        stack first. The checksum is extended over the bytes of each step right after they are written, while they
+        are still in cache, so checking the payload takes no separate pass over it.
+
+    Args:
+        image (const StegoImage*): The image to extract from.
+        scatter (const ScatterMap*): The permutation of a scattered payload, or NULL if it is stored in order.
+        firstCarrier (size_t): The first carrier byte to read, or the first payload slot if scatter is given.
+        writer (BitWriter*): The writer that receives the bits.
+        bitCount (size_t): The number of bits to extract.
+        bitsPerChannel (int): The number of low bits of each carrier byte that hold data.
+        version (int): The header version, which picks the checksum as in versionChecksum().
+        checksum (uint32_t*): The checksum to extend over the written bytes, or NULL to skip it.
+
+    Return:
+        This function does not return any value; it fills the writer's buffer.
+    */
+
+    unsigned char packed[BIT_CHUNK];
+    unsigned char window[CARRIER_WINDOW];
+    bool direct = !scatter && carrierIsContiguous(image);
+    size_t step = direct ? packedChunkBits(bitsPerChannel) : (size_t)CARRIER_WINDOW * bitsPerChannel;
+
+    for (size_t offset = 0; offset < bitCount; offset += step) {
+        size_t count = bitCount - offset < step ? bitCount - offset : step;
+        size_t first = firstCarrier + offset / bitsPerChannel;
+        size_t carriers = (count + bitsPerChannel - 1) / bitsPerChannel;
+        const unsigned char *carrier = window;
+
+        if (direct) carrier = image->pixels + first;
+        else if (scatter) gatherPermuted(image, scatter, first, carriers, window);
+        else gatherCarrier(image, first, carriers, window);
+
+        size_t written = writer->length;
+
+        extractBits(carrier, packed, count, bitsPerChannel);
+        writeBits(writer, packed, (count + 7) / 8);
+
+        if (checksum) {
+            *checksum = versionChecksum(version, *checksum, writer->bytes + written, writer->length - written);
+        }
+    }
+}
+
+void embedRange(unsigned char *carrier, size_t firstByte, size_t byteCount, const unsigned char *headerBytes,
+                const StegoHeader *header, const unsigned char *message) {
+    /*
+    Summary:
+        Embeds whatever part of the header and payload falls into an arbitrary window of the carrier, such as one row
+        of a streamed image. Carrier bytes past the end of the payload are left untouched.
+
+    Args:
+        carrier (unsigned char*): The carrier bytes of the window; carrier[0] is carrier byte firstByte of the image.
+        firstByte (size_t): The position of the window within the image's carrier bytes.
+        byteCount (size_t): The number of carrier bytes in the window.
+        headerBytes (const unsigned char*): The header, packed with packStegoHeader().
+        header (const StegoHeader*): The header describing the payload.
+        message (const unsigned char*): The payload.
+
+    Return:
+        This function does not return any value; it modifies the carrier in place.
+    */
+
+    int bitsPerChannel = header->bitsPerChannel;
+    size_t payloadBits = header->payloadLength * header->symbolBits;
+    size_t totalBytes = HEADER_BITS + (payloadBits + bitsPerChannel - 1) / bitsPerChannel;
+    size_t end = firstByte + byteCount < totalBytes ? firstByte + byteCount : totalBytes;
+    BitReader reader;
+
+    if (firstByte < HEADER_BITS && firstByte < end) {
+        size_t stop = end < HEADER_BITS ? end : HEADER_BITS;
+
+        initBitReader(&reader, headerBytes, HEADER_BYTES, 8);
+        seekBitReader(&reader, firstByte);
+        embedStream(carrier, &reader, stop - firstByte, 1);
+    }
+
+    size_t start = firstByte > HEADER_BITS ? firstByte : HEADER_BITS;
+
+    if (start < end) {
+        size_t firstBit = (start - HEADER_BITS) * bitsPerChannel;
+        size_t endBit = (end - HEADER_BITS) * bitsPerChannel < payloadBits ? (end - HEADER_BITS) * bitsPerChannel : payloadBits;
+
+        initBitReader(&reader, message, header->payloadLength, header->symbolBits);
+        seekBitReader(&reader, firstBit);
+        embedStream(carrier + (start - firstByte), &reader, endBit - firstBit, bitsPerChannel);
+    }
+}
+
+static void embedChunk(void *context, size_t chunk, int worker) {
+    /*
+    Summary:
+        Embeds the part of the payload that lands in one CARRIER_CHUNK of the image after the header. Carrier byte i only
+        depends on payload bits i * bitsPerChannel onwards, so chunks can be processed by any thread in any order.
+
+    Args:
+        context (void*): The EmbedJob describing the image and payload.
+        chunk (size_t): The index of the chunk to process.
+        worker (int): The index of the running thread; unused.
+
+    Return:
+        This function does not return any value; it modifies the image buffer in place.
+    */
+
+    EmbedJob *job = (EmbedJob *)context;
+    size_t chunkBits = (size_t)CARRIER_CHUNK * job->bitsPerChannel;
+    size_t start = chunk * chunkBits;
+    size_t stop = start + chunkBits < job->totalBits ? start + chunkBits : job->totalBits;
+    BitReader reader;
+
+    (void)worker;
+
+    initBitReader(&reader, job->message, job->length, job->symbolBits);
+    seekBitReader(&reader, start);
+    embedImageStream(job->image, job->scatter, (job->scatter ? 0 : HEADER_BITS) + chunk * CARRIER_CHUNK, &reader,
+                     stop - start, job->bitsPerChannel);
+}
+
+void embedMessage(StegoImage *image, const StegoHeader *header, const unsigned char *message, WorkerPool *pool) {
+    /*
+    Summary:
+        Embeds the header into the first HEADER_BITS carrier bytes and the payload right after it, header->bitsPerChannel
+        bits per carrier byte, or spread over the rest of the image with the header's key if it is scattered. Only
+        the carrier bytes that hold the header and payload are touched; the rest of the image is left exactly as it
+        was decoded. The payload is split into CARRIER_CHUNK pieces that are processed in parallel on the pool.
+
+    Args:
+        image (StegoImage*): The image to embed into; it is modified in place. It must be large enough for the header and
+            payload.
+        header (const StegoHeader*): The header describing the payload.
+        message (const unsigned char*): The payload to embed.
+        pool (WorkerPool*): The pool to run on, or NULL to run on the calling thread.
+
+    Return:
+        This function does not return any value.
+    */
+
+    unsigned char bytes[HEADER_BYTES];
+    BitReader reader;
+    ScatterMap scatter;
+    EmbedJob job;
+
+    packStegoHeader(header, bytes);
+    initBitReader(&reader, bytes, HEADER_BYTES, 8);
+    embedImageStream(image, NULL, 0, &reader, HEADER_BITS, 1);
+
+    job.image = image;
+    job.scatter = initHeaderScatter(image, header, &scatter) ? &scatter : NULL;
+    job.message = message;
+    job.length = header->payloadLength;
+    job.symbolBits = header->symbolBits;
+    job.bitsPerChannel = header->bitsPerChannel;
+    job.totalBits = header->payloadLength * header->symbolBits;
+
+    size_t chunkBits = (size_t)CARRIER_CHUNK * job.bitsPerChannel;
+
+    runParallel(pool, (job.totalBits + chunkBits - 1) / chunkBits, embedChunk, &job);
+}
+
+static void extractChunk(void *context, size_t chunk, int worker) {
+    /*
+    Summary:
+        Extracts the payload symbols held by one CARRIER_CHUNK of the extracted range into the matching part of the
+        output buffer, and records the checksum of those bytes alone.
+
+    Args:
+        context (void*): The ExtractJob describing the image and the output buffer.
+        chunk (size_t): The index of the chunk within the current batch, which starts at chunk job->firstChunk.
+        worker (int): The index of the running thread; unused.
+
+    Return:
+        This function does not return any value; it fills part of the output buffer and job->checksums[chunk].
+    */
+
+    ExtractJob *job = (ExtractJob *)context;
+    uint32_t *checksum = &job->checksums[chunk];
+
+    (void)worker;
+
+    chunk += job->firstChunk;
+    *checksum = 0;
+
+    size_t chunkBits = (size_t)CARRIER_CHUNK * job->bitsPerChannel;
+    size_t start = chunk * chunkBits;
+    size_t end = start + chunkBits < job->totalBits ? start + chunkBits : job->totalBits;
+    BitWriter writer;
+
+    initBitWriter(&writer, job->output + start / job->symbolBits, (end - start) / job->symbolBits, job->symbolBits);
+    extractImageStream(job->image, job->scatter, job->firstCarrier + chunk * CARRIER_CHUNK, &writer, end - start,
+                       job->bitsPerChannel, job->version, checksum);
+}
+
+uint32_t extractMessage(const StegoImage *image, const StegoHeader *header, unsigned char *output, WorkerPool *pool) {
+    /*
+    Summary:
+        Extracts the payload described by a header read with stegoReadHeader(). Since the length is known up front,
+        exactly the carrier bytes that hold the payload are read, split into CARRIER_CHUNK pieces that are processed in
+        parallel on the pool.
+
+    Args:
+        image (const StegoImage*): The image to extract from.
+        header (const StegoHeader*): The header describing the payload.
+        output (unsigned char*): The buffer that receives the payload, at least header->payloadLength bytes long.
+        pool (WorkerPool*): The pool to run on, or NULL to run on the calling thread.
+
+    Return:
+        Returns the checksum of the extracted payload, computed as in the header's version, to compare with
+        header->checksum; it fills the output buffer.
+    */
+
+    return extractRange(image, header, 0, header->payloadLength, output, 0, pool);
+}
+
+uint32_t extractRange(const StegoImage *image, const StegoHeader *header, size_t firstByte, size_t count,
+                      unsigned char *output, uint32_t checksum, WorkerPool *pool) {
+    /*
+    Summary:
+        Extracts count payload bytes starting at payload byte firstByte, so a large payload can be pulled out of the
+        image one window at a time. The carrier bytes of the window are split into CARRIER_CHUNK pieces that are
+        processed in parallel on the pool; every piece starts on a symbol boundary because the window does.
+
+    Args:
+        image (const StegoImage*): The image to extract from.
+        header (const StegoHeader*): The header describing the payload, with the key set by stegoUseKey() if it is
+            scattered.
+        firstByte (size_t): The first payload byte to extract; a multiple of header->bitsPerChannel, so that the window
+            starts on a carrier byte.
+        count (size_t): The number of payload bytes to extract; firstByte + count must not exceed the payload length.
+        output (unsigned char*): The buffer that receives the bytes, at least count bytes long.
+        checksum (uint32_t): The checksum of the payload before firstByte, or 0 at the start of the payload.
+        pool (WorkerPool*): The pool to run on, or NULL to run on the calling thread.
+
+    Return:
+        Returns the checksum extended over the extracted bytes; it fills the output buffer.
+    */
+
+    return extractWindow(image, 0, header, firstByte, count, output, checksum, pool);
+}
+
+uint32_t extractWindow(const StegoImage *window, size_t windowCarrier, const StegoHeader *header, size_t firstByte,
+                       size_t count, unsigned char *output, uint32_t checksum, WorkerPool *pool) {
+    /*
+    Summary:
+        Extracts count payload bytes starting at payload byte firstByte from a window of rows of the image rather than
+        the whole image, so a payload can be extracted while the image is still being decoded, holding only a few
+        rows at a time. Works like extractRange(), which is the window that starts at the top of the image.
+
+        Every chunk checksums its own bytes as it writes them. The chunks run in batches of CHECKSUM_BATCH, and after
+        each batch their checksums are joined in order onto the running one; all full chunks hold the same number of
+        bytes, so they share one shift operator.
+
+    Args:
+        window (const StegoImage*): The rows held, as an image of the full width whose height is the number of rows.
+        windowCarrier (size_t): The index in the whole image of the first carrier byte of the window.
+        header (const StegoHeader*): The header describing the payload. A scattered payload can only be extracted
+            from the whole image, with windowCarrier 0.
+        firstByte (size_t): The first payload byte to extract; a multiple of header->bitsPerChannel.
+        count (size_t): The number of payload bytes to extract; the carrier bytes that hold them must all lie in the
+            window.
+        output (unsigned char*): The buffer that receives the bytes, at least count bytes long.
+        checksum (uint32_t): The checksum of the payload before firstByte, or 0 at the start of the payload.
+        pool (WorkerPool*): The pool to run on, or NULL to run on the calling thread.
+
+    Return:
+        Returns the checksum extended over the extracted bytes; it fills the output buffer.
+    */
+
+    ScatterMap scatter;
+    ExtractJob job;
+    uint32_t checksums[CHECKSUM_BATCH];
+
+    job.image = window;
+    job.scatter = initHeaderScatter(window, header, &scatter) ? &scatter : NULL;
+    job.firstCarrier = (job.scatter ? 0 : HEADER_BITS) + firstByte * header->symbolBits / header->bitsPerChannel -
+                       windowCarrier;
+    job.output = output;
+    job.symbolBits = header->symbolBits;
+    job.bitsPerChannel = header->bitsPerChannel;
+    job.totalBits = count * header->symbolBits;
+    job.version = header->version;
+    job.checksums = checksums;
+
+    size_t chunkBits = (size_t)CARRIER_CHUNK * job.bitsPerChannel;
+    size_t chunkBytes = chunkBits / job.symbolBits;
+    size_t chunkCount = (job.totalBits + chunkBits - 1) / chunkBits;
+    uint32_t shift = job.version == 1 ? 0 : crc32cShift(chunkBytes);
+
+    for (job.firstChunk = 0; job.firstChunk < chunkCount; job.firstChunk += CHECKSUM_BATCH) {
+        size_t batch = chunkCount - job.firstChunk < CHECKSUM_BATCH ? chunkCount - job.firstChunk : CHECKSUM_BATCH;
+
+        runParallel(pool, batch, extractChunk, &job);
+
+        for (size_t chunk = 0; chunk < batch; chunk++) {
+            size_t bytes = count - (job.firstChunk + chunk) * chunkBytes;
+
+            if (bytes >= chunkBytes) {
+                checksum = joinChecksums(job.version, checksum, checksums[chunk], chunkBytes, shift);
+            } else {
+                checksum = joinChecksums(job.version, checksum, checksums[chunk], bytes,
+                                         job.version == 1 ? 0 : crc32cShift(bytes));
+            }
+        }
+    }
+
+    return checksum;
+}
+
+static bool initHeaderScatter(const StegoImage *image, const StegoHeader *header, ScatterMap *scatter) {
+    /*
+    Summary:
+        Prepares the permutation of a scattered payload from its header and the size of the image.
+
+    Args:
+        image (const StegoImage*): The image the payload is in.
+        header (const StegoHeader*): The header, holding the flags and the key.
+        scatter (ScatterMap*): Receives the permutation.
+
+    Return:
+        Returns true if the payload is scattered and the map was filled in, false if it is stored in order.
+    */
+
+    if (!(header->flags & STEGO_FLAG_SCATTER)) return false;
+
+    initScatterMap(scatter, header->key, carrierCount(image) - HEADER_BITS,
+                   (header->flags & STEGO_FLAG_BLOCK_MASK) >> STEGO_FLAG_BLOCK_SHIFT);
+
+    return true;
+}
@@ -0,0 +1,88 @@
+#ifndef STEGO_H
+#define STEGO_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "pool.h"
+
+// Version 2 headers hold the CRC-32C of the payload; version 1 headers, which hold its zlib CRC-32, are still read
+#define STEGO_VERSION 2
+#define STEGO_OLDEST_VERSION 1
+#define HEADER_BYTES 20
+#define HEADER_BITS (HEADER_BYTES * 8)
+
+// Header flags: the payload is spread with a keyed permutation over blocks of 2^bits carrier bytes, bits stored in
+// the flags above STEGO_FLAG_SCATTER
+#define STEGO_FLAG_SCATTER 0x01
+#define STEGO_FLAG_BLOCK_SHIFT 1
+#define STEGO_FLAG_BLOCK_MASK 0x1E
+#define STEGO_MAX_SCATTER_BLOCK_BITS 12
+#define STEGO_DEFAULT_SCATTER_BLOCK_BITS 9
+// The codec the payload was compressed with before embedding, in the two bits above the scatter block bits
+#define STEGO_FLAG_CODEC_SHIFT 5
+#define STEGO_FLAG_CODEC_MASK 0x60
+// The payload is one shard of a larger payload and starts with a shard record (see shard.h)
+#define STEGO_FLAG_SHARD 0x80
+#define STEGO_DEFAULT_CODEC_LEVEL 1
+
+typedef enum {
+    STEGO_CODEC_NONE = 0,
+    STEGO_CODEC_DEFLATE,
+    STEGO_CODEC_COUNT
+} StegoCodec;
+
+typedef enum {
+    STEGO_OK = 0,
+    STEGO_ERROR_INVALID_ARGUMENT,
+    STEGO_ERROR_TOO_LARGE,
+    STEGO_ERROR_NO_MESSAGE,
+    STEGO_ERROR_BUFFER_TOO_SMALL,
+    STEGO_ERROR_CHECKSUM,
+    STEGO_ERROR_KEY_REQUIRED
+} StegoStatus;
+
+typedef struct {
+    unsigned char *pixels;
+    int height;
+    int width;
+    int channels;
+    size_t stride;
+    int bitDepth;
+} StegoImage;
+
+typedef struct {
+    int bitsPerChannel;
+    bool scatter;
+    uint64_t key;
+    int scatterBlockBits;
+    int codec;
+    int codecLevel;
+    bool shard;
+} StegoOptions;
+
+typedef struct {
+    int version;
+    int bitsPerChannel;
+    int symbolBits;
+    int flags;
+    uint64_t payloadLength;
+    uint32_t checksum;
+    uint64_t key;
+} StegoHeader;
+
+void initStegoOptions(StegoOptions *options);
+void stegoInit(void);
+StegoStatus stegoEmbed(StegoImage *image, const unsigned char *message, size_t length, const StegoOptions *options,
+                       WorkerPool *pool);
+StegoStatus stegoReadHeader(const StegoImage *image, StegoHeader *header);
+StegoStatus stegoExtract(const StegoImage *image, unsigned char *output, size_t capacity, size_t *length,
+                         const StegoOptions *options, WorkerPool *pool);
+StegoStatus stegoCapacity(const StegoImage *image, const StegoOptions *options, int symbolBits, size_t *capacity);
+int stegoSymbolBits(const unsigned char *message, size_t length);
+const char *stegoStatusString(StegoStatus status);
+uint64_t stegoKeyFromPassphrase(const char *passphrase);
+StegoStatus stegoUseKey(StegoHeader *header, const StegoOptions *options);
+
+#endif
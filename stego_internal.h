@@ -0,0 +1,27 @@
+#ifndef STEGO_INTERNAL_H
+#define STEGO_INTERNAL_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "pool.h"
+#include "stego.h"
+
+// The building blocks behind the stego*() functions, for the command line tool and the benchmark, which stream
+// images and payloads themselves; they are not part of libstego's interface, and stegoInit() must have run before
+// any of them is called
+uint32_t payloadChecksum(uint32_t checksum, const unsigned char *bytes, size_t length);
+void initStegoHeader(StegoHeader *header, const unsigned char *message, size_t length, const StegoOptions *options);
+size_t payloadCapacity(const StegoHeader *header, size_t carrierBytes);
+size_t messageCarriers(const StegoHeader *header, size_t carrierBytes);
+void packStegoHeader(const StegoHeader *header, unsigned char *bytes);
+void embedRange(unsigned char *carrier, size_t firstByte, size_t byteCount, const unsigned char *headerBytes,
+                const StegoHeader *header, const unsigned char *message);
+void embedMessage(StegoImage *image, const StegoHeader *header, const unsigned char *message, WorkerPool *pool);
+uint32_t extractMessage(const StegoImage *image, const StegoHeader *header, unsigned char *output, WorkerPool *pool);
+uint32_t extractRange(const StegoImage *image, const StegoHeader *header, size_t firstByte, size_t count,
+                      unsigned char *output, uint32_t checksum, WorkerPool *pool);
+uint32_t extractWindow(const StegoImage *window, size_t windowCarrier, const StegoHeader *header, size_t firstByte,
+                       size_t count, unsigned char *output, uint32_t checksum, WorkerPool *pool);
+
+#endif
@@ -2,28 +2,143 @@
 #include <stdlib.h>
 #include <string.h>
 #include <png.h>
-#include <math.h>
 #include <stdbool.h>
+#include <stdint.h>
+#include <time.h>
+#include <stdatomic.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "arena.h"
+#include "carrier.h"
+#include "codec.h"
+#include "image.h"
+#include "lsb.h"
+#include "pool.h"
+#include "scatter.h"
+#include "server.h"
+#include "shard.h"
+#include "stats.h"
+#include "stego.h"
+#include "stego_internal.h"
+
+// Payload bytes extracted and written per step when decoding; a multiple of every bits-per-channel setting (1-4)
+#define DECODE_CHUNK (3 * 1024 * 1024)
+// Carrier bytes kept decoded ahead of the extraction when a PNG is decoded row by row while it is being extracted
+#define DECODE_WINDOW (4 * 1024 * 1024)
+// Working memory every daemon worker faults in before the first request: a decode chunk and its carrier window
+#define SERVE_WARM_BYTES (DECODE_CHUNK + DECODE_WINDOW)
+
+typedef struct {
+    unsigned char *bytes;
+    size_t capacity;
+} Buffer;
+
+typedef struct {
+    const unsigned char *bytes;
+    size_t length;
+    bool mapped;
+} Payload;
+
+typedef struct {
+    const char *fileName;
+    FILE *file;
+    size_t length;
+    bool failed;
+} DecodedFile;
+
+typedef struct {
+    char *pictureFileName;
+    char *textFileName;
+} BatchItem;
+
+typedef struct {
+    BatchItem *items;
+    bool encoding;
+    bool streaming;
+    bool stats;
+    const PngOptions *pngOptions;
+    const StegoOptions *stegoOptions;
+    Arena *arenas;
+    atomic_size_t failures;
+    atomic_size_t bytes;
+} BatchJob;
+
+typedef struct {
+    char **carrierFileNames;
+    const unsigned char *payload;
+    const uint64_t *lengths;
+    const uint64_t *offsets;
+    StegoShard shard;
+    bool streaming;
+    bool stats;
+    const PngOptions *pngOptions;
+    const StegoOptions *stegoOptions;
+    Arena *arenas;
+    atomic_size_t failures;
+    atomic_size_t bytes;
+} SplitJob;
+
+typedef struct {
+    const char *pictureFileName;
+    const char *outputFileName;
+    int file;
+    unsigned char record[SHARD_RECORD_BYTES];
+    size_t recordBytes;
+    StegoShard shard;
+    uint64_t length;
+    bool failed;
+} ShardSink;
+
+typedef struct {
+    char **pictureFileNames;
+    ShardSink *sinks;
+    bool stats;
+    const StegoOptions *stegoOptions;
+    Arena *arenas;
+    atomic_size_t failures;
+    atomic_size_t bytes;
+} ReassembleJob;
+
+typedef struct {
+    bool streaming;
+    bool stats;
+    const PngOptions *pngOptions;
+    const StegoOptions *stegoOptions;
+    Arena *arenas;
+} ServeJob;
 
-#define STB_IMAGE_IMPLEMENTATION
-#include "stb/stb_image.h"
-#define STB_IMAGE_WRITE_IMPLEMENTATION
-#include "stb/stb_image_write.h"
-
-unsigned char ***dynamicArray(int height, int width, int channels);
-void loadPixelData(unsigned char ***imageArray, unsigned char *image, int height, int width, int channels);
-void printArray(unsigned char ***imageArray, int height, int width, int channels);
-void free3DDynamicArray(unsigned char ***imageArray, int height, int width, int channels);
-void reverseArray(int *array, int length);
-void swap(int *x, int *y);
-int *convertCharToBinary(unsigned char character, int length);
-int *convertStringToBinary(char *string);
-unsigned char *updated1DPixelData(unsigned char ***imageArray, int height, int width, int channels);
-void createPng(char *fileName, unsigned char *pixels, int height, int width);
 char *getOutputFileName(char *fileName);
-void encode(char *fileName, char *sentence, char *outputFileName);
-void decode(char *outputPictureFileName, char *outputTextFileName);
-char *readTextFromFile(char *inputTextFileName);
+bool encode(char *fileName, const char *sentence, size_t sentenceLength, char *outputFileName, const PngOptions *pngOptions,
+            const StegoOptions *stegoOptions, WorkerPool *pool);
+bool streamEncode(char *fileName, const char *sentence, size_t sentenceLength, char *outputFileName, const PngOptions *pngOptions,
+                  const StegoOptions *stegoOptions, WorkerPool *pool);
+bool decode(char *outputPictureFileName, char *outputTextFileName, Buffer *scratch, size_t *length,
+            const StegoOptions *stegoOptions, WorkerPool *pool);
+bool extractImage(char *pictureFileName, Buffer *scratch, const StegoOptions *stegoOptions, bool sharded,
+                  PayloadSink sink, void *context, const bool *sinkFailed, WorkerPool *pool);
+bool reserveBuffer(Buffer *buffer, size_t size);
+bool readTextFromFile(char *inputTextFileName, Buffer *buffer, size_t *length);
+bool openPayload(char *fileName, Buffer *fallback, Payload *payload);
+void closePayload(Payload *payload);
+bool packPayload(Payload *payload, Buffer *packed, StegoOptions *stegoOptions);
+bool writeDecoded(void *context, const unsigned char *bytes, size_t length);
+bool reportCapacity(char *fileName, const StegoOptions *stegoOptions);
+size_t readManifest(char *manifestFileName, BatchItem **items);
+bool batch(char *manifestFileName, bool encoding, bool streaming, bool stats, const PngOptions *pngOptions,
+           const StegoOptions *stegoOptions, WorkerPool *pool);
+bool split(char *payloadFileName, char **carrierFileNames, size_t count, bool streaming, bool stats,
+           const PngOptions *pngOptions, const StegoOptions *stegoOptions, WorkerPool *pool);
+bool writeShard(void *context, const unsigned char *bytes, size_t length);
+bool reassemble(char *outputFileName, char **pictureFileNames, size_t count, bool stats, const StegoOptions *stegoOptions,
+                WorkerPool *pool);
+bool countDecoded(void *context, const unsigned char *bytes, size_t length);
+bool serve(char *socketPath, int threads, bool streaming, bool stats, const PngOptions *pngOptions,
+           const StegoOptions *stegoOptions);
+void printStats(const char *fileName, const char *operation, bool ok, const StegoStats *stats);
+void benchmark(char *fileName);
 
 int main(int argc, char *argv[]) {
     /*
@@ -34,591 +149,2004 @@ int main(int argc, char *argv[]) {
         -d: decoding
             Step 1: Run make
             Step 2: ./stegano -d {output picture file path} {text file to write to}
+        -E / -D: batch encoding / decoding of every job in a manifest, "-" reads the manifest from stdin
+            Step 1: Run make
+            Step 2: ./stegano -j 8 -E {manifest of "picture<TAB>text file to read" lines}
+                    ./stegano -D {manifest of "picture<TAB>text file to write to" lines}
+        -S / -R: split one payload over several carriers, each of which is written next to it like -e does, and
+            reassemble it from the encoded images, given in any order; the shards are embedded and extracted in parallel
+            Step 1: Run make
+            Step 2: ./stegano -S {payload file to read} {input picture file path} ...
+                    ./stegano -R {file to write to} {output picture file path} ...
+        --serve: run as a daemon answering encode, decode and check requests on a Unix domain socket until SIGINT or
+            SIGTERM, one request per line; -j sets the number of workers, the other options apply to every request
+            Step 1: Run make stegano stegano-load
+            Step 2: ./stegano -j 8 --serve {socket path}
+                    ./stegano-load -c 16 -n 10000 {socket path} {file of request lines}
+        -c / --capacity: print the payload capacity of one or more images for every embedding mode, reading only their
+            headers
+            Step 1: Run make
+            Step 2: ./stegano -c {picture file path} ...
+        -b: benchmarking embed/extract scaling from 1 to 64 threads
+            Step 1: Run make
+            Step 2: ./stegano -b {input picture file path}
+        -j N: run on N threads (defaults to the number of CPUs), given before -e or -d
+            Example: ./stegano -j 8 -e {input picture file path} {text file to read}
+        -k N: hide N bits (1-4) in every channel byte instead of 1, given before -e; decoding detects it
+            Example: ./stegano -k 2 -e {input picture file path} {text file to read}
+        -s: stream PNG carriers row by row while encoding, given before -e
+            Example: ./stegano -s -e {input picture file path} {text file to read}
+        --key PASSPHRASE: spread the message over the whole image in an order derived from the passphrase, given before
+            -e; decoding a message hidden this way needs the same passphrase before -d
+            Example: ./stegano --key "correct horse" -e {input picture file path} {text file to read}
+        --stats: print one JSON line per image to stderr with the time, bytes and heap allocations of every stage,
+            given before -e, -d, -E or -D
+            Example: ./stegano --stats -d {output picture file path} {text file to write to}
+        --codec NAME: compress the message with none or deflate before hiding it, given before -e; decoding detects it
+        --codec-level N: deflate level 1 (fastest, the default) to 9 (smallest)
+            Example: ./stegano --codec deflate -e {input picture file path} {log file to read}
+        --preset NAME: PNG output preset, one of none, fast, default or small, given before -e
+        --level N: zlib compression level 0-9 for the PNG output
+        --filter NAME: PNG row filter, one of none, sub, up, avg, paeth or all
+        --strategy NAME: zlib strategy, one of default, filtered, huffman, rle or fixed
+            Example: ./stegano --preset fast -e {input picture file path} {text file to read}
+    */
+
+    int threads = defaultThreadCount();
+    bool streaming = false;
+    bool stats = false;
+    PngOptions pngOptions;
+    StegoOptions stegoOptions;
+    int arg = 1;
+
+    parsePngPreset("default", &pngOptions);
+    initStegoOptions(&stegoOptions);
+
+    while (arg < argc) {
+        if (strcmp("-j", argv[arg]) == 0 && arg + 1 < argc) {
+            threads = atoi(argv[arg + 1]);
+            arg += 2;
+
+            if (threads < 1) {
+                printf("Invalid thread count\n");
+                return 1;
+            }
+        } else if (strcmp("-k", argv[arg]) == 0 && arg + 1 < argc) {
+            stegoOptions.bitsPerChannel = atoi(argv[arg + 1]);
+            arg += 2;
+
+            if (stegoOptions.bitsPerChannel < 1 || stegoOptions.bitsPerChannel > 4) {
+                printf("Invalid bits per channel\n");
+                return 1;
+            }
+        } else if (strcmp("-s", argv[arg]) == 0) {
+            streaming = true;
+            arg++;
+        } else if (strcmp("--key", argv[arg]) == 0 && arg + 1 < argc) {
+            stegoOptions.scatter = true;
+            stegoOptions.key = stegoKeyFromPassphrase(argv[arg + 1]);
+            arg += 2;
+        } else if (strcmp("--stats", argv[arg]) == 0) {
+            stats = true;
+            arg++;
+        } else if (strcmp("--codec", argv[arg]) == 0 && arg + 1 < argc) {
+            if (!parseCodec(argv[arg + 1], &stegoOptions.codec)) {
+                printf("Invalid codec\n");
+                return 1;
+            }
+
+            arg += 2;
+        } else if (strcmp("--codec-level", argv[arg]) == 0 && arg + 1 < argc) {
+            stegoOptions.codecLevel = atoi(argv[arg + 1]);
+            arg += 2;
+
+            if (stegoOptions.codecLevel < 1 || stegoOptions.codecLevel > 9) {
+                printf("Invalid codec level\n");
+                return 1;
+            }
+        } else if (strcmp("--preset", argv[arg]) == 0 && arg + 1 < argc) {
+            if (!parsePngPreset(argv[arg + 1], &pngOptions)) {
+                printf("Invalid preset\n");
+                return 1;
+            }
+
+            arg += 2;
+        } else if (strcmp("--level", argv[arg]) == 0 && arg + 1 < argc) {
+            pngOptions.compressionLevel = atoi(argv[arg + 1]);
+            arg += 2;
+
+            if (pngOptions.compressionLevel < 0 || pngOptions.compressionLevel > 9) {
+                printf("Invalid compression level\n");
+                return 1;
+            }
+        } else if (strcmp("--filter", argv[arg]) == 0 && arg + 1 < argc) {
+            if (!parsePngFilter(argv[arg + 1], &pngOptions)) {
+                printf("Invalid filter\n");
+                return 1;
+            }
+
+            arg += 2;
+        } else if (strcmp("--strategy", argv[arg]) == 0 && arg + 1 < argc) {
+            if (!parsePngStrategy(argv[arg + 1], &pngOptions)) {
+                printf("Invalid strategy\n");
+                return 1;
+            }
+
+            arg += 2;
+        } else break;
+    }
+
+    initImageBackend();
+    stegoInit();
+
+    if (argc - arg >= 2 && (strcmp("-c", argv[arg]) == 0 || strcmp("--capacity", argv[arg]) == 0)) {
+        bool ok = true;
+
+        printf("image,width,height,channels,depth,text_k1,binary_k1,text_k2,binary_k2,text_k3,binary_k3,text_k4,binary_k4\n");
+
+        for (int file = arg + 1; file < argc; file++) ok = reportCapacity(argv[file], &stegoOptions) && ok;
+
+        return ok ? 0 : 1;
+    }
+
+    if (argc - arg == 2 && strcmp("-b", argv[arg]) == 0) {
+        benchmark(argv[arg + 1]);
+        return 0;
+    }
+
+    if (argc - arg == 2 && (strcmp("-E", argv[arg]) == 0 || strcmp("-D", argv[arg]) == 0)) {
+        WorkerPool *pool = createWorkerPool(threads);
+        bool ok = batch(argv[arg + 1], argv[arg][1] == 'E', streaming, stats, &pngOptions, &stegoOptions, pool);
+
+        destroyWorkerPool(pool);
+
+        return ok ? 0 : 1;
+    }
+
+    if (argc - arg == 2 && strcmp("--serve", argv[arg]) == 0) {
+        return serve(argv[arg + 1], threads, streaming, stats, &pngOptions, &stegoOptions) ? 0 : 1;
+    }
+
+    if (argc - arg >= 3 && (strcmp("-S", argv[arg]) == 0 || strcmp("-R", argv[arg]) == 0)) {
+        if (stegoOptions.codec != STEGO_CODEC_NONE) {
+            printf("A split payload cannot be compressed\n");
+            return 1;
+        }
+
+        WorkerPool *pool = createWorkerPool(threads);
+        size_t count = (size_t)(argc - arg - 2);
+        bool ok = argv[arg][1] == 'S' ?
+                  split(argv[arg + 1], argv + arg + 2, count, streaming, stats, &pngOptions, &stegoOptions, pool) :
+                  reassemble(argv[arg + 1], argv + arg + 2, count, stats, &stegoOptions, pool);
+
+        destroyWorkerPool(pool);
+
+        return ok ? 0 : 1;
+    }
+
+    if (argc - arg != 3) {
+        printf("Not enough arguements\n");
+	return 1;
+    }
+
+    Arena arena;
+
+    initArena(&arena);
+    attachArena(&arena);
+
+    char *option = argv[arg];
+    char *pictureFileName = argv[arg + 1];
+    char *outputFileName = getOutputFileName(pictureFileName);
+    char *textFileName = argv[arg + 2];
+    WorkerPool *pool = createWorkerPool(threads);
+    Buffer buffer = {NULL, 0};
+    Buffer packed = {NULL, 0};
+    Payload payload = {NULL, 0, false};
+    StegoStats imageStats;
+    size_t length;
+    bool ok = false;
+
+    if (stats) stegoStatsBegin(&imageStats);
+
+    if (strcmp("-e", option) == 0) {
+        if (!outputFileName || !openPayload(textFileName, &buffer, &payload)) ok = false;
+        else if (!packPayload(&payload, &packed, &stegoOptions)) ok = false;
+        else if (streaming) ok = streamEncode(pictureFileName, (const char *)payload.bytes, payload.length, outputFileName, &pngOptions, &stegoOptions, pool);
+        else ok = encode(pictureFileName, (const char *)payload.bytes, payload.length, outputFileName, &pngOptions, &stegoOptions, pool);
+
+        closePayload(&payload);
+    } else if (strcmp("-d", option) == 0) ok = decode(pictureFileName, textFileName, &buffer, &length, &stegoOptions, pool);
+    else printf("Invalid Option\n");
+
+    if (stats) {
+        stegoStatsEnd();
+        printStats(pictureFileName, strcmp("-d", option) == 0 ? "decode" : "encode", ok, &imageStats);
+    }
+
+    workFree(packed.bytes);
+    workFree(buffer.bytes);
+    workFree(outputFileName);
+    attachArena(NULL);
+    destroyArena(&arena);
+    destroyWorkerPool(pool);
+
+    return ok ? 0 : 1;
+}
+
+char *getOutputFileName(char *fileName) {
+    /*
+    Summary:
+        Generates a new output file name by appending "-output.png" to the original file name (excluding the file extension).
+        This is useful for saving processed images with a modified name based on the original file. Only a dot in the
+        last path component starts the extension, so directories containing dots are kept intact.
+
+    Args:
+        fileName (char*): The original file name, including the extension.
+
+    Return:
+        Returns a dynamically allocated string containing the new file name with the "-output.png" suffix, or NULL if
+        memory allocation fails. The string is working memory; the caller releases it with workFree().
+    */
+
+    char *baseName = strrchr(fileName, '/');
+    char *extension = strrchr(baseName ? baseName : fileName, '.');
+    size_t stemLength = extension ? (size_t)(extension - fileName) : strlen(fileName);
+    char *outputFileName = (char *)workAlloc(stemLength + sizeof("-output.png"));
+
+    if (!outputFileName) return NULL;
+
+    memcpy(outputFileName, fileName, stemLength);
+    strcpy(outputFileName + stemLength, "-output.png");
+
+    return outputFileName;
+}
+
+bool encode(char *fileName, const char *sentence, size_t sentenceLength, char *outputFileName, const PngOptions *pngOptions,
+            const StegoOptions *stegoOptions, WorkerPool *pool) {
+    /*
+    Summary:
+        Encodes a message into an image file by modifying the least significant bits of each pixel in the input image.
+        The encoded message is saved as a new image file. A header holding the length and checksum of the message is
+        embedded first, followed by the message itself as 7-bit characters (ASCII text) or 8-bit bytes (anything else).
+
+    Args:
+        fileName (char*): The name of the input image file to encode the message into.
+        sentence (const char*): The message to be encoded within the image. It may contain any bytes.
+        sentenceLength (size_t): The number of bytes in the message.
+        outputFileName (char*): The name of the output image file to save the encoded image.
+        pngOptions (const PngOptions*): The compression settings for the output PNG.
+        stegoOptions (const StegoOptions*): How the message is embedded, such as the bits used per channel byte.
+        pool (WorkerPool*): The pool the embedding runs on.
+
+    Return:
+        Returns true once the encoded image has been written to the output file, false otherwise.
+
+    Note:
+        The message is embedded directly into the buffer the image is decoded into, so it is held in memory exactly once.
+        The message bits are produced on the fly, so no memory is allocated for them, and the image is processed in
+        chunks across the pool. The capacity is checked against the image header before the pixels are decoded, so an
+        oversized message is rejected without allocating anything. A failed image load or a message that does not fit
+        results in an error message to stderr and a false return, never in exiting the process, so batch runs can
+        carry on with the next image.
+    */
+
+    StegoImage image;
+    ImageReader reader;
+    StageTimer timer;
+    size_t capacity;
+
+    beginStage(&timer, STEGO_STAGE_LOAD);
+    bool opened = openImage(fileName, &reader, &image);
+    endStage(&timer, 0);
+
+    if (!opened) {
+        fprintf(stderr, "Error loading image: %s\n", fileName);
+        return false;
+    }
+
+    int symbolBits = stegoSymbolBits((const unsigned char *)sentence, sentenceLength);
+    StegoStatus status = stegoCapacity(&image, stegoOptions, symbolBits, &capacity);
+
+    if (status == STEGO_OK && sentenceLength > capacity) status = STEGO_ERROR_TOO_LARGE;
+
+    if (status != STEGO_OK) {
+        fprintf(stderr, "%s: %s\n", fileName, stegoStatusString(status));
+        closeImage(&reader);
+        return false;
+    }
+
+    beginStage(&timer, STEGO_STAGE_LOAD);
+    bool loaded = readImageRows(&reader, &image, image.height);
+    closeImage(&reader);
+    endStage(&timer, loaded ? (uint64_t)image.height * image.stride : 0);
+
+    if (!loaded) {
+        fprintf(stderr, "Error loading image: %s\n", fileName);
+        freeImage(&image);
+        return false;
+    }
+
+    status = stegoEmbed(&image, (const unsigned char *)sentence, sentenceLength, stegoOptions, pool);
+
+    if (status != STEGO_OK) {
+        fprintf(stderr, "%s: %s\n", fileName, stegoStatusString(status));
+        freeImage(&image);
+        return false;
+    }
+
+    beginStage(&timer, STEGO_STAGE_WRITE);
+    bool written = createPng(outputFileName, &image, pngOptions);
+    endStage(&timer, (uint64_t)image.height * image.stride);
+
+    freeImage(&image);
+
+    return written;
+}
+
+
+bool streamEncode(char *fileName, const char *sentence, size_t sentenceLength, char *outputFileName, const PngOptions *pngOptions,
+                  const StegoOptions *stegoOptions, WorkerPool *pool) {
+    /*
+    Summary:
+        Encodes a message like encode(), but streams the carrier through libpng one row at a time: a row is read, the
+        slice of the header and payload that belongs to it is embedded, and the row is written to the output PNG
+        straight away. Only one row of pixels is held in memory, so peak memory does not depend on the image size.
+
+    Args:
+        fileName (char*): The name of the input image file to encode the message into.
+        sentence (const char*): The message to be encoded within the image. It may contain any bytes.
+        sentenceLength (size_t): The number of bytes in the message.
+        outputFileName (char*): The name of the output image file to save the encoded image.
+        pngOptions (const PngOptions*): The compression settings for the output PNG.
+        stegoOptions (const StegoOptions*): How the message is embedded, such as the bits used per channel byte.
+        pool (WorkerPool*): The pool used if the carrier has to go through encode() instead.
+
+    Return:
+        Returns true once the encoded image has been written to the output file, false otherwise.
+
+    Note:
+        Rows of an interlaced PNG are only final after the last pass, other formats have no row reader, and a scattered
+        payload may land in any row, so those carriers fall back to encode(), which holds the whole image in memory.
+        Errors are printed to stderr.
+    */
+
+    if (stegoOptions->scatter) return encode(fileName, sentence, sentenceLength, outputFileName, pngOptions, stegoOptions, pool);
+
+    FILE *input = fopen(fileName, "rb");
+    unsigned char signature[8];
+
+    if (!input) {
+        fprintf(stderr, "Error loading image: %s\n", fileName);
+        return false;
+    }
+
+    if (fread(signature, 1, 8, input) != 8 || png_sig_cmp(signature, 0, 8) != 0) {
+        fclose(input);
+        return encode(fileName, sentence, sentenceLength, outputFileName, pngOptions, stegoOptions, pool);
+    }
+
+    png_structp reader = createPngReader();
+    png_infop readInfo = reader ? png_create_info_struct(reader) : NULL;
+    png_structp volatile writer = NULL;
+    png_infop volatile writeInfo = NULL;
+    FILE *volatile output = NULL;
+    png_bytep volatile row = NULL;
+    unsigned char *volatile rowCarrier = NULL;
+    volatile bool written = false;
+
+    if (!readInfo) {
+        png_destroy_read_struct(&reader, NULL, NULL);
+        fclose(input);
+        return false;
+    }
+
+    if (setjmp(png_jmpbuf(reader))) {
+        fprintf(stderr, "Error reading %s\n", fileName);
+        goto cleanup;
+    }
+
+    png_init_io(reader, input);
+    png_set_sig_bytes(reader, 8);
+    png_read_info(reader, readInfo);
+
+    if (png_get_interlace_type(reader, readInfo) != PNG_INTERLACE_NONE) {
+        png_destroy_read_struct(&reader, &readInfo, NULL);
+        fclose(input);
+        return encode(fileName, sentence, sentenceLength, outputFileName, pngOptions, stegoOptions, pool);
+    }
+
+    // Match what stb_image hands to encode(): palettes, low bit depths and transparency expanded, 16-bit samples in
+    // host byte order
+    png_set_expand(reader);
+    swapPng16(reader, png_get_bit_depth(reader, readInfo));
+    png_read_update_info(reader, readInfo);
+
+    int bitDepth = png_get_bit_depth(reader, readInfo);
+    int colorType = png_get_color_type(reader, readInfo);
+    size_t rowBytes = png_get_rowbytes(reader, readInfo);
+    StegoImage line = {NULL, 1, (int)png_get_image_width(reader, readInfo), png_get_channels(reader, readInfo), rowBytes, bitDepth};
+    int height = (int)png_get_image_height(reader, readInfo);
+    size_t rowCarriers = carrierCount(&line);
+    bool contiguous = carrierIsContiguous(&line);
+    StegoHeader header;
+    unsigned char headerBytes[HEADER_BYTES];
+    StageTimer timer;
+
+    beginStage(&timer, STEGO_STAGE_HEADER);
+    initStegoHeader(&header, (const unsigned char *)sentence, sentenceLength, stegoOptions);
+    packStegoHeader(&header, headerBytes);
+    endStage(&timer, sentenceLength);
+
+    if (sentenceLength > payloadCapacity(&header, (size_t)height * rowCarriers)) {
+        fprintf(stderr, "Message is too large for %s\n", fileName);
+        goto cleanup;
+    }
+
+    row = (png_bytep)workAlloc(rowBytes);
+    rowCarrier = contiguous ? row : (unsigned char *)workAlloc(rowCarriers);
+    output = fopen(outputFileName, "wb");
+    writer = createPngWriter();
+    writeInfo = writer ? png_create_info_struct(writer) : NULL;
+
+    if (!row || !rowCarrier || !output || !writeInfo) {
+        fprintf(stderr, "Error opening file: %s\n", outputFileName);
+        goto cleanup;
+    }
+
+    if (setjmp(png_jmpbuf(writer))) {
+        fprintf(stderr, "Error writing %s\n", outputFileName);
+        goto cleanup;
+    }
+
+    png_init_io(writer, output);
+    png_set_IHDR(writer, writeInfo, line.width, height, bitDepth, colorType, PNG_INTERLACE_NONE, PNG_COMPRESSION_TYPE_DEFAULT,
+                 PNG_FILTER_TYPE_DEFAULT);
+    applyPngOptions(writer, pngOptions);
+    png_write_info(writer, writeInfo);
+    swapPng16(writer, bitDepth);
+    line.pixels = row;
+
+    for (int y = 0; y < height; y++) {
+        beginStage(&timer, STEGO_STAGE_LOAD);
+        png_read_row(reader, row, NULL);
+        endStage(&timer, rowBytes);
+
+        beginStage(&timer, STEGO_STAGE_EMBED);
+
+        if (!contiguous) gatherCarrier(&line, 0, rowCarriers, rowCarrier);
+
+        embedRange(rowCarrier, (size_t)y * rowCarriers, rowCarriers, headerBytes, &header, (const unsigned char *)sentence);
+
+        if (!contiguous) scatterCarrier(&line, 0, rowCarriers, rowCarrier);
+
+        endStage(&timer, 0);
+
+        beginStage(&timer, STEGO_STAGE_WRITE);
+        png_write_row(writer, row);
+        endStage(&timer, rowBytes);
+    }
+
+    // Each row embeds a slice of the payload whose size depends on the row, so the stage gets the total instead
+    countStageBytes(STEGO_STAGE_EMBED, sentenceLength);
+    beginStage(&timer, STEGO_STAGE_LOAD);
+    png_read_end(reader, NULL);
+    endStage(&timer, 0);
+    beginStage(&timer, STEGO_STAGE_WRITE);
+    png_write_end(writer, NULL);
+    endStage(&timer, 0);
+    written = true;
+
+cleanup:
+    png_destroy_read_struct(&reader, &readInfo, NULL);
+
+    png_structp writeStruct = writer;
+    png_infop writeInfoStruct = writeInfo;
+
+    if (writeStruct) png_destroy_write_struct(&writeStruct, writeInfoStruct ? &writeInfoStruct : NULL);
+
+    if (output && fclose(output) != 0) written = false;
+
+    if (rowCarrier != row) workFree(rowCarrier);
+
+    workFree(row);
+    fclose(input);
+
+    return written;
+}
+
+bool decode(char *outputPictureFileName, char *outputTextFileName, Buffer *scratch, size_t *length,
+            const StegoOptions *stegoOptions, WorkerPool *pool) {
+    /*
+    Summary:
+        Decodes a message hidden within the least significant bits of each pixel in an encoded image and writes the decoded 
+        message to an output file, as it is extracted by extractImage(). The output file is only created once the image
+        has been found to hold a message, so a failed decode leaves an existing file with that name alone.
+
+    Args:
+        outputPictureFileName (char*): The name of the image file containing the encoded message.
+        outputTextFileName (char*): The name of the output file where the decoded message will be saved.
+        scratch (Buffer*): The buffer each chunk of the message is extracted into; it is grown to at most DECODE_CHUNK
+            bytes and released by the caller.
+        length (size_t*): Receives the length of the decoded message, after decompression if it was compressed.
+        stegoOptions (const StegoOptions*): The key to use if the message is scattered; the rest comes from the header.
+        pool (WorkerPool*): The pool the extraction runs on.
+
+    Return:
+        Returns true once the message has been decoded and written to the specified file, false otherwise.
+
+    Note:
+        If the image cannot be loaded, holds no message, holds one shard of a split payload (see reassemble()) or
+        memory allocation fails, an error is printed to stderr and no output file is written. If the message turns out
+        to be damaged once it has been written, the output file is removed again.
+    */
+
+    DecodedFile decodedFile = {outputTextFileName, NULL, 0, false};
+    bool extracted = extractImage(outputPictureFileName, scratch, stegoOptions, false, writeDecoded, &decodedFile,
+                                  &decodedFile.failed, pool);
+
+    // An empty message never reaches the sink, but still gets its (empty) file
+    if (extracted && !decodedFile.file) writeDecoded(&decodedFile, NULL, 0);
+
+    if (decodedFile.file && fclose(decodedFile.file) != 0 && !decodedFile.failed) {
+        fprintf(stderr, "Error writing %s\n", outputTextFileName);
+        decodedFile.failed = true;
+    }
+
+    if (!extracted || decodedFile.failed) {
+        if (decodedFile.file) remove(outputTextFileName);
+
+        return false;
+    }
+
+    *length = decodedFile.length;
+
+    return true;
+}
+
+bool extractImage(char *pictureFileName, Buffer *scratch, const StegoOptions *stegoOptions, bool sharded,
+                  PayloadSink sink, void *context, const bool *sinkFailed, WorkerPool *pool) {
+    /*
+    Summary:
+        Extracts the message hidden in an image and hands it to a sink as it comes out. The header at the start of the
+        image is read first; it gives the exact length of the message, so decoding stops at the last row that holds
+        it, and the rest of the image is never inflated. The message is extracted at most DECODE_CHUNK bytes at a time
+        while its checksum is computed, so even a very large message never has to be held in memory whole. When the
+        image is decoded row by row (a PNG that is not interlaced) and the message is stored in order, the extraction
+        follows the decoder down the image through a window of about DECODE_WINDOW carrier bytes: rows are extracted
+        while they are still in cache, and dropped once extracted, so the image is never held whole either. A message
+        compressed before embedding (see packPayload()) is inflated on the way to the sink, following the codec
+        recorded in the header.
+
+    Args:
+        pictureFileName (char*): The name of the image file containing the encoded message.
+        scratch (Buffer*): The buffer each chunk of the message is extracted into; it is grown to at most DECODE_CHUNK
+            bytes and released by the caller.
+        stegoOptions (const StegoOptions*): The key to use if the message is scattered; the rest comes from the header.
+        sharded (bool): Whether the image must hold one shard of a split payload (true) or a whole message (false).
+        sink (PayloadSink): Called with every piece of the message in order; it may stop extraction by returning false.
+        context (void*): Passed to the sink.
+        sinkFailed (const bool*): The flag the sink sets when it fails, so its own failures, which it reports itself,
+            are not reported as a damaged message.
+        pool (WorkerPool*): The pool the extraction runs on.
+
+    Return:
+        Returns true once the whole message has passed through the sink and its checksum matches, false otherwise.
+
+    Note:
+        PNGs are decoded with libpng and other formats with stb_image (see openImage()). Other formats, interlaced
+        PNGs and scattered messages are decoded up to the last row of the message first and extracted afterwards. If
+        the image cannot be loaded, holds no message or the wrong kind of message, memory allocation fails or the
+        message is damaged, an error is printed to stderr. The sink may already have been given part of the message
+        when the damage is found, so whatever it wrote must be discarded when false is returned.
+    */
+
+    StegoImage image;
+    StegoHeader header;
+    ImageReader reader;
+    StageTimer timer;
+
+    beginStage(&timer, STEGO_STAGE_LOAD);
+    bool loaded = openImage(pictureFileName, &reader, &image);
+    size_t rowCarriers = loaded ? carrierCount(&image) / image.height : 0;
+
+    // The header only needs its first HEADER_BITS carrier bytes, a row or two of most images
+    if (loaded && !readImageRows(&reader, &image, (int)((HEADER_BITS + rowCarriers - 1) / rowCarriers))) {
+        closeImage(&reader);
+        freeImage(&image);
+        loaded = false;
+    }
+
+    endStage(&timer, loaded ? (uint64_t)reader.rows * image.stride : 0);
+
+    if (!loaded) {
+        fprintf(stderr, "Error loading image: %s\n", pictureFileName);
+        return false;
+    }
+
+    StegoStatus status = stegoReadHeader(&image, &header);
+
+    if (status == STEGO_OK) status = stegoUseKey(&header, stegoOptions);
+
+    if (status != STEGO_OK) {
+        fprintf(stderr, "%s: %s\n", pictureFileName, stegoStatusString(status));
+        closeImage(&reader);
+        freeImage(&image);
+        return false;
+    }
+
+    if (((header.flags & STEGO_FLAG_SHARD) != 0) != sharded) {
+        if (sharded) fprintf(stderr, "%s: holds a whole message, not a shard of a split payload\n", pictureFileName);
+        else fprintf(stderr, "%s: holds one shard of a split payload; reassemble it with -R\n", pictureFileName);
+
+        closeImage(&reader);
+        freeImage(&image);
+        return false;
+    }
+
+    int messageRows = (int)((messageCarriers(&header, carrierCount(&image)) + rowCarriers - 1) / rowCarriers);
+    bool streaming = reader.incremental && !(header.flags & STEGO_FLAG_SCATTER);
+    int windowRows = (int)((DECODE_WINDOW + rowCarriers - 1) / rowCarriers) + 1;
+    int codec = (header.flags & STEGO_FLAG_CODEC_MASK) >> STEGO_FLAG_CODEC_SHIFT;
+    PayloadDecoder decoder;
+
+    if (!reserveBuffer(scratch, header.payloadLength < DECODE_CHUNK ? header.payloadLength : DECODE_CHUNK) ||
+        !initPayloadDecoder(&decoder, codec)) {
+        fprintf(stderr, "Memory allocation failed\n");
+        closeImage(&reader);
+        freeImage(&image);
+        return false;
+    }
+
+    uint32_t checksum = 0;
+    bool written = true;
+    size_t count = 0;
+
+    for (size_t offset = 0; offset < header.payloadLength && loaded && written; offset += count) {
+        size_t carrier = (header.flags & STEGO_FLAG_SCATTER ? 0 : HEADER_BITS) +
+                         offset * header.symbolBits / header.bitsPerChannel;
+        int decoded = reader.rows;
+
+        // Without streaming the first pass decodes every row of the message, and the later ones find them all there
+        if (streaming) dropImageRows(&reader, &image, (int)(carrier / rowCarriers));
+
+        beginStage(&timer, STEGO_STAGE_LOAD);
+        loaded = readImageRows(&reader, &image, streaming && reader.firstRow + windowRows < messageRows ?
+                                                    reader.firstRow + windowRows : messageRows);
+        endStage(&timer, loaded ? (uint64_t)(reader.rows - decoded) * image.stride : 0);
+
+        if (!loaded) break;
+
+        // Whole groups of bitsPerChannel bytes fill whole carrier bytes, so every step starts on a carrier byte
+        StegoImage window = image;
+        size_t available = (size_t)reader.rows * rowCarriers - carrier;
+        size_t remaining = header.payloadLength - offset;
+        size_t fits = available / header.symbolBits * header.bitsPerChannel;
+
+        window.height = reader.rows - reader.firstRow;
+        count = remaining < DECODE_CHUNK ? remaining : DECODE_CHUNK;
+
+        if (count > fits && messageCarriers(&header, carrierCount(&image)) > (size_t)reader.rows * rowCarriers) {
+            count = fits;
+        }
+
+        beginStage(&timer, STEGO_STAGE_EXTRACT);
+        checksum = extractWindow(&window, (size_t)reader.firstRow * rowCarriers, &header, offset, count, scratch->bytes,
+                                 checksum, pool);
+        endStage(&timer, count);
+
+        // A compressed message is inflated and written as it comes out, so it is never held whole either
+        beginStage(&timer, codec == STEGO_CODEC_NONE ? STEGO_STAGE_WRITE : STEGO_STAGE_CODEC);
+        written = decodePayload(&decoder, scratch->bytes, count, sink, context);
+        endStage(&timer, count);
+    }
+
+    bool complete = finishPayloadDecoder(&decoder);
+
+    closeImage(&reader);
+    freeImage(&image);
+
+    if (!loaded) {
+        fprintf(stderr, "Error loading image: %s\n", pictureFileName);
+        return false;
+    }
+
+    if (*sinkFailed) return false;
+
+    // Compressed data that does not inflate cleanly is damaged, and may not even have been extracted to the end
+    if (!written || !complete || checksum != header.checksum) {
+        fprintf(stderr, "%s: %s\n", pictureFileName, stegoStatusString(STEGO_ERROR_CHECKSUM));
+        return false;
+    }
+
+    return true;
+}
+
+bool reserveBuffer(Buffer *buffer, size_t size) {
+    /*
+    Summary:
+        Makes sure a growable buffer holds at least size + 1 bytes, so callers can always NUL-terminate what they put
+        in it. The buffer only ever grows, to at least double its previous capacity. It is working memory, so while an
+        arena is attached it grows in place inside the arena, and it is released with workFree().
+
+    Args:
+        buffer (Buffer*): The buffer to grow. A zeroed Buffer is a valid empty buffer.
+        size (size_t): The number of bytes that must fit, not counting the terminator.
+
+    Return:
+        Returns true if the buffer is large enough, false if memory allocation fails; the old contents are kept either way.
+    */
+
+    if (size < buffer->capacity) return true;
+
+    size_t capacity = buffer->capacity * 2 > size + 1 ? buffer->capacity * 2 : size + 1;
+    unsigned char *bytes = (unsigned char *)workRealloc(buffer->bytes, capacity);
+
+    if (!bytes) return false;
+
+    buffer->bytes = bytes;
+    buffer->capacity = capacity;
+
+    return true;
+}
+
+bool readTextFromFile(char *inputTextFileName, Buffer *buffer, size_t *length) {
+    /*
+    Summary:
+        Reads the contents of a file into a growable buffer. The file is opened in binary mode and read in blocks until
+        its end, growing the buffer as needed, so pipes and other files whose size is not known up front work too. The
+        content is NUL-terminated, but may also contain NUL bytes, so the length is returned separately.
+
+    Args:
+        inputTextFileName (char*): The name of the input file to be read.
+        buffer (Buffer*): The buffer that receives the content. It is owned by the caller and can be reused across
+            files.
+        length (size_t*): Receives the number of bytes read.
+
+    Return:
+        Returns true if the file was read, false if it cannot be opened or read, or memory allocation fails.
+
+    Note:
+        If any error occurs (file not found, memory allocation failure), an appropriate error message is printed to 
+        stderr, and the function returns false.
+    */
+
+    FILE *inputFile = fopen(inputTextFileName, "rb");
+
+    if (inputFile == NULL) {
+        fprintf(stderr, "Error opening file: %s\n", inputTextFileName);
+        return false;
+    }
+
+    *length = 0;
+
+    while (true) {
+        if (!reserveBuffer(buffer, *length + 65536)) {
+            fprintf(stderr, "Memory allocation failed\n");
+            fclose(inputFile);
+            return false;
+        }
+
+        size_t count = fread(buffer->bytes + *length, 1, buffer->capacity - 1 - *length, inputFile);
+
+        *length += count;
+
+        if (count == 0) break;
+    }
+
+    bool failed = ferror(inputFile);
+
+    fclose(inputFile);
+    buffer->bytes[*length] = '\0';
+
+    if (failed) fprintf(stderr, "Error reading %s\n", inputTextFileName);
+
+    return !failed;
+}
+
+bool openPayload(char *fileName, Buffer *fallback, Payload *payload) {
+    /*
+    Summary:
+        Makes the contents of a payload file available for embedding. Regular files are memory-mapped read-only, so the
+        embedder reads the payload straight from the page cache and no copy of it is ever made. Anything that cannot be
+        mapped, such as a pipe, is read into the fallback buffer with readTextFromFile() instead.
+
+    Args:
+        fileName (char*): The name of the payload file.
+        fallback (Buffer*): The buffer used when the file cannot be mapped; owned by the caller and reusable.
+        payload (Payload*): Receives the payload bytes and length.
+
+    Return:
+        Returns true if the payload is available, false otherwise (an error has been printed to stderr). Either way
+        the payload must be released with closePayload().
+    */
+
+    int fd = open(fileName, O_RDONLY);
+    struct stat status;
+    StageTimer timer;
+
+    beginStage(&timer, STEGO_STAGE_PAYLOAD);
+    payload->bytes = NULL;
+    payload->length = 0;
+    payload->mapped = false;
+
+    if (fd >= 0 && fstat(fd, &status) == 0 && S_ISREG(status.st_mode) && status.st_size > 0) {
+        void *bytes = mmap(NULL, (size_t)status.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+
+        if (bytes != MAP_FAILED) {
+            madvise(bytes, (size_t)status.st_size, MADV_SEQUENTIAL);
+            payload->bytes = (const unsigned char *)bytes;
+            payload->length = (size_t)status.st_size;
+            payload->mapped = true;
+            close(fd);
+            endStage(&timer, payload->length);
+
+            return true;
+        }
+    }
+
+    if (fd >= 0) close(fd);
+
+    bool read = readTextFromFile(fileName, fallback, &payload->length);
+
+    endStage(&timer, payload->length);
+
+    if (!read) return false;
+
+    payload->bytes = fallback->bytes;
+
+    return true;
+}
+
+void closePayload(Payload *payload) {
+    /*
+    Summary:
+        Releases a payload opened with openPayload(). A mapped file is unmapped; a payload read into the fallback
+        buffer is left there for the buffer's owner to reuse or free.
+
+    Args:
+        payload (Payload*): The payload to release.
+
+    Return:
+        This function does not return any value.
     */
 
-    if (argc != 4) {
-        printf("Not enough arguements\n");
-	return 1;
-    }
+    if (payload->mapped) munmap((void *)payload->bytes, payload->length);
 
-    char *option = argv[1];
-    char *pictureFileName = argv[2];
-    char *outputFileName = getOutputFileName(pictureFileName);
-    char *textFileName = argv[3];
-
-    if (strcmp("-e", option) == 0 && argc == 4) {
-        char *sentenceToEncode = readTextFromFile(textFileName);
-        encode(pictureFileName, sentenceToEncode, outputFileName);
-        free(sentenceToEncode);
-    } else if (strcmp("-d", option) == 0 && argc == 4) {
-        decode(argv[2], argv[3]);
-        free(outputFileName);
-    } else printf("Invalid Option\n");
-
-    return 0;
+    payload->bytes = NULL;
+    payload->length = 0;
+    payload->mapped = false;
 }
 
-unsigned char ***dynamicArray(int height, int width, int channels) {
+bool packPayload(Payload *payload, Buffer *packed, StegoOptions *stegoOptions) {
     /*
     Summary:
-        Returns a pointer to an allocated 3D array, where the innermost array has a tuple of 3 (RGB) values that is 
-        supposed to represent all the pixels in the array.
+        Compresses an opened payload with the codec chosen in the options, between reading it and embedding it, so
+        compressible payloads such as logs and JSON need fewer carrier bytes and less embedding work. The payload is
+        then replaced by its compressed form. Without a codec, or if compressing does not make it smaller, it is left
+        as it is.
 
     Args:
-        height (int): Represnts the height of the image
-        width (int): Represnts the width of the image
-        channels (int): Represnts 3 RGB values, and channels is usually 3
+        payload (Payload*): The payload opened with openPayload(). On success it refers to the packed buffer, and its
+            mapping, if any, has already been released.
+        packed (Buffer*): The buffer that receives the compressed payload; owned by the caller and reusable.
+        stegoOptions (StegoOptions*): The codec and its level; the codec is reset to STEGO_CODEC_NONE if the payload
+            is embedded uncompressed, so the header matches.
 
-    Returns:
-        Returns a pointer to the allocated 3D array on the heap. Memory must be freed.
+    Return:
+        Returns true if the payload is ready to embed, false if compression failed (an error has been printed to
+        stderr). Either way the payload must still be released with closePayload().
     */
 
-    unsigned char ***imageArray = (unsigned char ***)malloc(height * sizeof(unsigned char **));
+    if (stegoOptions->codec == STEGO_CODEC_NONE) return true;
 
-    if (!imageArray) {
-        fprintf(stderr, "Memory allocation failed\n");
-        exit(1);
-    }
+    size_t length = 0;
+    StageTimer timer;
 
-    for (int x = 0; x < height; x++) {
-        imageArray[x] = (unsigned char **)malloc(width * sizeof(unsigned char *));
-        
-        if (!imageArray[x]) {
-            fprintf(stderr, "Memory allocation failed\n");
-            exit(1);
-        }
+    beginStage(&timer, STEGO_STAGE_CODEC);
+    bool compressed = reserveBuffer(packed, compressedBound(stegoOptions->codec, payload->length)) &&
+                      compressPayload(stegoOptions->codec, stegoOptions->codecLevel, payload->bytes, payload->length,
+                                      packed->bytes, packed->capacity, &length);
+    endStage(&timer, payload->length);
 
-        for (int y = 0; y < width; y++) {
-            imageArray[x][y] = (unsigned char *)malloc(channels * sizeof(unsigned char));
-            
-            if (!imageArray[x][y]) {
-                fprintf(stderr, "Memory allocation failed\n");
-                exit(1);
-            }
-        }
+    if (!compressed) {
+        fprintf(stderr, "Error compressing the message with %s\n", codecName(stegoOptions->codec));
+        return false;
+    }
+
+    if (length >= payload->length) {
+        stegoOptions->codec = STEGO_CODEC_NONE;
+        return true;
     }
 
-    return imageArray;
+    closePayload(payload);
+    payload->bytes = packed->bytes;
+    payload->length = length;
+
+    return true;
 }
 
-void loadPixelData(unsigned char ***imageArray, unsigned char *image, int height, int width, int channels) {
+bool writeDecoded(void *context, const unsigned char *bytes, size_t length) {
     /*
     Summary:
-        Returns a pointer to an allocated 3D array, where the innermost array has a tuple of 3 (RGB) values. Meaning at
-        array[0][0][0] is the first red pixel value, at array[0][0][1] the array[0][0][1] is the first green pixel
-        value, the array[0][0][2] is teh first blue pixel.
+        The sink decode() hands the message to: writes it to the output file and counts it. The file is created on
+        the first call, once extraction has got as far as producing part of the message.
 
     Args:
-        imageArray (unsigned char 3D image array): Represnts the image as a 3D array of RGB values
-        image (unsigned char linear array): Represents the image as a linear
-        height (int): Represents the height of the image
-        width (int): Represents the width of the image
-        channels (int): Represents the 3 RGB values (typically 3)
+        context (void*): The DecodedFile to write to; a failure to create or write the file is recorded in it and
+            reported on stderr.
+        bytes (const unsigned char*): The next bytes of the message.
+        length (size_t): The number of bytes.
 
     Return:
-        A void return that modifies the array in place that converts the 1D image array into a 3D image array
+        Returns true if the bytes were written, false otherwise.
     */
-    
-    for (int x = 0; x < height; x++) {
-        for (int y = 0; y < width; y++) {
-            for (int channel = 0; channel < channels; channel++) {
-                imageArray[x][y][channel] = image[(x * width + y) * channels + channel];
-            }
+
+    DecodedFile *decoded = (DecodedFile *)context;
+
+    if (!decoded->file && !decoded->failed) {
+        decoded->file = fopen(decoded->fileName, "wb");
+
+        if (!decoded->file) {
+            fprintf(stderr, "Error opening file: %s\n", decoded->fileName);
+            decoded->failed = true;
         }
     }
+
+    if (decoded->failed) return false;
+
+    decoded->length += length;
+
+    if (length > 0 && fwrite(bytes, 1, length, decoded->file) != length) {
+        fprintf(stderr, "Error writing %s\n", decoded->fileName);
+        decoded->failed = true;
+    }
+
+    return !decoded->failed;
 }
 
-void printArray(unsigned char ***imageArray, int height, int width, int channels) {
+bool reportCapacity(char *fileName, const StegoOptions *stegoOptions) {
     /*
     Summary:
-        Prints the RGB values of each pixel in a 3D image array. For each pixel, the Red (R), Green (G), and Blue (B)
-        values are printed in the format "R: value | G: value | B: value".
-    
+        Prints one CSV row with the layout of an image and the largest payload it can hold in every embedding mode:
+        ASCII text (7 bits per character) and binary data (8 bits per byte), at 1 to 4 bits per channel. Only the
+        image header is read, so whole directories of carriers can be planned for quickly.
+
     Args:
-        imageArray (unsigned char 3D image array): Represents the image as a 3D array of RGB values. 
-        height (int): Represents the height of the image (number of rows of pixels).
-        width (int): Represents the width of the image (number of columns of pixels).
-        channels (int): Represents the number of channels per pixel, typically 3 for RGB.
+        fileName (char*): The image to report on.
+        stegoOptions (const StegoOptions*): The scatter settings to report for; the bits per channel are varied.
 
     Return:
-        This function does not return any value; it prints the RGB values for each pixel to the console.
+        Returns true if the row was printed, false if the image header could not be read (an error goes to stderr).
     */
 
-    for (int x = 0; x < height; x++) {
-        for (int y = 0; y < width; y++) {
-            printf("R: %d | G: %d | B: %d\n", imageArray[x][y][0], imageArray[x][y][1], imageArray[x][y][2]);
+    StegoImage image;
+    StegoOptions options = *stegoOptions;
+
+    if (!readImageInfo(fileName, &image)) {
+        fprintf(stderr, "Error loading image: %s\n", fileName);
+        return false;
+    }
+
+    printf("%s,%d,%d,%d,%d", fileName, image.width, image.height, image.channels, image.bitDepth);
+
+    for (int bits = 1; bits <= 4; bits++) {
+        for (int symbolBits = 7; symbolBits <= 8; symbolBits++) {
+            size_t capacity = 0;
+
+            options.bitsPerChannel = bits;
+            stegoCapacity(&image, &options, symbolBits, &capacity);
+            printf(",%zu", capacity);
         }
     }
-    
+
     printf("\n");
+
+    return true;
 }
 
-void free3DDynamicArray(unsigned char ***imageArray, int height, int width, int channels) {
+static double elapsedSeconds(struct timespec *start) {
     /*
     Summary:
-        Frees the memory allocated for a 3D image array. This function deallocates the memory row by row, and then frees
-        the entire array, preventing memory leaks.
+        Returns the time elapsed since start on the monotonic clock.
 
     Args:
-        imageArray (unsigned char 3D image array): The dynamically allocated 3D array of RGB values to be freed.
-        height (int): The height of the image (number of rows of pixels).
-        width (int): The width of the image (number of columns of pixels).
-        channels (int): The number of channels per pixel, typically 3 for RGB.
+        start (struct timespec*): The starting point, taken with clock_gettime(CLOCK_MONOTONIC).
 
     Return:
-        This function does not return any value; it frees the memory of the image array.
+        Returns the elapsed time in seconds.
     */
 
-    for (int x = 0; x < height; x++) {
-        for (int y = 0; y < width; y++) free(imageArray[x][y]);
-        free(imageArray[x]);
-    }
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
 
-    free(imageArray);
+    return (double)(now.tv_sec - start->tv_sec) + (double)(now.tv_nsec - start->tv_nsec) / 1e9;
 }
 
-void swap(int *x, int *y) {
+void benchmark(char *fileName) {
     /*
     Summary:
-        Swaps the values of two integers. This function exchanges the values of the two given integers using a temporary variable.
+        Measures how embedding and extraction scale with the number of threads, and how fast each PNG output preset
+        writes. A message that fills the whole image is embedded as 7-bit text and extracted with 1, 2, 4, ... 64
+        threads, and one CSV line is printed per thread count with the time taken and the carrier throughput in MB/s.
+        The encoded image is then compressed in memory with every preset, and a second CSV table gives the write
+        throughput (raw pixel MB/s) against the resulting file size. Finally the same message is embedded and extracted
+        on one thread with 1 to 4 bits per channel byte, with throughput given in payload MB/s. PNG loading and file
+        I/O are not included.
 
     Args:
-        x (int*): Pointer to the first integer.
-        y (int*): Pointer to the second integer.
+        fileName (char*): The image to use as the carrier.
 
     Return:
-        This function does not return any value; it swaps the values of the two integers in place.
+        This function does not return any value; it prints the results to stdout.
     */
 
-    int temp = *x;
-    *x = *y;
-    *y = temp;
+    StegoImage image;
+
+    if (!loadImage(fileName, &image)) {
+        fprintf(stderr, "Error loading image\n");
+        return;
+    }
+
+    size_t imageBytes = carrierCount(&image);
+    size_t length = imageBytes > HEADER_BITS ? (imageBytes - HEADER_BITS) / 7 : 0;
+    unsigned char *message = (unsigned char *)malloc(length + 1);
+    unsigned char *output = (unsigned char *)malloc(length + 1);
+
+    if (!message || !output) {
+        fprintf(stderr, "Memory allocation failed\n");
+        free(message);
+        free(output);
+        freeImage(&image);
+        return;
+    }
+
+    for (size_t index = 0; index < length; index++) message[index] = (unsigned char)(' ' + index % 95);
+
+    StegoHeader header;
+
+    initStegoHeader(&header, message, length, NULL);
+
+    printf("kernel,threads,embed_ms,embed_MBps,extract_ms,extract_MBps\n");
+
+    for (int threads = 1; threads <= 64; threads *= 2) {
+        WorkerPool *pool = createWorkerPool(threads);
+        struct timespec start;
+
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        embedMessage(&image, &header, message, pool);
+        double embedSeconds = elapsedSeconds(&start);
+
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        extractMessage(&image, &header, output, pool);
+        double extractSeconds = elapsedSeconds(&start);
+
+        if (memcmp(message, output, length) != 0) fprintf(stderr, "Round trip failed with %d threads\n", threads);
+
+        printf("%s,%d,%.2f,%.0f,%.2f,%.0f\n", lsbKernelName(), threads, embedSeconds * 1e3, imageBytes / embedSeconds / 1e6,
+               extractSeconds * 1e3, imageBytes / extractSeconds / 1e6);
+
+        destroyWorkerPool(pool);
+    }
+
+    const char *presets[] = {"none", "fast", "default", "small"};
+
+    printf("\npreset,write_ms,write_MBps,bytes,ratio\n");
+
+    for (int preset = 0; preset < 4; preset++) {
+        PngOptions pngOptions;
+        struct timespec start;
+        size_t bytes;
+
+        parsePngPreset(presets[preset], &pngOptions);
+        clock_gettime(CLOCK_MONOTONIC, &start);
+
+        if (!measurePngWrite(&image, &pngOptions, &bytes)) continue;
+
+        double writeSeconds = elapsedSeconds(&start);
+
+        printf("%s,%.2f,%.1f,%zu,%.3f\n", presets[preset], writeSeconds * 1e3, imageBytes / writeSeconds / 1e6, bytes,
+               (double)bytes / imageBytes);
+    }
+
+    printf("\nbits,embed_ms,embed_MBps,extract_ms,extract_MBps\n");
+
+    for (int bits = 1; bits <= 4; bits++) {
+        StegoOptions options;
+        struct timespec start;
+
+        initStegoOptions(&options);
+        options.bitsPerChannel = bits;
+        initStegoHeader(&header, message, length, &options);
+
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        embedMessage(&image, &header, message, NULL);
+        double embedSeconds = elapsedSeconds(&start);
+
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        extractMessage(&image, &header, output, NULL);
+        double extractSeconds = elapsedSeconds(&start);
+
+        if (memcmp(message, output, length) != 0) fprintf(stderr, "Round trip failed with %d bits per channel\n", bits);
+
+        printf("%d,%.2f,%.1f,%.2f,%.1f\n", bits, embedSeconds * 1e3, length / embedSeconds / 1e6, extractSeconds * 1e3,
+               length / extractSeconds / 1e6);
+    }
+
+    free(message);
+    free(output);
+    freeImage(&image);
 }
 
-int *convertCharToBinary(unsigned char character, int length) {
+size_t readManifest(char *manifestFileName, BatchItem **items) {
     /*
     Summary:
-        Converts a given character to its 7-bit binary representation (ASCII). The function dynamically allocates an array
-        to store the binary digits and returns the array. The binary digits are ordered from most significant bit to 
-        least significant bit.
+        Reads a batch manifest: one job per line, holding an image path and a payload path (when encoding) or an output
+        path (when decoding). The two paths are separated by a tab, or by whitespace if the line has no tab, so paths
+        with spaces work in tab-separated manifests. Blank lines and lines starting with '#' are skipped.
 
     Args:
-        character (char): The character to be converted to binary.
+        manifestFileName (char*): The manifest to read, or "-" to read it from stdin.
+        items (BatchItem**): Receives a dynamically allocated array of jobs. Each path is allocated separately; the
+            caller frees the paths and the array.
 
     Return:
-        Returns a pointer to an integer array containing the 7-bit binary representation of the character.
-        The caller is responsible for freeing the allocated memory after use.
+        Returns the number of jobs read. Malformed lines are reported on stderr and skipped; on an I/O or memory error
+        the jobs read so far are returned.
     */
 
-    int *binaryArray = (int *)malloc(length * sizeof(int));
-    
-    if (!binaryArray) {
-        fprintf(stderr, "Memory allocation failed\n");
-        exit(1);
-    }
+    FILE *manifest = strcmp(manifestFileName, "-") == 0 ? stdin : fopen(manifestFileName, "r");
+    char *line = NULL;
+    size_t lineCapacity = 0;
+    size_t count = 0;
+    size_t capacity = 0;
+    size_t lineNumber = 0;
+    ssize_t lineLength;
 
-    int index = 0;
-    int characterAsASCII = (int)character;
+    *items = NULL;
 
-    while (characterAsASCII) {
-        binaryArray[index] = characterAsASCII % 2;
-        characterAsASCII /= 2;
-        index++;
+    if (!manifest) {
+        fprintf(stderr, "Error opening file: %s\n", manifestFileName);
+        return 0;
     }
 
-    while (index < length) {
-        binaryArray[index++] = 0;
+    while ((lineLength = getline(&line, &lineCapacity, manifest)) >= 0) {
+        lineNumber++;
+
+        while (lineLength > 0 && (line[lineLength - 1] == '\n' || line[lineLength - 1] == '\r')) line[--lineLength] = '\0';
+
+        char *picture = line + strspn(line, " \t");
+
+        if (*picture == '\0' || *picture == '#') continue;
+
+        char *separator = strchr(picture, '\t');
+
+        if (!separator) separator = picture + strcspn(picture, " ");
+
+        char *text = separator + strspn(separator, " \t");
+
+        *separator = '\0';
+
+        if (*text == '\0') {
+            fprintf(stderr, "%s:%zu: expected an image path and a text path\n", manifestFileName, lineNumber);
+            continue;
+        }
+
+        if (count == capacity) {
+            size_t grown = capacity ? capacity * 2 : 64;
+            BatchItem *resized = (BatchItem *)realloc(*items, grown * sizeof(BatchItem));
+
+            if (!resized) break;
+
+            *items = resized;
+            capacity = grown;
+        }
+
+        (*items)[count].pictureFileName = strdup(picture);
+        (*items)[count].textFileName = strdup(text);
+
+        if (!(*items)[count].pictureFileName || !(*items)[count].textFileName) {
+            free((*items)[count].pictureFileName);
+            free((*items)[count].textFileName);
+            break;
+        }
+
+        count++;
     }
 
-    reverseArray(binaryArray, length);
+    free(line);
 
-    return binaryArray;
+    if (manifest != stdin) fclose(manifest);
+
+    return count;
 }
 
-void reverseArray(int *array, int length) {
+static void batchItem(void *context, size_t chunk, int worker) {
     /*
     Summary:
-        Reverses the elements of an integer array in place. The function swaps the elements from the front and back
-        of the array until it reaches the middle, effectively reversing the order of the elements.
+        Encodes or decodes one manifest entry and prints its status line. Each entry runs on a single thread; the
+        parallelism of a batch comes from running many entries at once, which scales better than splitting small
+        images into chunks.
 
     Args:
-        array (int*): Pointer to the array to be reversed.
-        length (int): The number of elements in the array.
+        context (void*): The BatchJob describing the manifest and settings.
+        chunk (size_t): The index of the manifest entry to process.
+        worker (int): The index of the running thread, which selects the arena the entry's working memory comes from.
 
     Return:
-        This function does not return any value; it reverses the array in place.
+        This function does not return any value; failures are counted in the job and never stop the batch.
     */
 
-    int middle = length / 2;
+    BatchJob *job = (BatchJob *)context;
+    BatchItem *item = &job->items[chunk];
+    Arena *arena = &job->arenas[worker];
+    Buffer buffer = {NULL, 0};
+    Buffer packed = {NULL, 0};
+    StegoOptions stegoOptions = *job->stegoOptions;
+    StegoStats stats;
+    struct timespec start;
+    size_t length = 0;
+    bool ok;
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    attachArena(arena);
+
+    if (job->stats) stegoStatsBegin(&stats);
+
+    if (job->encoding) {
+        char *outputFileName = getOutputFileName(item->pictureFileName);
+        Payload payload = {NULL, 0, false};
 
-    for (int front = 0, back = length - 1; front < middle; front++, back--) {
-        swap(&array[front], &array[back]);
+        ok = outputFileName && openPayload(item->textFileName, &buffer, &payload) &&
+             packPayload(&payload, &packed, &stegoOptions);
+
+        if (ok && job->streaming) ok = streamEncode(item->pictureFileName, (const char *)payload.bytes, payload.length, outputFileName, job->pngOptions, &stegoOptions, NULL);
+        else if (ok) ok = encode(item->pictureFileName, (const char *)payload.bytes, payload.length, outputFileName, job->pngOptions, &stegoOptions, NULL);
+
+        length = payload.length;
+        closePayload(&payload);
+    } else ok = decode(item->pictureFileName, item->textFileName, &buffer, &length, job->stegoOptions, NULL);
+
+    if (job->stats) {
+        stegoStatsEnd();
+        printStats(item->pictureFileName, job->encoding ? "encode" : "decode", ok, &stats);
+    }
+
+    if (ok) {
+        atomic_fetch_add(&job->bytes, length);
+        printf("ok\t%s\t%zu bytes\t%.1f ms\n", item->pictureFileName, length, elapsedSeconds(&start) * 1000.0);
+    } else {
+        atomic_fetch_add(&job->failures, 1);
+        printf("FAILED\t%s\n", item->pictureFileName);
     }
+
+    // The output name, the payload or scratch buffer and everything the codecs allocated go at once
+    attachArena(NULL);
+    resetArena(arena);
 }
 
-int *convertStringToBinary(char *string) {
+bool batch(char *manifestFileName, bool encoding, bool streaming, bool stats, const PngOptions *pngOptions,
+           const StegoOptions *stegoOptions, WorkerPool *pool) {
     /*
     Summary:
-        Converts a string into its binary representation. Each character in the string is converted to its 7-bit binary
-        equivalent (ASCII), and the function combines these into a single dynamically allocated 1D array. The binary
-        digits for each character are stored sequentially in the array. The function also pads the end of the array with
-        7 additional 0 bits.
+        Encodes or decodes every image listed in a manifest in one process, so the pool, the LSB kernel selection and
+        the per-thread arenas are set up once instead of per image. Entries are spread over the pool, one entry
+        per thread at a time. A status line is printed for each entry as it finishes, followed by a summary with the
+        failure count and the aggregate throughput.
 
     Args:
-        string (char*): The input string to be converted into binary.
+        manifestFileName (char*): The manifest to process, see readManifest(); "-" reads it from stdin.
+        encoding (bool): True to encode each entry's payload into its image, false to decode each image into its
+            output path.
+        streaming (bool): Whether encoding streams PNG carriers row by row, like the -s option.
+        stats (bool): Whether a JSON line of per-stage statistics is printed for each entry, like the --stats option.
+        pngOptions (const PngOptions*): The compression settings for encoded PNGs.
+        stegoOptions (const StegoOptions*): How messages are embedded when encoding, and the key when decoding.
+        pool (WorkerPool*): The pool the entries run on.
 
     Return:
-        Returns a pointer to a dynamically allocated 1D integer array containing the 7-bit binary representation
-        of the string, followed by 7 additional 0 bits. The caller is responsible for freeing the allocated memory after use.
-
-    Note:
-        If memory allocation fails, the function prints an error message and exits the program.
+        Returns true if every entry succeeded. A failing entry is reported and counted, but the rest of the batch still
+        runs.
     */
 
-    int **totalBinaryArray = (int **)malloc(strlen(string) * sizeof(int *));
-    
-    if (!totalBinaryArray) {
-        fprintf(stderr, "Memory allocation failed\n");
-        exit(1);
-    }
-
-    for (int character = 0; character < strlen(string); character++) {
-        totalBinaryArray[character] = convertCharToBinary((unsigned char)string[character], 7);
-    }
+    BatchItem *items;
+    size_t count = readManifest(manifestFileName, &items);
+    int threads = workerPoolThreads(pool);
+    Arena *arenas = (Arena *)malloc((size_t)threads * sizeof(Arena));
+    BatchJob job;
+    struct timespec start;
 
-    int *oneDimBinaryArray = (int *)malloc(((strlen(string) * 7) + 7) * sizeof(int));
-    
-    if (!oneDimBinaryArray) {
+    if (!arenas) {
         fprintf(stderr, "Memory allocation failed\n");
-        exit(1);
-    }
 
-    for (int character = 0; character < strlen(string); character++) {
-        for (int bit = 0; bit < 7; bit++) {
-            oneDimBinaryArray[character * 7 + bit] = totalBinaryArray[character][bit];
+        for (size_t index = 0; index < count; index++) {
+            free(items[index].pictureFileName);
+            free(items[index].textFileName);
         }
 
-        free(totalBinaryArray[character]);
+        free(items);
+        return false;
     }
 
-    free(totalBinaryArray);
+    job.items = items;
+    job.encoding = encoding;
+    job.streaming = streaming;
+    job.stats = stats;
+    job.pngOptions = pngOptions;
+    job.stegoOptions = stegoOptions;
+    job.arenas = arenas;
+    atomic_init(&job.failures, 0);
+    atomic_init(&job.bytes, 0);
+
+    for (int worker = 0; worker < threads; worker++) initArena(&arenas[worker]);
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    runParallel(pool, count, batchItem, &job);
+
+    double seconds = elapsedSeconds(&start);
+    size_t failures = atomic_load(&job.failures);
 
-    for (int index = (strlen(string) * 7); index < ((strlen(string) * 7) + 7); index++) {
-        oneDimBinaryArray[index] = 0;
+    printf("%zu items, %zu failed, %.3f s, %.1f items/s, %.2f MB/s\n", count, failures, seconds,
+           seconds > 0 ? count / seconds : 0.0, seconds > 0 ? atomic_load(&job.bytes) / seconds / 1e6 : 0.0);
+
+    for (int worker = 0; worker < threads; worker++) destroyArena(&arenas[worker]);
+
+    for (size_t index = 0; index < count; index++) {
+        free(items[index].pictureFileName);
+        free(items[index].textFileName);
     }
-    
-    return oneDimBinaryArray;
+
+    free(arenas);
+    free(items);
+
+    return count > 0 && failures == 0;
 }
 
-unsigned char *updated1DPixelData(unsigned char ***imageArray, int height, int width, int channels) {
+static void splitShard(void *context, size_t chunk, int worker) {
     /*
     Summary:
-        Converts a 3D image array back into a 1D array of pixel data. This function also updates each pixel's RGB values by 
-        subtracting the remainder when divided by 2, effectively setting the least significant bit of each channel to 0. 
-        The resulting 1D array contains the modified pixel data in row-major order.
+        Embeds one shard of a split payload into its carrier and prints its status line, like batchItem() does for a
+        manifest entry. The shard record and the shard's slice of the payload are copied into the worker's arena and
+        embedded together as one message, so the header checksum covers both.
 
     Args:
-        imageArray (unsigned char 3D image array): A 3D array representing the image, where each pixel has multiple channels (e.g., RGB).
-        height (int): The height of the image (number of rows of pixels).
-        width (int): The width of the image (number of columns of pixels).
-        channels (int): The number of channels per pixel, typically 3 for RGB.
+        context (void*): The SplitJob describing the payload, the plan and the settings.
+        chunk (size_t): The index of the shard, which is also the index of its carrier.
+        worker (int): The index of the running thread, which selects the arena the shard's working memory comes from.
 
     Return:
-        Returns a pointer to a dynamically allocated 1D array containing the modified pixel data, with each pixel's RGB
-        values flattened into a linear sequence. The caller is responsible for freeing the allocated memory after use.
-
-    Note:
-        If memory allocation fails, the function prints an error message and exits the program.
+        This function does not return any value; failures are counted in the job and the other shards still run.
     */
 
-    unsigned char *flattened3DArray = (unsigned char *)malloc((height * width * channels) * sizeof(unsigned char));
-    
-    if (!flattened3DArray) {
-        fprintf(stderr, "Memory allocation failed\n");
-        exit(1);
+    SplitJob *job = (SplitJob *)context;
+    char *pictureFileName = job->carrierFileNames[chunk];
+    Arena *arena = &job->arenas[worker];
+    StegoShard shard = job->shard;
+    size_t length = (size_t)job->lengths[chunk];
+    StegoStats stats;
+    struct timespec start;
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    attachArena(arena);
+
+    if (job->stats) stegoStatsBegin(&stats);
+
+    char *outputFileName = getOutputFileName(pictureFileName);
+    unsigned char *message = (unsigned char *)workAlloc(SHARD_RECORD_BYTES + length);
+    bool ok = outputFileName && message;
+
+    if (ok) {
+        shard.index = (uint32_t)chunk;
+        shard.offset = job->offsets[chunk];
+        packStegoShard(&shard, message);
+
+        if (length > 0) memcpy(message + SHARD_RECORD_BYTES, job->payload + shard.offset, length);
+
+        if (job->streaming) ok = streamEncode(pictureFileName, (const char *)message, SHARD_RECORD_BYTES + length, outputFileName, job->pngOptions, job->stegoOptions, NULL);
+        else ok = encode(pictureFileName, (const char *)message, SHARD_RECORD_BYTES + length, outputFileName, job->pngOptions, job->stegoOptions, NULL);
+    } else fprintf(stderr, "Memory allocation failed\n");
+
+    if (job->stats) {
+        stegoStatsEnd();
+        printStats(pictureFileName, "encode", ok, &stats);
     }
-    
-    for (int x = 0; x < height; x++) {
-        for (int y = 0; y < width; y++) {
-            for (int channel = 0; channel < channels; channel++) {
-                imageArray[x][y][channel] = imageArray[x][y][channel] - (imageArray[x][y][channel] % 2);
 
-                int index = (x * width * channels) + (y * channels) + channel;
-                flattened3DArray[index] = imageArray[x][y][channel];
-            }
-        }
+    if (ok) {
+        atomic_fetch_add(&job->bytes, length);
+        printf("ok\t%s\tshard %zu/%u\t%zu bytes\t%.1f ms\n", pictureFileName, chunk + 1, shard.count, length,
+               elapsedSeconds(&start) * 1000.0);
+    } else {
+        atomic_fetch_add(&job->failures, 1);
+        printf("FAILED\t%s\n", pictureFileName);
     }
 
-    return flattened3DArray;
+    attachArena(NULL);
+    resetArena(arena);
 }
 
-void createPng(char *filename, unsigned char *pixels, int height, int width) {
+bool split(char *payloadFileName, char **carrierFileNames, size_t count, bool streaming, bool stats,
+           const PngOptions *pngOptions, const StegoOptions *stegoOptions, WorkerPool *pool) {
     /*
     Summary:
-        Creates a PNG image file from a 1D array of pixel data. The function writes pixel data to the file specified
-        by the given filename, with the image being generated from the pixel values in RGB format.
+        Splits a payload too large for one image over several carriers. Every carrier's capacity is read from its
+        header, the payload is divided in proportion to it (see planShards()), and the shards are embedded in
+        parallel, one shard per thread at a time, each into the image next to its carrier that -e would write. Every
+        shard starts with a record giving the id of the split, its index, the number of shards, the payload length and
+        the offset of its slice (see packStegoShard()), and its header is flagged STEGO_FLAG_SHARD, so the shards can
+        only be put back together with reassemble(), in any order.
 
     Args:
-        filename (char*): The name of the file where the PNG image will be saved.
-        pixels (unsigned char*): A 1D array of pixel data in RGB format. Each pixel consists of three consecutive values (R, G, B).
-        height (int): The height of the image (number of rows of pixels).
-        width (int): The width of the image (number of columns of pixels).
+        payloadFileName (char*): The payload to split.
+        carrierFileNames (char**): The carrier images, one shard each.
+        count (size_t): The number of carriers.
+        streaming (bool): Whether PNG carriers are streamed row by row, like the -s option.
+        stats (bool): Whether a JSON line of per-stage statistics is printed for each shard, like the --stats option.
+        pngOptions (const PngOptions*): The compression settings for encoded PNGs.
+        stegoOptions (const StegoOptions*): How the shards are embedded; the payload is never compressed.
+        pool (WorkerPool*): The pool the shards are embedded on.
 
     Return:
-        This function does not return any value; it creates and writes the PNG file to the specified location.
+        Returns true if every shard was embedded. A status line is printed for every shard as it finishes, followed by
+        a summary with the aggregate throughput; errors go to stderr.
 
     Note:
-        If any step (file opening, memory allocation, PNG struct creation) fails, the function prints an error message
-        and safely exits. The caller must ensure valid pixel data is passed and handle memory freeing after use.
+        A carrier too small to hold the shard record, or a payload larger than all the carriers together, is rejected
+        before anything is written. Shards that were written before another one failed are left in place.
     */
 
-    FILE *fp = fopen(filename, "wb");
-    
-    if (!fp) {
-        perror("Error opening file");
-        return;
+    StegoOptions shardOptions = *stegoOptions;
+    Buffer buffer = {NULL, 0};
+    Payload payload = {NULL, 0, false};
+    size_t *capacities = (size_t *)malloc(count * sizeof(size_t));
+    uint64_t *lengths = (uint64_t *)malloc(count * sizeof(uint64_t));
+    uint64_t *offsets = (uint64_t *)malloc(count * sizeof(uint64_t));
+    int threads = workerPoolThreads(pool);
+    Arena *arenas = (Arena *)malloc((size_t)threads * sizeof(Arena));
+    bool ok = capacities && lengths && offsets && arenas;
+
+    shardOptions.shard = true;
+
+    if (!ok) fprintf(stderr, "Memory allocation failed\n");
+    else if (count > UINT32_MAX) {
+        fprintf(stderr, "Too many carriers\n");
+        ok = false;
     }
 
-    png_structp png = png_create_write_struct(PNG_LIBPNG_VER_STRING, NULL, NULL, NULL);
+    for (size_t index = 0; ok && index < count; index++) {
+        StegoImage image;
+
+        // Shards are binary data as far as the capacity goes: the record alone rules out 7-bit packing
+        if (!readImageInfo(carrierFileNames[index], &image)) {
+            fprintf(stderr, "Error loading image: %s\n", carrierFileNames[index]);
+            ok = false;
+        } else if (stegoCapacity(&image, &shardOptions, 8, &capacities[index]) != STEGO_OK ||
+                   capacities[index] < SHARD_RECORD_BYTES) {
+            fprintf(stderr, "%s: too small to hold a shard\n", carrierFileNames[index]);
+            ok = false;
+        } else capacities[index] -= SHARD_RECORD_BYTES;
+    }
 
-    if (!png) {
-        fclose(fp);
-        return;
+    if (ok && !openPayload(payloadFileName, &buffer, &payload)) ok = false;
+
+    if (ok && !planShards(capacities, count, payload.length, lengths)) {
+        fprintf(stderr, "%s: too large for the given carriers together\n", payloadFileName);
+        ok = false;
     }
 
-    png_infop info = png_create_info_struct(png);
+    if (ok) {
+        SplitJob job;
+        struct timespec start;
+        uint64_t offset = 0;
 
-    if (!info) {
-        png_destroy_write_struct(&png, NULL);
-        fclose(fp);
-        return;
+        clock_gettime(CLOCK_MONOTONIC, &start);
+
+        for (size_t index = 0; index < count; index++) {
+            offsets[index] = offset;
+            offset += lengths[index];
+        }
+
+        job.carrierFileNames = carrierFileNames;
+        job.payload = payload.bytes;
+        job.lengths = lengths;
+        job.offsets = offsets;
+        job.shard.id = mixKey((uint64_t)start.tv_sec * 1000000000u + (uint64_t)start.tv_nsec) ^
+                       mixKey(((uint64_t)getpid() << 32) ^ payload.length);
+        job.shard.count = (uint32_t)count;
+        job.shard.totalLength = payload.length;
+        job.streaming = streaming;
+        job.stats = stats;
+        job.pngOptions = pngOptions;
+        job.stegoOptions = &shardOptions;
+        job.arenas = arenas;
+        atomic_init(&job.failures, 0);
+        atomic_init(&job.bytes, 0);
+
+        for (int worker = 0; worker < threads; worker++) initArena(&arenas[worker]);
+
+        runParallel(pool, count, splitShard, &job);
+
+        double seconds = elapsedSeconds(&start);
+        size_t failures = atomic_load(&job.failures);
+
+        printf("%zu shards, %zu failed, %.3f s, %.2f MB/s\n", count, failures, seconds,
+               seconds > 0 ? atomic_load(&job.bytes) / seconds / 1e6 : 0.0);
+
+        for (int worker = 0; worker < threads; worker++) destroyArena(&arenas[worker]);
+
+        ok = failures == 0;
     }
 
-    if (setjmp(png_jmpbuf(png))) {
-        png_destroy_write_struct(&png, &info);
-        fclose(fp);
-        return;
+    closePayload(&payload);
+    workFree(buffer.bytes);
+    free(arenas);
+    free(offsets);
+    free(lengths);
+    free(capacities);
+
+    return ok;
+}
+
+bool writeShard(void *context, const unsigned char *bytes, size_t length) {
+    /*
+    Summary:
+        The sink reassemble() hands every shard to. The shard record is collected first; from then on the data is
+        written straight to its place in the output file, so shards can be extracted in any order and at the same
+        time, and none of them is ever held whole.
+
+    Args:
+        context (void*): The ShardSink of the shard being extracted; a failure is recorded in it and reported on
+            stderr.
+        bytes (const unsigned char*): The next bytes of the shard.
+        length (size_t): The number of bytes.
+
+    Return:
+        Returns true if the bytes were taken, false if the record is invalid, the data runs past the end of the
+        payload the record describes, or writing failed.
+    */
+
+    ShardSink *sink = (ShardSink *)context;
+
+    if (sink->recordBytes < SHARD_RECORD_BYTES) {
+        size_t take = SHARD_RECORD_BYTES - sink->recordBytes < length ? SHARD_RECORD_BYTES - sink->recordBytes : length;
+
+        memcpy(sink->record + sink->recordBytes, bytes, take);
+        sink->recordBytes += take;
+        bytes += take;
+        length -= take;
+
+        if (sink->recordBytes == SHARD_RECORD_BYTES && !unpackStegoShard(sink->record, &sink->shard)) {
+            fprintf(stderr, "%s: the shard record is damaged\n", sink->pictureFileName);
+            sink->failed = true;
+            return false;
+        }
     }
 
-    png_init_io(png, fp);
-    png_set_IHDR(png, info, width, height, 8, PNG_COLOR_TYPE_RGB, PNG_INTERLACE_NONE, PNG_COMPRESSION_TYPE_DEFAULT, PNG_FILTER_TYPE_DEFAULT);
-    png_write_info(png, info);
-    
-    png_bytep row = (png_bytep)malloc(3 * width * sizeof(png_byte));
-    
-    if (!row) {
-        png_destroy_write_struct(&png, &info);
-        fclose(fp);
-        return;
+    if (length == 0) return true;
+
+    if (length > sink->shard.totalLength - sink->shard.offset - sink->length) {
+        fprintf(stderr, "%s: the shard runs past the end of the payload\n", sink->pictureFileName);
+        sink->failed = true;
+        return false;
     }
 
-    for (int y = 0; y < height; y++) {
-        for (int x = 0; x < width; x++) {
-            row[x * 3 + 0] = pixels[(y * width + x) * 3 + 0];
-            row[x * 3 + 1] = pixels[(y * width + x) * 3 + 1];
-            row[x * 3 + 2] = pixels[(y * width + x) * 3 + 2];
+    while (length > 0) {
+        ssize_t written = pwrite(sink->file, bytes, length, (off_t)(sink->shard.offset + sink->length));
+
+        if (written <= 0) {
+            fprintf(stderr, "Error writing %s\n", sink->outputFileName);
+            sink->failed = true;
+            return false;
         }
 
-        png_write_row(png, row);
+        bytes += written;
+        length -= (size_t)written;
+        sink->length += (uint64_t)written;
     }
 
-    free(row);
-    png_write_end(png, NULL);
-    png_destroy_write_struct(&png, &info);
-    fclose(fp);
+    return true;
 }
 
-char *getOutputFileName(char *fileName) {
+static void reassembleShard(void *context, size_t chunk, int worker) {
     /*
     Summary:
-        Generates a new output file name by appending "-output.png" to the original file name (excluding the file extension).
-        This is useful for saving processed images with a modified name based on the original file.
+        Extracts one shard into the output file and prints its status line.
 
     Args:
-        fileName (char*): The original file name, including the extension.
+        context (void*): The ReassembleJob describing the shards and settings.
+        chunk (size_t): The index of the shard image on the command line.
+        worker (int): The index of the running thread, which selects the arena the shard's working memory comes from.
 
     Return:
-        Returns a dynamically allocated string containing the new file name with the "-output.png" suffix.
-        The caller is responsible for freeing the allocated memory after use.
-
-    Note:
-        If memory allocation fails, the function behavior is undefined. The caller must ensure proper memory handling.
+        This function does not return any value; failures are counted in the job and the other shards still run.
     */
 
-    char *outputFileName = (char *)malloc((strlen(fileName) + 11) * sizeof(unsigned char));
+    ReassembleJob *job = (ReassembleJob *)context;
+    ShardSink *sink = &job->sinks[chunk];
+    Arena *arena = &job->arenas[worker];
+    Buffer buffer = {NULL, 0};
+    StegoStats stats;
+    struct timespec start;
 
-    for (int index = 0; index < strlen(fileName); index++) {
-        if (fileName[index] == '.') break;
-        else outputFileName[index] = fileName[index];
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    attachArena(arena);
+
+    if (job->stats) stegoStatsBegin(&stats);
+
+    bool ok = extractImage(job->pictureFileNames[chunk], &buffer, job->stegoOptions, true, writeShard, sink,
+                           &sink->failed, NULL);
+
+    if (ok && sink->recordBytes < SHARD_RECORD_BYTES) {
+        fprintf(stderr, "%s: the shard record is missing\n", sink->pictureFileName);
+        ok = false;
+    }
+
+    if (job->stats) {
+        stegoStatsEnd();
+        printStats(sink->pictureFileName, "decode", ok, &stats);
     }
 
-    strcat((char *)outputFileName, "-output.png");
+    if (ok) {
+        atomic_fetch_add(&job->bytes, sink->length);
+        printf("ok\t%s\tshard %u/%u\t%llu bytes\t%.1f ms\n", sink->pictureFileName, sink->shard.index + 1,
+               sink->shard.count, (unsigned long long)sink->length, elapsedSeconds(&start) * 1000.0);
+    } else {
+        sink->failed = true;
+        atomic_fetch_add(&job->failures, 1);
+        printf("FAILED\t%s\n", sink->pictureFileName);
+    }
 
-    return outputFileName;
+    attachArena(NULL);
+    resetArena(arena);
 }
 
-void encode(char *fileName, char *sentence, char *outputFileName) {
+bool reassemble(char *outputFileName, char **pictureFileNames, size_t count, bool stats, const StegoOptions *stegoOptions,
+                WorkerPool *pool) {
     /*
     Summary:
-        Encodes a text message into an image file by modifying the least significant bits of each pixel in the input image.
-        The encoded message is saved as a new image file. Each character in the text is converted to binary, and the binary 
-        data is embedded sequentially into the pixel data.
+        Puts a payload split by split() back together. The shard images may be given in any order: they are extracted
+        in parallel, one shard per thread at a time, and each shard is written to its offset in the output file as it
+        comes out, so reassembly streams and never holds a shard in memory. Once every shard is in, the records are
+        checked to belong to the same split and to cover the whole payload exactly once.
 
     Args:
-        fileName (char*): The name of the input image file to encode the message into.
-        sentence (char*): The text message to be encoded within the image.
-        outputFileName (char*): The name of the output image file to save the encoded image.
+        outputFileName (char*): The file the payload is written to.
+        pictureFileNames (char**): The encoded images holding the shards.
+        count (size_t): The number of images.
+        stats (bool): Whether a JSON line of per-stage statistics is printed for each shard, like the --stats option.
+        stegoOptions (const StegoOptions*): The key, if the shards were scattered.
+        pool (WorkerPool*): The pool the shards are extracted on.
 
     Return:
-        This function does not return any value; it performs encoding in place and saves the result to the output file.
+        Returns true once the whole payload has been written, false otherwise.
 
     Note:
-        Memory for the dynamically allocated 3D image array, binary array, and updated pixel data is freed after use. 
-        The function relies on the stb_image library to load and free image data. Error handling includes memory 
-        management checks, and any failed memory allocation or image loading operation results in an error message to stderr.
+        If a shard is damaged or missing, or the shards come from different splits, the error is printed to stderr
+        and the output file is removed.
     */
 
-    int width, height, channels;
-    unsigned char *img = stbi_load(fileName, &width, &height, &channels, 0);
+    int threads = workerPoolThreads(pool);
+    ShardSink *sinks = (ShardSink *)calloc(count, sizeof(ShardSink));
+    ShardSink **byIndex = (ShardSink **)calloc(count, sizeof(ShardSink *));
+    Arena *arenas = (Arena *)malloc((size_t)threads * sizeof(Arena));
 
-    if (!img) {
-        fprintf(stderr, "Error loading image\n");
-        exit(0);
+    if (!sinks || !byIndex || !arenas) {
+        fprintf(stderr, "Memory allocation failed\n");
+        free(arenas);
+        free(byIndex);
+        free(sinks);
+        return false;
     }
-    
-    unsigned char ***imageArray = dynamicArray(height, width, channels);
-    loadPixelData(imageArray, img, height, width, channels);
 
-    int *binaryArray = convertStringToBinary(sentence);
-    unsigned char *updatedPixels = updated1DPixelData(imageArray, height, width, channels);
+    int file = open(outputFileName, O_WRONLY | O_CREAT | O_TRUNC, 0666);
 
-    binaryArray = (int *)realloc(binaryArray, ((strlen(sentence) * 7) + 7 + 7) * sizeof(int)); 
+    if (file < 0) {
+        fprintf(stderr, "Error opening file: %s\n", outputFileName);
+        free(arenas);
+        free(byIndex);
+        free(sinks);
+        return false;
+    }
 
-    for (int index = (strlen(sentence) * 7) + 7; index < ((strlen(sentence) * 7) + 7 + 7); index++) binaryArray[index] = 0;
+    ReassembleJob job;
+    struct timespec start;
 
-    // This line needs work, because this just changes the pixel to either a 0 or 1, and that annoying,
-    // the potential fix is to convert the pixel to its binary value 
-    for (int index = 0; index < ((strlen(sentence) * 7) + 7 + 7); index++) updatedPixels[index] = updatedPixels[index] + (unsigned char)binaryArray[index];
+    for (size_t index = 0; index < count; index++) {
+        sinks[index].pictureFileName = pictureFileNames[index];
+        sinks[index].outputFileName = outputFileName;
+        sinks[index].file = file;
+    }
 
-    createPng(outputFileName, updatedPixels, height, width);
+    job.pictureFileNames = pictureFileNames;
+    job.sinks = sinks;
+    job.stats = stats;
+    job.stegoOptions = stegoOptions;
+    job.arenas = arenas;
+    atomic_init(&job.failures, 0);
+    atomic_init(&job.bytes, 0);
+
+    for (int worker = 0; worker < threads; worker++) initArena(&arenas[worker]);
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    runParallel(pool, count, reassembleShard, &job);
+
+    double seconds = elapsedSeconds(&start);
+    size_t failures = atomic_load(&job.failures);
+    uint64_t covered = 0;
+
+    for (int worker = 0; worker < threads; worker++) destroyArena(&arenas[worker]);
+
+    // Every shard of one split, each once, and each starting where the one before it ends. A shard that belongs to
+    // another split or repeats one is counted as failed, and a payload that is still incomplete as one failure, so the
+    // summary agrees with the result
+    bool extracted = failures == 0;
+
+    for (size_t index = 0; extracted && index < count; index++) {
+        const StegoShard *shard = &sinks[index].shard;
+
+        if (shard->id != sinks[0].shard.id || shard->count != sinks[0].shard.count ||
+            shard->totalLength != sinks[0].shard.totalLength) {
+            fprintf(stderr, "%s: belongs to a different split payload than %s\n", sinks[index].pictureFileName,
+                    sinks[0].pictureFileName);
+            failures++;
+        } else if (shard->index < count && !byIndex[shard->index]) byIndex[shard->index] = &sinks[index];
+        else if (shard->index < count) {
+            fprintf(stderr, "%s: holds the same shard as %s\n", sinks[index].pictureFileName,
+                    byIndex[shard->index]->pictureFileName);
+            failures++;
+        }
+    }
 
-    free3DDynamicArray(imageArray, height, width, channels);
-    free(binaryArray);
-    free(updatedPixels);
-    stbi_image_free(img);
-}
+    bool ok = failures == 0;
 
+    if (ok && count != sinks[0].shard.count) {
+        fprintf(stderr, "The payload was split into %u shards, %zu were given\n", sinks[0].shard.count, count);
+        ok = false;
+    }
+
+    for (size_t index = 0; ok && index < count; index++) {
+        if (byIndex[index]->shard.offset != covered) {
+            fprintf(stderr, "%s: the shard does not follow the one before it\n", byIndex[index]->pictureFileName);
+            ok = false;
+        }
+
+        covered += byIndex[index]->length;
+    }
+
+    if (ok && covered != sinks[0].shard.totalLength) {
+        fprintf(stderr, "The shards do not add up to the payload\n");
+        ok = false;
+    }
+
+    if (close(file) != 0 && ok) {
+        fprintf(stderr, "Error writing %s\n", outputFileName);
+        ok = false;
+    }
+
+    if (!ok && failures == 0) failures = 1;
+
+    printf("%zu shards, %zu failed, %.3f s, %.2f MB/s\n", count, failures, seconds,
+           seconds > 0 ? atomic_load(&job.bytes) / seconds / 1e6 : 0.0);
+
+    if (!ok) remove(outputFileName);
 
-void decode(char *outputPictureFileName, char *outputTextFileName) {
+    free(arenas);
+    free(byIndex);
+    free(sinks);
+
+    return ok;
+}
+
+bool countDecoded(void *context, const unsigned char *bytes, size_t length) {
     /*
     Summary:
-        Decodes a message hidden within the least significant bits of each pixel in an encoded image and writes the decoded 
-        text to an output text file. This function iteratively extracts bits from pixel values, reconstructs characters, and 
-        terminates upon detecting a null character (0).
+        The sink of a "check" request: counts the message without writing it anywhere.
 
     Args:
-        outputPictureFileName (char*): The name of the image file containing the encoded message.
-        outputTextFileName (char*): The name of the output file where the decoded text will be saved.
+        context (void*): The size_t the length is added to.
+        bytes (const unsigned char*): The next bytes of the message; unused.
+        length (size_t): The number of bytes.
 
     Return:
-        This function does not return any value; it decodes the message and writes it to the specified text file.
+        Returns true.
+    */
 
-    Note:
-        The function allocates memory for the decoded message string and relies on the stb_image library to load and free 
-        image data. If the image cannot be loaded or memory allocation fails, an error is printed to stderr. The caller 
-        must handle any necessary memory management after calling this function.
+    (void)bytes;
+
+    *(size_t *)context += length;
+
+    return true;
+}
+
+static bool serveRequest(void *context, char *request, int worker, char *reply, size_t replyCapacity) {
+    /*
+    Summary:
+        Answers one daemon request, with the fields separated by tabs like a batch manifest:
+            encode<TAB>picture<TAB>payload   embeds the payload like -e, writing the image next to the picture
+            decode<TAB>picture<TAB>output    extracts the message to the output file like -d
+            check<TAB>picture                extracts the message and verifies its checksum, writing nothing
+        Each request runs on the worker's thread alone, with working memory from the worker's arena, which is reset
+        afterwards but keeps its blocks, so a steady stream of similar images allocates nothing.
+
+    Args:
+        context (void*): The ServeJob with the daemon's settings.
+        request (char*): The request line, without its newline; it is split in place.
+        worker (int): The index of the serving thread, which selects its arena.
+        reply (char*): Receives "ok<TAB>bytes", with the length of the message, or "FAILED<TAB>reason".
+        replyCapacity (size_t): The size of the reply buffer.
+
+    Return:
+        Returns true if the request succeeded, false otherwise. Details of a failure go to stderr, like for -E and -D.
     */
 
-    int binaryPlaces[7] = {0};
-    int width, height, channels;
+    ServeJob *job = (ServeJob *)context;
+    Arena *arena = &job->arenas[worker];
+    char *pictureFileName = strchr(request, '\t');
+    char *textFileName = NULL;
+
+    if (pictureFileName) {
+        *pictureFileName++ = '\0';
+        textFileName = strchr(pictureFileName, '\t');
 
-    unsigned char *encodedImageArray = stbi_load(outputPictureFileName, &width, &height, &channels, 0);
-    char *outputSentence = (char *)malloc((height * width * channels) * sizeof(char));
+        if (textFileName) *textFileName++ = '\0';
+    }
 
-    FILE *outputDecodedFile = fopen(outputTextFileName, "w+");
+    bool checking = strcmp(request, "check") == 0;
+    bool encoding = strcmp(request, "encode") == 0;
 
-    if (outputDecodedFile == NULL) {
-        fprintf(stderr, "Error opening file: %s\n", outputTextFileName);
-        free(outputSentence);
-        return;
+    if ((!checking && !encoding && strcmp(request, "decode") != 0) || !pictureFileName || !*pictureFileName ||
+        (!checking && (!textFileName || !*textFileName))) {
+        snprintf(reply, replyCapacity, "FAILED\texpected encode, decode or check and tab-separated paths");
+        return false;
     }
 
-    for (int index = 0; index < 7; index++) binaryPlaces[index] = (int)pow(2, 6-index);
+    Buffer buffer = {NULL, 0};
+    Buffer packed = {NULL, 0};
+    StegoOptions stegoOptions = *job->stegoOptions;
+    StegoStats stats;
+    size_t length = 0;
+    bool ok;
 
-    bool stillRunning = true;
-    int imageIndex = 0;
-    int charIndex = 0;
+    attachArena(arena);
 
-    while (stillRunning) {
-        int bits[7] = {0};
+    if (job->stats) stegoStatsBegin(&stats);
 
-        for (int index = 0; index < 7; index++) {
-            bits[index] = encodedImageArray[imageIndex] % 2; // Gets the LSB of every pixel
-                
-            imageIndex++;
-        }
+    if (encoding) {
+        char *outputFileName = getOutputFileName(pictureFileName);
+        Payload payload = {NULL, 0, false};
+
+        ok = outputFileName && openPayload(textFileName, &buffer, &payload) &&
+             packPayload(&payload, &packed, &stegoOptions);
 
-        int charCode = 0;
+        if (ok && job->streaming) ok = streamEncode(pictureFileName, (const char *)payload.bytes, payload.length, outputFileName, job->pngOptions, &stegoOptions, NULL);
+        else if (ok) ok = encode(pictureFileName, (const char *)payload.bytes, payload.length, outputFileName, job->pngOptions, &stegoOptions, NULL);
 
-        for (int i = 0; i < 7; i++) charCode += binaryPlaces[i] * bits[i];
+        length = payload.length;
+        closePayload(&payload);
+    } else if (checking) {
+        bool failed = false;
 
-        if (charCode == 0) stillRunning = false; // Null terminator check
-        else outputSentence[charIndex++] = (char)(charCode);
+        ok = extractImage(pictureFileName, &buffer, &stegoOptions, false, countDecoded, &length, &failed, NULL);
+    } else ok = decode(pictureFileName, textFileName, &buffer, &length, &stegoOptions, NULL);
+
+    if (job->stats) {
+        stegoStatsEnd();
+        printStats(pictureFileName, encoding ? "encode" : "decode", ok, &stats);
     }
 
-    outputSentence[charIndex] = '\0';
+    if (ok) snprintf(reply, replyCapacity, "ok\t%zu", length);
+    else snprintf(reply, replyCapacity, "FAILED\t%s", pictureFileName);
 
-    fprintf(outputDecodedFile, "%s", outputSentence);
+    attachArena(NULL);
+    resetArena(arena);
 
-    fclose(outputDecodedFile);
-    stbi_image_free(encodedImageArray);
-    free(outputSentence);
+    return ok;
 }
 
-char *readTextFromFile(char *inputTextFileName) {
+bool serve(char *socketPath, int threads, bool streaming, bool stats, const PngOptions *pngOptions,
+           const StegoOptions *stegoOptions) {
     /*
     Summary:
-        Reads the contents of a text file into a dynamically allocated string. The function opens the specified file,
-        determines its size, and allocates a buffer to hold the entire content of the file, which it then reads into 
-        the buffer.
+        Runs the daemon: answers encode, decode and check requests on a Unix domain socket (see runServer() and
+        serveRequest()) until SIGINT or SIGTERM. The LSB kernels are already selected and every worker's arena is
+        reserved and faulted in before the socket opens, so the first requests are as fast as the rest.
 
     Args:
-        inputTextFileName (char*): The name of the input text file to be read.
+        socketPath (char*): The path to listen on.
+        threads (int): The number of workers.
+        streaming (bool): Whether encoding streams PNG carriers row by row, like the -s option.
+        stats (bool): Whether a JSON line of per-stage statistics is printed for each request, like --stats.
+        pngOptions (const PngOptions*): The compression settings for encoded PNGs.
+        stegoOptions (const StegoOptions*): How messages are embedded, and the key for scattered messages.
 
     Return:
-        Returns a pointer to a dynamically allocated string containing the contents of the file. The caller is 
-        responsible for freeing the allocated memory after use. If the file cannot be opened or memory allocation fails, 
-        the function returns NULL.
-
-    Note:
-        If any error occurs (file not found, memory allocation failure), an appropriate error message is printed to 
-        stderr, and the function safely exits by returning NULL.
+        Returns true once the daemon has been stopped, false if it could not start (an error is printed to stderr).
     */
 
+    size_t arenaCount = (size_t)threads + 1;
+    Arena *arenas = (Arena *)malloc(arenaCount * sizeof(Arena));
+    ServeJob job = {streaming, stats, pngOptions, stegoOptions, arenas};
+
+    if (!arenas) {
+        fprintf(stderr, "Memory allocation failed\n");
+        return false;
+    }
+
+    for (size_t index = 0; index < arenaCount; index++) {
+        initArena(&arenas[index]);
 
-    FILE *inputFile = fopen(inputTextFileName, "r+");
+        unsigned char *warm = (unsigned char *)arenaAlloc(&arenas[index], SERVE_WARM_BYTES);
 
-    if (inputFile == NULL) {
-        perror("Error opeaning file\n");
-        return NULL;
+        if (warm) memset(warm, 0, SERVE_WARM_BYTES);
+
+        resetArena(&arenas[index]);
     }
 
-    fseek(inputFile, 0, SEEK_END);
+    bool ok = runServer(socketPath, threads, serveRequest, &job);
+
+    for (size_t index = 0; index < arenaCount; index++) destroyArena(&arenas[index]);
+
+    free(arenas);
+
+    return ok;
+}
+
+void printStats(const char *fileName, const char *operation, bool ok, const StegoStats *stats) {
+    /*
+    Summary:
+        Prints the statistics recorded for one image as a single line of JSON on stderr, so they can be collected
+        with the rest of a run's diagnostics and parsed line by line. The line holds the total time and allocations,
+        and an object per stage that ran with its time, calls, bytes, throughput and allocations:
+            {"image":"a.png","operation":"encode","ok":true,"total_ms":41.2,"allocs":38,"alloc_bytes":3696640,
+             "stages":{"load":{"ms":20.1,"calls":2,"bytes":3686400,"MBps":183.4,"allocs":31,"alloc_bytes":3689913},...}}
+
+    Args:
+        fileName (const char*): The image the statistics belong to.
+        operation (const char*): "encode" or "decode".
+        ok (bool): Whether the operation succeeded.
+        stats (const StegoStats*): The statistics to print.
+
+    Return:
+        This function does not return any value.
+
+    Note:
+        stderr is locked for the whole line, so the lines of a batch running on many threads never interleave.
+        Allocations made outside any stage are reported as the "other" stage.
+    */
 
-    unsigned long long fileSize = (unsigned long long)ftell(inputFile);
+    uint64_t allocations = 0;
+    uint64_t allocatedBytes = 0;
+    bool first = true;
 
-    fseek(inputFile, 0, SEEK_SET);
+    for (int stage = 0; stage < STEGO_STAGE_COUNT; stage++) {
+        allocations += stats->stages[stage].allocations;
+        allocatedBytes += stats->stages[stage].allocatedBytes;
+    }
 
-    char *buffer = (char *)malloc((fileSize + 1) * sizeof(char));
+    flockfile(stderr);
+    fputs("{\"image\":\"", stderr);
 
-    if (buffer == NULL) {
-        perror("Memmory allocation failed\n");
-        fclose(inputFile);
-        return NULL;
+    for (const unsigned char *c = (const unsigned char *)fileName; *c; c++) {
+        if (*c == '"' || *c == '\\') fprintf(stderr, "\\%c", *c);
+        else if (*c < 0x20) fprintf(stderr, "\\u%04x", *c);
+        else fputc(*c, stderr);
     }
 
-    fread(buffer, 1, fileSize, inputFile);
-    fclose(inputFile);
+    fprintf(stderr, "\",\"operation\":\"%s\",\"ok\":%s,\"total_ms\":%.3f,\"allocs\":%llu,\"alloc_bytes\":%llu,\"stages\":{",
+            operation, ok ? "true" : "false", stats->totalNanoseconds / 1e6, (unsigned long long)allocations,
+            (unsigned long long)allocatedBytes);
+
+    for (int index = 0; index < STEGO_STAGE_COUNT; index++) {
+        const StegoStageStats *stage = &stats->stages[index];
+
+        if (stage->calls == 0 && stage->allocations == 0) continue;
+
+        fprintf(stderr, "%s\"%s\":{\"ms\":%.3f,\"calls\":%llu,\"bytes\":%llu,\"MBps\":%.1f,\"allocs\":%llu,\"alloc_bytes\":%llu}",
+                first ? "" : ",", stegoStageName((StegoStage)index), stage->nanoseconds / 1e6, (unsigned long long)stage->calls,
+                (unsigned long long)stage->bytes, stage->nanoseconds ? stage->bytes * 1e3 / stage->nanoseconds : 0.0,
+                (unsigned long long)stage->allocations, (unsigned long long)stage->allocatedBytes);
+        first = false;
+    }
 
-    return buffer;
+    fputs("}}\n", stderr);
+    funlockfile(stderr);
 }